@@ -0,0 +1,320 @@
+/*************************************************************************
+ * Copyright (c) 2024, NVIDIA CORPORATION. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+// Bootstrap scaling benchmark. Emulates a job of N ranks on one machine, as threads of processes
+// which each stand for a node, talking over loopback. Reports how long each phase of the bootstrap
+// takes: bootstrapGetUniqueId, bootstrapInit, bootstrapAllGather, bootstrapBarrier and
+// bootstrapSplit (with the allgather of colors and keys ncclCommSplit does first). No GPU is used.
+//
+// For each phase we report the time of the slowest rank, which the job waits for, and the average
+// over ranks. AllGather and Barrier are averaged over iterations.
+
+#include "comm.h"
+#include "bootstrap.h"
+#include "ipcsocket.h"
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <getopt.h>
+#include <algorithm>
+
+enum { PHASE_INIT, PHASE_ALLGATHER, PHASE_BARRIER, PHASE_SPLIT, NPHASES };
+static const char* phaseNames[NPHASES] = { "Init", "AllGather", "Barrier", "Split" };
+
+struct benchArgs {
+  int minRanks;
+  int maxRanks;
+  int factor;
+  int ranksPerProc;
+  int iters;
+  int size;      // allgather bytes per rank
+  int nColors;   // split colors
+};
+
+struct benchRun {
+  struct benchArgs* args;
+  struct ncclBootstrapHandle handle;
+  int nranks;
+  double* times;      // [nranks][NPHASES] us, shared with the processes of the run
+};
+
+static double usSince(uint64_t t0) {
+  return (clockNano()-t0)/1e3;
+}
+
+// Neither the proxy thread nor the rest of the comm are created: release what bootstrapInit and
+// bootstrapSplit set up for the proxy ourselves
+static void benchProxyFree(struct ncclComm* comm) {
+  struct ncclProxyState* proxyState = comm->proxyState;
+  if (proxyState == NULL) return;
+  ncclSocketClose(proxyState->listenSock);
+  free(proxyState->listenSock);
+  ncclIpcSocketClose(&proxyState->ipcSock);
+  free(proxyState->peerAddresses);
+  free(proxyState->peerAddressesUDS);
+  free(proxyState);
+}
+
+static ncclResult_t benchCommAlloc(struct ncclComm** comm, int rank, int nranks, uint32_t* abortFlag) {
+  NCCLCHECK(ncclCalloc(comm, 1));
+  NCCLCHECK(ncclCalloc(&(*comm)->sharedRes, 1));
+  (*comm)->rank = rank;
+  (*comm)->nRanks = nranks;
+  (*comm)->cudaDev = -1;
+  (*comm)->abortFlag = abortFlag;
+  return ncclSuccess;
+}
+
+static void benchCommFree(struct ncclComm* comm) {
+  if (comm == NULL) return;
+  benchProxyFree(comm);
+  free(comm->sharedRes);
+  free(comm);
+}
+
+// Split the comm by rank % nColors, keyed by rank, as ncclCommSplit does
+static ncclResult_t benchSplit(struct ncclComm* comm, int nColors, struct ncclComm** child) {
+  ncclResult_t ret = ncclSuccess;
+  int rank = comm->rank, nranks = comm->nRanks;
+  int color = rank % nColors;
+  int* info = NULL, *parentRanks = NULL;
+  int childRank = -1, childNRanks = 0;
+  ncclUniqueId commId;
+
+  NCCLCHECKGOTO(ncclCalloc(&info, 2*nranks), ret, exit);
+  NCCLCHECKGOTO(ncclCalloc(&parentRanks, nranks), ret, exit);
+  info[2*rank] = color;
+  info[2*rank+1] = rank;
+  NCCLCHECKGOTO(bootstrapAllGather(comm->bootstrap, info, 2*sizeof(int)), ret, exit);
+  for (int r=0; r<nranks; r++) {
+    if (info[2*r] != color) continue;
+    if (r == rank) childRank = childNRanks;
+    parentRanks[childNRanks++] = r;
+  }
+  memset(&commId, 0, sizeof(commId));
+  snprintf((char*)&commId, sizeof(commId), "%016lx-%d", comm->magic, color);
+  NCCLCHECKGOTO(benchCommAlloc(child, childRank, childNRanks, comm->abortFlag), ret, exit);
+  NCCLCHECKGOTO(bootstrapSplit((struct ncclBootstrapHandle*)&commId, *child, comm, color, rank, parentRanks), ret, exit);
+exit:
+  free(info);
+  free(parentRanks);
+  return ret;
+}
+
+struct benchRankArgs {
+  struct benchRun* run;
+  int rank;
+  ncclResult_t ret;
+};
+
+static ncclResult_t benchRank(struct benchRun* run, int rank) {
+  ncclResult_t ret = ncclSuccess;
+  struct benchArgs* args = run->args;
+  int nranks = run->nranks;
+  double* times = run->times+rank*NPHASES;
+  struct ncclComm* comm = NULL, *child = NULL;
+  char* data = NULL;
+  static uint32_t abortFlag = 0;
+  uint64_t t0;
+
+  NCCLCHECKGOTO(benchCommAlloc(&comm, rank, nranks, &abortFlag), ret, fail);
+  t0 = clockNano();
+  NCCLCHECKGOTO(bootstrapInit(&run->handle, comm), ret, fail);
+  times[PHASE_INIT] = usSince(t0);
+
+  NCCLCHECKGOTO(ncclCalloc(&data, (size_t)args->size*nranks), ret, fail);
+  NCCLCHECKGOTO(bootstrapBarrier(comm->bootstrap, rank, nranks, 0), ret, fail);
+  t0 = clockNano();
+  for (int i=0; i<args->iters; i++) {
+    NCCLCHECKGOTO(bootstrapAllGather(comm->bootstrap, data, args->size), ret, fail);
+  }
+  times[PHASE_ALLGATHER] = usSince(t0)/args->iters;
+
+  NCCLCHECKGOTO(bootstrapBarrier(comm->bootstrap, rank, nranks, 0), ret, fail);
+  t0 = clockNano();
+  for (int i=0; i<args->iters; i++) {
+    NCCLCHECKGOTO(bootstrapBarrier(comm->bootstrap, rank, nranks, 0), ret, fail);
+  }
+  times[PHASE_BARRIER] = usSince(t0)/args->iters;
+
+  NCCLCHECKGOTO(bootstrapBarrier(comm->bootstrap, rank, nranks, 0), ret, fail);
+  t0 = clockNano();
+  NCCLCHECKGOTO(benchSplit(comm, args->nColors, &child), ret, fail);
+  times[PHASE_SPLIT] = usSince(t0);
+
+  // Do not tear down until everyone is done with us
+  NCCLCHECKGOTO(bootstrapBarrier(child->bootstrap, child->rank, child->nRanks, 0), ret, fail);
+  NCCLCHECKGOTO(bootstrapBarrier(comm->bootstrap, rank, nranks, 0), ret, fail);
+  NCCLCHECKGOTO(bootstrapClose(child->bootstrap), ret, fail);
+  child->bootstrap = NULL;
+  NCCLCHECKGOTO(bootstrapClose(comm->bootstrap), ret, fail);
+  comm->bootstrap = NULL;
+
+exit:
+  free(data);
+  benchCommFree(child);
+  benchCommFree(comm);
+  return ret;
+fail:
+  if (child && child->bootstrap) bootstrapAbort(child->bootstrap);
+  if (comm && comm->bootstrap) bootstrapAbort(comm->bootstrap);
+  if (child) child->bootstrap = NULL;
+  if (comm) comm->bootstrap = NULL;
+  goto exit;
+}
+
+static void* benchRankThread(void* rargs) {
+  struct benchRankArgs* args = (struct benchRankArgs*)rargs;
+  args->ret = benchRank(args->run, args->rank);
+  if (args->ret != ncclSuccess) WARN("Rank %d failed : %s", args->rank, ncclGetErrorString(args->ret));
+  return NULL;
+}
+
+// A process of the run: stands for a node, with one thread per rank
+static int benchProc(struct benchRun* run, int node, int firstRank, int nLocal) {
+  struct benchRankArgs* rankArgs;
+  pthread_t* threads;
+  pthread_attr_t attr;
+  char hostId[64];
+  int failed = 0;
+
+  snprintf(hostId, sizeof(hostId), "bootstrap-bench-node-%d", node);
+  setenv("NCCL_HOSTID", hostId, 1);
+  if (ncclCalloc(&rankArgs, nLocal) != ncclSuccess || ncclCalloc(&threads, nLocal) != ncclSuccess) return 1;
+  pthread_attr_init(&attr);
+  pthread_attr_setstacksize(&attr, 1024*1024);
+  for (int i=0; i<nLocal; i++) {
+    rankArgs[i].run = run;
+    rankArgs[i].rank = firstRank+i;
+    int err = pthread_create(threads+i, &attr, benchRankThread, rankArgs+i);
+    if (err != 0) {
+      WARN("Could not create thread for rank %d : %s", firstRank+i, strerror(err));
+      _exit(1);
+    }
+  }
+  for (int i=0; i<nLocal; i++) {
+    pthread_join(threads[i], NULL);
+    if (rankArgs[i].ret != ncclSuccess) failed = 1;
+  }
+  return failed;
+}
+
+static void benchPrint(double* times, int nranks, int phase) {
+  double max = 0, sum = 0;
+  for (int r=0; r<nranks; r++) {
+    max = std::max(max, times[r*NPHASES+phase]);
+    sum += times[r*NPHASES+phase];
+  }
+  printf("  %10.1f %10.1f", max, sum/nranks);
+}
+
+static ncclResult_t benchRanks(struct benchArgs* args, int nranks) {
+  struct benchRun run;
+  int nProcs = DIVUP(nranks, args->ranksPerProc);
+  size_t timesSize = (size_t)nranks*NPHASES*sizeof(double);
+  int failed = 0;
+  pid_t* pids;
+  uint64_t t0;
+  double idTime;
+
+  memset(&run, 0, sizeof(run));
+  run.args = args;
+  run.nranks = nranks;
+  run.times = (double*)mmap(NULL, timesSize, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+  if (run.times == MAP_FAILED) {
+    WARN("Could not map %ld bytes : %s", timesSize, strerror(errno));
+    return ncclSystemError;
+  }
+  NCCLCHECK(ncclCalloc(&pids, nProcs));
+
+  // The root runs in this process, which then only waits
+  t0 = clockNano();
+  NCCLCHECK(bootstrapGetUniqueId(&run.handle));
+  idTime = usSince(t0);
+
+  fflush(stdout);
+  for (int p=0; p<nProcs; p++) {
+    int firstRank = p*args->ranksPerProc;
+    pids[p] = fork();
+    if (pids[p] == 0) _exit(benchProc(&run, p, firstRank, std::min(args->ranksPerProc, nranks-firstRank)));
+    if (pids[p] < 0) {
+      WARN("fork failed : %s", strerror(errno));
+      failed = 1;
+      nProcs = p;
+      break;
+    }
+  }
+  for (int p=0; p<nProcs; p++) {
+    int status;
+    if (waitpid(pids[p], &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) failed = 1;
+  }
+
+  printf("%8d %6d %10.1f", nranks, nProcs, idTime);
+  if (failed) {
+    printf("  FAILED\n");
+  } else {
+    for (int p=0; p<NPHASES; p++) benchPrint(run.times, nranks, p);
+    printf("\n");
+  }
+  free(pids);
+  munmap(run.times, timesSize);
+  return failed ? ncclSystemError : ncclSuccess;
+}
+
+static void benchUsage(const char* name) {
+  printf("Usage: %s [options]\n"
+         "  -b <ranks>   smallest number of ranks (default 8)\n"
+         "  -e <ranks>   largest number of ranks (default 2048)\n"
+         "  -f <factor>  number of ranks multiplied by this from one run to the next (default 2)\n"
+         "  -r <ranks>   ranks per process, each process standing for a node (default 8)\n"
+         "  -n <iters>   AllGather and Barrier iterations (default 20)\n"
+         "  -s <bytes>   AllGather bytes per rank (default 64)\n"
+         "  -c <colors>  Split colors (default 2)\n"
+         "Other settings come from the usual NCCL_BOOTSTRAP_* and NCCL_SOCKET_* variables.\n", name);
+}
+
+int main(int argc, char* argv[]) {
+  struct benchArgs args = { 8, 2048, 2, 8, 20, 64, 2 };
+  struct rlimit filesLimit;
+  int c;
+
+  while ((c = getopt(argc, argv, "b:e:f:r:n:s:c:h")) != -1) {
+    switch (c) {
+      case 'b': args.minRanks = atoi(optarg); break;
+      case 'e': args.maxRanks = atoi(optarg); break;
+      case 'f': args.factor = atoi(optarg); break;
+      case 'r': args.ranksPerProc = atoi(optarg); break;
+      case 'n': args.iters = atoi(optarg); break;
+      case 's': args.size = atoi(optarg); break;
+      case 'c': args.nColors = atoi(optarg); break;
+      default: benchUsage(argv[0]); return c == 'h' ? 0 : 1;
+    }
+  }
+  if (args.minRanks < 1 || args.maxRanks < args.minRanks || args.factor < 2 || args.ranksPerProc < 1 ||
+      args.iters < 1 || args.size < 1 || args.nColors < 1) {
+    benchUsage(argv[0]);
+    return 1;
+  }
+
+  // Every rank holds a few sockets
+  if (getrlimit(RLIMIT_NOFILE, &filesLimit) == 0) {
+    filesLimit.rlim_cur = filesLimit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &filesLimit);
+  }
+  setenv("NCCL_SOCKET_IFNAME", "lo", 0);
+  if (bootstrapNetInit() != ncclSuccess) return 1;
+
+  printf("# Bootstrap benchmark: %d ranks per process, %d iterations, %d bytes per rank, %d split colors\n",
+      args.ranksPerProc, args.iters, args.size, args.nColors);
+  printf("# Times in us: slowest rank, then average over ranks\n");
+  printf("#%7s %6s %10s", "nranks", "procs", "UniqueId");
+  for (int p=0; p<NPHASES; p++) printf("  %21s", phaseNames[p]);
+  printf("\n");
+  for (long n=args.minRanks; n<=args.maxRanks; n*=args.factor) {
+    if (benchRanks(&args, n) != ncclSuccess) return 1;
+  }
+  return 0;
+}
@@ -11,6 +11,7 @@ KEEP ?= 0
 DEBUG ?= 0
 ASAN ?= 0
 TRACE ?= 0
+TRACEPOINTS ?= 0
 PROFAPI ?= 1
 NVTX ?= 1
 RDMA_CORE ?= 0
@@ -104,6 +105,10 @@ ifneq ($(TRACE), 0)
 CXXFLAGS  += -DENABLE_TRACE
 endif
 
+ifneq ($(TRACEPOINTS), 0)
+CXXFLAGS  += -DENABLE_TRACEPOINTS
+endif
+
 ifeq ($(NVTX), 0)
 CXXFLAGS  += -DNVTX_DISABLE
 endif
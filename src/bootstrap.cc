@@ -61,6 +61,12 @@ ncclResult_t bootstrapNetInit() {
   return ncclSuccess;
 }
 
+// Negative tags are reserved for the bootstrap itself
+#define BOOTSTRAP_TAG_SPLIT -2
+#define BOOTSTRAP_TAG_ALLGATHER -3
+#define BOOTSTRAP_TAG_INTRANODE_ALLGATHER -4
+#define BOOTSTRAP_TAG_SHM -5
+
 /* Socket Interface Selection type */
 enum bootstrapInterface_t { findSubnetIf = -1, dontCareIf = -2 };
 
@@ -99,6 +105,18 @@ struct extInfo {
 };
 
 #include <sys/resource.h>
+#include <sys/epoll.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <stddef.h>
+#include <limits.h>
+#include <algorithm>
+#include "shm.h"
+
+// Ranks connecting to the root directly do so this many per millisecond
+#define BOOTSTRAP_ROOT_STAGGER 64
 
 static ncclResult_t setFilesLimit() {
   struct rlimit filesLimit;
@@ -108,85 +126,624 @@ static ncclResult_t setFilesLimit() {
   return ncclSuccess;
 }
 
-static void *bootstrapRoot(void* rargs) {
-  struct bootstrapRootArgs* args = (struct bootstrapRootArgs*)rargs;
-  struct ncclSocket* listenSock = args->listenSock;
-  uint64_t magic = args->magic;
-  ncclResult_t res = ncclSuccess;
-  int nranks = 0, c = 0;
+// The root collects the extInfo of every rank, then sends each rank the address of its successor
+// in the bootstrap ring. It serves all connections at once from an epoll loop: ranks connect,
+// send their extInfo and close, and the root connects back to the extAddressListenRoot of each
+// rank to reply, with up to NCCL_BOOTSTRAP_ROOT_CONNECTS connections in flight.
+//
+// With NCCL_BOOTSTRAP_HIERARCHICAL=1, the ranks of a node instead go through a sub-root, run by
+// whichever of them first binds an abstract unix socket named after the bootstrap handle and the
+// number of times it was used. The sub-root relays the extInfo of its local ranks over a single
+// connection to the root, which replies on that same connection, and it then forwards each reply
+// to its rank. Ranks behind a sub-root leave extAddressListenRoot empty.
+NCCL_PARAM(BootstrapHierarchical, "BOOTSTRAP_HIERARCHICAL", 0);
+NCCL_PARAM(BootstrapRootConnects, "BOOTSTRAP_ROOT_CONNECTS", 256);
+
+// Connection accepted by the root or a sub-root, or opened by the root to reply to a rank
+struct bootstrapRootConn {
+  struct ncclSocket sock;
+  int size;             // extInfo being received
+  int offset;
   struct extInfo info;
-  union ncclSocketAddress *rankAddresses = NULL;
-  union ncclSocketAddress *rankAddressesRoot = NULL; // for initial rank <-> root information exchange
-  union ncclSocketAddress *zero = NULL;
-  NCCLCHECKGOTO(ncclCalloc(&zero, 1), res, out);
-  setFilesLimit();
+  int* ranks;           // ranks relayed by a sub-root on this connection, in order
+  int nRanks;
+  char* reply;          // replies being sent, framed as by bootstrapNetSend
+  int replySize;
+  uint64_t magic;       // sub-root: magic sent by a local rank before its extInfo
+  int magicOffset;
+};
 
-  TRACE(NCCL_INIT, "BEGIN");
-  /* Receive addresses from all ranks */
-  do {
-    struct ncclSocket sock;
-    NCCLCHECKGOTO(ncclSocketInit(&sock), res, out);
-    NCCLCHECKGOTO(ncclSocketAccept(&sock, listenSock), res, out);
-    NCCLCHECKGOTO(bootstrapNetRecv(&sock, &info, sizeof(info)), res, out);
-    NCCLCHECKGOTO(ncclSocketClose(&sock), res, out);
+struct bootstrapSubRootArgs {
+  int listenFd;
+  union ncclSocketAddress rootAddr;
+  uint64_t magic;
+};
+
+static bool bootstrapAddrValid(union ncclSocketAddress* addr) {
+  return addr->sa.sa_family == AF_INET || addr->sa.sa_family == AF_INET6;
+}
+
+static ncclResult_t bootstrapEpollCtl(int epollFd, int op, int fd, uint32_t events, void* ptr) {
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = events;
+  ev.data.ptr = ptr;
+  SYSCHECK(epoll_ctl(epollFd, op, fd, &ev), "epoll_ctl");
+  return ncclSuccess;
+}
+
+static void bootstrapRootConnFree(struct bootstrapRootConn* conn) {
+  ncclSocketClose(&conn->sock);
+  free(conn->ranks);
+  free(conn->reply);
+  free(conn);
+}
+
+// Receive what is available of the next extInfo sent on a connection, without blocking. Sets
+// *done once it is complete, and *closed if the peer closed the connection instead.
+static ncclResult_t bootstrapRootRecvInfo(struct bootstrapRootConn* conn, int* done, int* closed) {
+  struct iovec iov[2] = { { &conn->size, sizeof(int) }, { &conn->info, sizeof(struct extInfo) } };
+  *done = *closed = 0;
+  NCCLCHECK(ncclSocketProgressIov(NCCL_SOCKET_RECV, &conn->sock, iov, 2, &conn->offset, closed));
+  if (*closed && conn->offset != 0) {
+    WARN("Bootstrap Root : connection closed in the middle of a message");
+    return ncclRemoteError;
+  }
+  if (conn->offset >= (int)sizeof(int) && conn->size != sizeof(struct extInfo)) {
+    WARN("Bootstrap Root : received message of %d bytes instead of %ld", conn->size, sizeof(struct extInfo));
+    return ncclInternalError;
+  }
+  if (conn->offset == sizeof(int)+sizeof(struct extInfo)) {
+    conn->offset = 0;
+    *done = 1;
+  }
+  return ncclSuccess;
+}
+
+// Append the framed address to the replies of a connection
+static ncclResult_t bootstrapRootAddReply(struct bootstrapRootConn* conn, union ncclSocketAddress* addr) {
+  const int size = sizeof(union ncclSocketAddress);
+  const int msgSize = sizeof(int)+size;
+  NCCLCHECK(ncclRealloc(&conn->reply, conn->replySize, conn->replySize+msgSize));
+  memcpy(conn->reply+conn->replySize, &size, sizeof(int));
+  memcpy(conn->reply+conn->replySize+sizeof(int), addr, size);
+  conn->replySize += msgSize;
+  return ncclSuccess;
+}
+
+struct bootstrapRootState {
+  uint64_t magic;
+  int epollFd;
+  int nranks;
+  int nReceived;
+  bool* received;
+  union ncclSocketAddress* rankAddresses;
+  union ncclSocketAddress* rankAddressesRoot; // for initial rank <-> root information exchange
+  struct bootstrapRootConn** conns;           // connections accepted, or opened to reply
+  int nConns;
+  int maxConns;
+};
+
+static ncclResult_t bootstrapRootAddConn(struct bootstrapRootState* root, struct bootstrapRootConn* conn, uint32_t events) {
+  if (root->nConns == root->maxConns) {
+    int maxConns = std::max(2*root->maxConns, 64);
+    NCCLCHECK(ncclRealloc(&root->conns, root->maxConns, maxConns));
+    root->maxConns = maxConns;
+  }
+  root->conns[root->nConns++] = conn;
+  NCCLCHECK(bootstrapEpollCtl(root->epollFd, EPOLL_CTL_ADD, conn->sock.fd, events, conn));
+  return ncclSuccess;
+}
+
+static void bootstrapRootRemoveConn(struct bootstrapRootState* root, struct bootstrapRootConn* conn) {
+  for (int i=0; i<root->nConns; i++) {
+    if (root->conns[i] != conn) continue;
+    root->conns[i] = root->conns[--root->nConns];
+    break;
+  }
+  // The socket may outlive close() if the process forked, so remove it explicitly
+  if (conn->sock.fd >= 0) epoll_ctl(root->epollFd, EPOLL_CTL_DEL, conn->sock.fd, NULL);
+  bootstrapRootConnFree(conn);
+}
+
+static ncclResult_t bootstrapRootHandleInfo(struct bootstrapRootState* root, struct bootstrapRootConn* conn) {
+  struct extInfo* info = &conn->info;
+  if (root->nReceived == 0) {
+    root->nranks = info->nranks;
+    NCCLCHECK(ncclCalloc(&root->received, root->nranks));
+    NCCLCHECK(ncclCalloc(&root->rankAddresses, root->nranks));
+    NCCLCHECK(ncclCalloc(&root->rankAddressesRoot, root->nranks));
+  }
+  if (root->nranks != info->nranks) {
+    WARN("Bootstrap Root : mismatch in rank count from procs %d : %d", root->nranks, info->nranks);
+    return ncclInvalidUsage;
+  }
+  if (info->rank < 0 || info->rank >= root->nranks) {
+    WARN("Bootstrap Root : invalid rank %d of %d ranks", info->rank, root->nranks);
+    return ncclInvalidUsage;
+  }
+  if (root->received[info->rank]) {
+    WARN("Bootstrap Root : rank %d of %d ranks has already checked in", info->rank, root->nranks);
+    return ncclInvalidUsage;
+  }
+
+  // Save the connection handle for that rank
+  root->received[info->rank] = true;
+  memcpy(root->rankAddressesRoot+info->rank, &info->extAddressListenRoot, sizeof(union ncclSocketAddress));
+  memcpy(root->rankAddresses+info->rank, &info->extAddressListen, sizeof(union ncclSocketAddress));
+  if (!bootstrapAddrValid(&info->extAddressListenRoot)) {
+    // Relayed by a sub-root, which expects the reply on this connection
+    NCCLCHECK(ncclRealloc(&conn->ranks, conn->nRanks, conn->nRanks+1));
+    conn->ranks[conn->nRanks++] = info->rank;
+  }
+
+  ++root->nReceived;
+  TRACE(NCCL_INIT, "Received connect from rank %d total %d/%d", info->rank, root->nReceived, root->nranks);
+  return ncclSuccess;
+}
+
+static ncclResult_t bootstrapRootCollect(struct bootstrapRootState* root, struct ncclSocket* listenSock) {
+  struct bootstrapRootConn* pending = NULL;
+  struct epoll_event events[64];
+  ncclResult_t ret = ncclSuccess;
+  NCCLCHECK(bootstrapEpollCtl(root->epollFd, EPOLL_CTL_ADD, listenSock->fd, EPOLLIN, NULL));
 
-    if (c == 0) {
-      nranks = info.nranks;
-      NCCLCHECKGOTO(ncclCalloc(&rankAddresses, nranks), res, out);
-      NCCLCHECKGOTO(ncclCalloc(&rankAddressesRoot, nranks), res, out);
+  do {
+    int nEvents = epoll_wait(root->epollFd, events, 64, -1);
+    if (nEvents < 0) {
+      if (errno == EINTR) continue;
+      WARN("Bootstrap Root : epoll_wait failed : %s", strerror(errno));
+      ret = ncclSystemError;
+      goto exit;
+    }
+    for (int e=0; e<nEvents; e++) {
+      struct bootstrapRootConn* conn = (struct bootstrapRootConn*)events[e].data.ptr;
+      if (conn == NULL) {
+        // Accept all pending connections
+        while (1) {
+          if (pending == NULL) {
+            NCCLCHECKGOTO(ncclCalloc(&pending, 1), ret, exit);
+            NCCLCHECKGOTO(ncclSocketInit(&pending->sock), ret, exit);
+          }
+          NCCLCHECKGOTO(ncclSocketAccept(&pending->sock, listenSock), ret, exit);
+          if (pending->sock.state == ncclSocketStateAccepting) break;
+          NCCLCHECKGOTO(bootstrapRootAddConn(root, pending, EPOLLIN), ret, exit);
+          pending = NULL;
+        }
+        continue;
+      }
+      if (conn->sock.state != ncclSocketStateReady) {
+        int ready;
+        NCCLCHECKGOTO(ncclSocketReady(&conn->sock, &ready), ret, exit);
+        if (conn->sock.state == ncclSocketStateAccepting) {
+          // Spurious connection with the wrong magic, which has already been closed
+          bootstrapRootRemoveConn(root, conn);
+          continue;
+        }
+        if (!ready) continue;
+      }
+      int done, closed;
+      do {
+        NCCLCHECKGOTO(bootstrapRootRecvInfo(conn, &done, &closed), ret, exit);
+        if (done) NCCLCHECKGOTO(bootstrapRootHandleInfo(root, conn), ret, exit);
+        // Ranks talking to us directly close after sending their info
+      } while (done && conn->nRanks > 0);
+      if (closed || (done && conn->nRanks == 0)) {
+        if (conn->nRanks > 0) {
+          WARN("Bootstrap Root : sub-root connection closed before receiving replies");
+          ret = ncclRemoteError;
+          goto exit;
+        }
+        bootstrapRootRemoveConn(root, conn);
+      }
     }
+  } while (root->nReceived == 0 || root->nReceived < root->nranks);
+  TRACE(NCCL_INIT, "COLLECTED ALL %d HANDLES", root->nranks);
 
-    if (nranks != info.nranks) {
-      WARN("Bootstrap Root : mismatch in rank count from procs %d : %d", nranks, info.nranks);
-      goto out;
+exit:
+  if (pending) free(pending);
+  return ret;
+}
+
+// Connect back to rank r and queue the address of its successor
+static ncclResult_t bootstrapRootConnectRank(struct bootstrapRootState* root, int r) {
+  struct bootstrapRootConn* conn;
+  NCCLCHECK(ncclCalloc(&conn, 1));
+  NCCLCHECK(ncclSocketInit(&conn->sock, root->rankAddressesRoot+r, root->magic, ncclSocketTypeBootstrap, NULL, 1));
+  NCCLCHECK(ncclSocketConnect(&conn->sock));
+  NCCLCHECK(bootstrapRootAddReply(conn, root->rankAddresses+(r+1)%root->nranks));
+  NCCLCHECK(bootstrapRootAddConn(root, conn, EPOLLOUT));
+  return ncclSuccess;
+}
+
+// Progress the connection, then send what we can of its replies. Sets *done once all are sent.
+static ncclResult_t bootstrapRootSendReplies(struct bootstrapRootConn* conn, int* done) {
+  *done = 0;
+  if (conn->sock.state != ncclSocketStateReady) {
+    int ready;
+    NCCLCHECK(ncclSocketReady(&conn->sock, &ready));
+    if (!ready) return ncclSuccess;
+  }
+  NCCLCHECK(ncclSocketProgress(NCCL_SOCKET_SEND, &conn->sock, conn->reply, conn->replySize, &conn->offset));
+  *done = conn->offset == conn->replySize;
+  return ncclSuccess;
+}
+
+static ncclResult_t bootstrapRootReply(struct bootstrapRootState* root) {
+  struct epoll_event events[64];
+  int nranks = root->nranks;
+  int maxConnects = std::max(1, (int)ncclParamBootstrapRootConnects());
+  int nConnects = 0, next = 0;
+
+  // Sub-roots get the replies for all their ranks at once, on the connection they used. Other
+  // connections still open have nothing to tell us anymore.
+  for (int i=root->nConns-1; i>=0; i--) {
+    struct bootstrapRootConn* conn = root->conns[i];
+    if (conn->nRanks == 0) {
+      bootstrapRootRemoveConn(root, conn);
+      continue;
+    }
+    conn->offset = 0;
+    for (int j=0; j<conn->nRanks; j++) {
+      NCCLCHECK(bootstrapRootAddReply(conn, root->rankAddresses+(conn->ranks[j]+1)%nranks));
     }
+    NCCLCHECK(bootstrapEpollCtl(root->epollFd, EPOLL_CTL_MOD, conn->sock.fd, EPOLLOUT, conn));
+  }
 
-    if (memcmp(zero, &rankAddressesRoot[info.rank], sizeof(union ncclSocketAddress)) != 0) {
-      WARN("Bootstrap Root : rank %d of %d ranks has already checked in", info.rank, nranks);
-      goto out;
+  while (1) {
+    // Keep up to maxConnects connections to other ranks in flight
+    for (; next<nranks && nConnects<maxConnects; next++) {
+      if (!bootstrapAddrValid(root->rankAddressesRoot+next)) continue;
+      NCCLCHECK(bootstrapRootConnectRank(root, next));
+      nConnects++;
     }
+    if (root->nConns == 0) break;
 
-    // Save the connection handle for that rank
-    memcpy(rankAddressesRoot+info.rank, &info.extAddressListenRoot, sizeof(union ncclSocketAddress));
-    memcpy(rankAddresses+info.rank, &info.extAddressListen, sizeof(union ncclSocketAddress));
+    // A connection refused is retried from scratch, which epoll does not tell us about
+    int timeout = -1;
+    for (int i=0; i<root->nConns; i++) {
+      if (root->conns[i]->sock.state == ncclSocketStateConnecting) timeout = 1;
+    }
+    int nEvents = epoll_wait(root->epollFd, events, 64, timeout);
+    if (nEvents < 0 && errno != EINTR) {
+      WARN("Bootstrap Root : epoll_wait failed : %s", strerror(errno));
+      return ncclSystemError;
+    }
+    for (int e=0; e<nEvents; e++) {
+      struct bootstrapRootConn* conn = (struct bootstrapRootConn*)events[e].data.ptr;
+      int done;
+      NCCLCHECK(bootstrapRootSendReplies(conn, &done));
+      if (!done) continue;
+      if (conn->nRanks == 0) nConnects--;
+      bootstrapRootRemoveConn(root, conn);
+    }
+    for (int i=0; i<root->nConns; i++) {
+      struct bootstrapRootConn* conn = root->conns[i];
+      if (conn->sock.state != ncclSocketStateConnecting) continue;
+      int ready;
+      NCCLCHECK(ncclSocketReady(&conn->sock, &ready));
+    }
+  }
+  TRACE(NCCL_INIT, "SENT OUT ALL %d HANDLES", nranks);
+  return ncclSuccess;
+}
 
-    ++c;
-    TRACE(NCCL_INIT, "Received connect from rank %d total %d/%d",  info.rank, c, nranks);
-  } while (c < nranks);
-  TRACE(NCCL_INIT, "COLLECTED ALL %d HANDLES", nranks);
+static void *bootstrapRoot(void* rargs) {
+  struct bootstrapRootArgs* args = (struct bootstrapRootArgs*)rargs;
+  struct ncclSocket* listenSock = args->listenSock;
+  struct bootstrapRootState root;
+  ncclResult_t res = ncclSuccess;
+  memset(&root, 0, sizeof(root));
+  root.magic = args->magic;
+  setFilesLimit();
 
-  // Send the connect handle for the next rank in the AllGather ring
-  for (int r=0; r<nranks; ++r) {
-    int next = (r+1) % nranks;
-    struct ncclSocket sock;
-    NCCLCHECKGOTO(ncclSocketInit(&sock, rankAddressesRoot+r, magic, ncclSocketTypeBootstrap), res, out);
-    NCCLCHECKGOTO(ncclSocketConnect(&sock), res, out);
-    NCCLCHECKGOTO(bootstrapNetSend(&sock, rankAddresses+next, sizeof(union ncclSocketAddress)), res, out);
-    NCCLCHECKGOTO(ncclSocketClose(&sock), res, out);
+  TRACE(NCCL_INIT, "BEGIN");
+  root.epollFd = epoll_create1(EPOLL_CLOEXEC);
+  if (root.epollFd == -1) {
+    WARN("Bootstrap Root : epoll_create1 failed : %s", strerror(errno));
+    goto out;
   }
-  TRACE(NCCL_INIT, "SENT OUT ALL %d HANDLES", nranks);
+  /* Receive addresses from all ranks */
+  NCCLCHECKGOTO(bootstrapRootCollect(&root, listenSock), res, out);
+  // Ranks have all checked in, no need to accept anything more
+  epoll_ctl(root.epollFd, EPOLL_CTL_DEL, listenSock->fd, NULL);
+  ncclSocketClose(listenSock);
+  /* Send the connect handle for the next rank in the AllGather ring */
+  NCCLCHECKGOTO(bootstrapRootReply(&root), res, out);
 
 out:
   if (listenSock != NULL) {
     ncclSocketClose(listenSock);
     free(listenSock);
   }
-  if (rankAddresses) free(rankAddresses);
-  if (rankAddressesRoot) free(rankAddressesRoot);
-  if (zero) free(zero);
+  for (int i=0; i<root.nConns; i++) bootstrapRootConnFree(root.conns[i]);
+  free(root.conns);
+  if (root.epollFd >= 0) close(root.epollFd);
+  free(root.received);
+  free(root.rankAddresses);
+  free(root.rankAddressesRoot);
   free(rargs);
 
   TRACE(NCCL_INIT, "DONE");
   return NULL;
 }
 
+// Wrap a connected unix socket so that the ncclSocket calls can use it
+static ncclResult_t bootstrapUnixSocket(int fd, struct ncclSocket* sock, uint64_t magic, volatile uint32_t* abortFlag) {
+  NCCLCHECK(ncclSocketInit(sock, NULL, magic, ncclSocketTypeBootstrap, abortFlag));
+  NCCLCHECK(ncclSocketSetFd(fd, sock));
+  sock->state = ncclSocketStateReady;
+  return ncclSuccess;
+}
+
+// Abstract unix sockets can be reached by any local user; only talk to processes of our own user
+static ncclResult_t bootstrapUnixPeerCheck(int fd, int* valid) {
+  struct ucred cred;
+  socklen_t credLen = sizeof(cred);
+  SYSCHECK(getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &credLen), "getsockopt");
+  *valid = cred.uid == getuid();
+  if (*valid == 0) WARN("Bootstrap : sub-root socket peer is pid %d of uid %d, expected uid %d", cred.pid, cred.uid, getuid());
+  return ncclSuccess;
+}
+
+// Receive what is available of the magic a local rank sends first. Sets *done once it is complete
+// and matches ours, and *closed if the connection is to be dropped instead.
+static ncclResult_t bootstrapSubRootRecvMagic(struct bootstrapRootConn* conn, int* done, int* closed) {
+  struct iovec iov = { &conn->magic, sizeof(conn->magic) };
+  *done = *closed = 0;
+  NCCLCHECK(ncclSocketProgressIov(NCCL_SOCKET_RECV, &conn->sock, &iov, 1, &conn->magicOffset, closed));
+  if (*closed || conn->magicOffset < (int)sizeof(conn->magic)) return ncclSuccess;
+  if (conn->magic != conn->sock.magic) {
+    WARN("Bootstrap : sub-root dropping connection with wrong magic %lx != %lx", conn->magic, conn->sock.magic);
+    *closed = 1;
+    return ncclSuccess;
+  }
+  // Let the rank check we are the sub-root of its init as well
+  NCCLCHECK(ncclSocketSend(&conn->sock, &conn->sock.magic, sizeof(conn->sock.magic)));
+  *done = 1;
+  return ncclSuccess;
+}
+
+// Close the connection of a local rank, which is referenced by conns and possibly by locals
+static void bootstrapSubRootClose(struct bootstrapRootConn* conn, struct bootstrapRootConn** conns, int nConns, struct bootstrapRootConn** locals, int nLocals) {
+  for (int i=0; i<nConns; i++) if (conns[i] == conn) conns[i] = NULL;
+  for (int i=0; i<nLocals; i++) if (locals[i] == conn) locals[i] = NULL;
+  bootstrapRootConnFree(conn);
+}
+
+static ncclResult_t bootstrapSubRootLoop(struct bootstrapSubRootArgs* args, struct ncclSocket* rootSock, int epollFd) {
+  struct bootstrapRootConn** conns = NULL;  // connections of local ranks, in the order they were accepted
+  struct bootstrapRootConn** locals = NULL; // local ranks, in the order their info was relayed
+  int nConns = 0, nOpen = 0, nLocals = 0, nReplied = 0;
+  struct epoll_event events[64];
+  ncclResult_t ret = ncclSuccess;
+
+  NCCLCHECK(ncclSocketInit(rootSock, &args->rootAddr, args->magic, ncclSocketTypeBootstrap));
+  NCCLCHECK(ncclSocketConnect(rootSock));
+  NCCLCHECK(bootstrapEpollCtl(epollFd, EPOLL_CTL_ADD, args->listenFd, EPOLLIN, NULL));
+  NCCLCHECK(bootstrapEpollCtl(epollFd, EPOLL_CTL_ADD, rootSock->fd, EPOLLIN, rootSock));
+
+  // The root replies once all ranks have checked in, hence once no local rank is left to accept.
+  // A lost root connection wakes us up like a reply would, and local ranks which abort close
+  // their connection, so that we leave once nobody is waiting on us any more.
+  while (nLocals == 0 || nReplied < nLocals) {
+    // The rank which started us connects right away, or gave up
+    int timeout = nOpen == 0 ? RETRY_REFUSED_TIMES*SLEEP_INT/1000 : -1;
+    int nEvents = epoll_wait(epollFd, events, 64, timeout);
+    if (nEvents < 0) {
+      if (errno == EINTR) continue;
+      WARN("Bootstrap : sub-root epoll_wait failed : %s", strerror(errno));
+      ret = ncclSystemError;
+      goto exit;
+    }
+    if (nEvents == 0) {
+      WARN("Bootstrap : no local rank connected to the sub-root");
+      ret = ncclRemoteError;
+      goto exit;
+    }
+    for (int e=0; e<nEvents; e++) {
+      void* ptr = events[e].data.ptr;
+      if (ptr == NULL) {
+        int fd;
+        while ((fd = accept4(args->listenFd, NULL, NULL, SOCK_NONBLOCK|SOCK_CLOEXEC)) >= 0) {
+          struct bootstrapRootConn* conn;
+          int valid;
+          if (bootstrapUnixPeerCheck(fd, &valid) != ncclSuccess || valid == 0) {
+            close(fd);
+            continue;
+          }
+          NCCLCHECKGOTO(ncclCalloc(&conn, 1), ret, exit);
+          NCCLCHECKGOTO(bootstrapUnixSocket(fd, &conn->sock, args->magic, NULL), ret, exit);
+          NCCLCHECKGOTO(ncclRealloc(&conns, nConns, nConns+1), ret, exit);
+          conns[nConns++] = conn;
+          NCCLCHECKGOTO(bootstrapEpollCtl(epollFd, EPOLL_CTL_ADD, fd, EPOLLIN, conn), ret, exit);
+        }
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+          WARN("Bootstrap : sub-root accept failed : %s", strerror(errno));
+          ret = ncclSystemError;
+          goto exit;
+        }
+      } else if (ptr == rootSock) {
+        if (nReplied == nLocals) {
+          WARN("Bootstrap : sub-root received unexpected data or lost its connection to the root");
+          ret = ncclRemoteError;
+          goto exit;
+        }
+        // All ranks have checked in; later connections are for another init
+        if (args->listenFd != -1) {
+          epoll_ctl(epollFd, EPOLL_CTL_DEL, args->listenFd, NULL);
+          close(args->listenFd);
+          args->listenFd = -1;
+        }
+        // All replies were sent at once; forward each one to its rank, unless it left already
+        for (; nReplied<nLocals; nReplied++) {
+          union ncclSocketAddress next;
+          struct bootstrapRootConn* conn = locals[nReplied];
+          NCCLCHECKGOTO(bootstrapNetRecv(rootSock, &next, sizeof(next)), ret, exit);
+          if (conn == NULL) continue;
+          NCCLCHECKGOTO(bootstrapNetSend(&conn->sock, &next, sizeof(next)), ret, exit);
+          bootstrapSubRootClose(conn, conns, nConns, locals, nLocals);
+          nOpen--;
+        }
+      } else {
+        struct bootstrapRootConn* conn = (struct bootstrapRootConn*)ptr;
+        int relayed = 0, done = 0, closed = 1;
+        if (conn->magicOffset < (int)sizeof(conn->magic)) {
+          // Connections only count as local ranks once they sent the magic of the handle
+          NCCLCHECKGOTO(bootstrapSubRootRecvMagic(conn, &done, &closed), ret, exit);
+          if (closed) bootstrapSubRootClose(conn, conns, nConns, locals, nLocals);
+          else if (done) nOpen++;
+          continue;
+        }
+        for (int i=nReplied; i<nLocals; i++) relayed |= (locals[i] == conn);
+        // Relayed ranks only wait for their reply; hearing from them again means they left
+        if (!relayed) NCCLCHECKGOTO(bootstrapRootRecvInfo(conn, &done, &closed), ret, exit);
+        if (closed) {
+          bootstrapSubRootClose(conn, conns, nConns, locals, nLocals);
+          if (--nOpen == 0) {
+            INFO(NCCL_INIT, "Bootstrap : all local ranks left, stopping sub-root");
+            ret = ncclRemoteError;
+            goto exit;
+          }
+        } else if (done) {
+          NCCLCHECKGOTO(ncclRealloc(&locals, nLocals, nLocals+1), ret, exit);
+          locals[nLocals++] = conn;
+          NCCLCHECKGOTO(bootstrapNetSend(rootSock, &conn->info, sizeof(struct extInfo)), ret, exit);
+        }
+      }
+    }
+  }
+  TRACE(NCCL_INIT, "Sub-root relayed %d ranks", nLocals);
+
+exit:
+  for (int i=0; i<nConns; i++) if (conns[i]) bootstrapRootConnFree(conns[i]);
+  free(conns);
+  free(locals);
+  return ret;
+}
+
+static void* bootstrapSubRoot(void* rargs) {
+  struct bootstrapSubRootArgs* args = (struct bootstrapSubRootArgs*)rargs;
+  struct ncclSocket rootSock;
+  int epollFd = epoll_create1(EPOLL_CLOEXEC);
+  ncclSocketInit(&rootSock);
+  if (epollFd == -1) {
+    WARN("Bootstrap : sub-root epoll_create1 failed : %s", strerror(errno));
+  } else {
+    bootstrapSubRootLoop(args, &rootSock, epollFd);
+    close(epollFd);
+  }
+  if (args->listenFd != -1) close(args->listenFd);
+  ncclSocketClose(&rootSock);
+  free(args);
+  return NULL;
+}
+
+// Number of inits each rank of this process went through with a given handle. Ranks of a node
+// see the same sequence of inits with a handle, so the count tells inits reusing it apart
+// without having to talk to each other.
+struct bootstrapSubRootUse {
+  uint64_t hash;
+  int rank;
+  int count;
+};
+static struct bootstrapSubRootUse* bootstrapSubRootUses = NULL;
+static int bootstrapNSubRootUses = 0;
+static pthread_mutex_t bootstrapSubRootLock = PTHREAD_MUTEX_INITIALIZER;
+
+static ncclResult_t bootstrapSubRootNonce(uint64_t hash, int rank, int* nonce) {
+  ncclResult_t ret = ncclSuccess;
+  pthread_mutex_lock(&bootstrapSubRootLock);
+  int i = 0;
+  while (i < bootstrapNSubRootUses && (bootstrapSubRootUses[i].hash != hash || bootstrapSubRootUses[i].rank != rank)) i++;
+  if (i == bootstrapNSubRootUses) {
+    NCCLCHECKGOTO(ncclRealloc(&bootstrapSubRootUses, bootstrapNSubRootUses, bootstrapNSubRootUses+1), ret, exit);
+    bootstrapSubRootUses[i].hash = hash;
+    bootstrapSubRootUses[i].rank = rank;
+    bootstrapNSubRootUses++;
+  }
+  *nonce = bootstrapSubRootUses[i].count++;
+exit:
+  pthread_mutex_unlock(&bootstrapSubRootLock);
+  return ret;
+}
+
+// Connect to the sub-root of this node, starting it if we are the first rank to get there
+static ncclResult_t bootstrapSubRootConnect(struct ncclBootstrapHandle* handle, int rank, struct ncclSocket* sock, volatile uint32_t* abortFlag) {
+  ncclResult_t ret = ncclSuccess;
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  // Abstract socket, named after the handle so that different communicators do not collide, and
+  // after the init so that one reusing the handle does not reach a sub-root still serving another
+  uint64_t hash = getHash((const char*)handle, sizeof(*handle));
+  int nonce;
+  NCCLCHECK(bootstrapSubRootNonce(hash, rank, &nonce));
+  int len = snprintf(addr.sun_path+1, sizeof(addr.sun_path)-1, "nccl-bootstrap-%lx-%x", hash, nonce);
+  socklen_t addrLen = offsetof(struct sockaddr_un, sun_path)+1+len;
+
+  int fd;
+  SYSCHECKVAL(socket(AF_UNIX, SOCK_STREAM|SOCK_NONBLOCK|SOCK_CLOEXEC, 0), "socket", fd);
+  if (bind(fd, (struct sockaddr*)&addr, addrLen) == 0) {
+    struct bootstrapSubRootArgs* args;
+    pthread_t thread;
+    SYSCHECK(listen(fd, 16384), "listen");
+    NCCLCHECK(ncclCalloc(&args, 1));
+    args->listenFd = fd;
+    memcpy(&args->rootAddr, &handle->addr, sizeof(union ncclSocketAddress));
+    args->magic = handle->magic;
+    NEQCHECK(pthread_create(&thread, NULL, bootstrapSubRoot, (void*)args), 0);
+    ncclSetThreadName(thread, "NCCL BootstrapS");
+    NEQCHECK(pthread_detach(thread), 0); // will not be pthread_join()'d
+    INFO(NCCL_INIT, "Bootstrap : started sub-root for this node");
+  } else if (errno == EADDRINUSE) {
+    // Another local rank started the sub-root, or somebody else holds the name; we find out below
+    close(fd);
+  } else {
+    WARN("Bootstrap : binding sub-root socket failed : %s", strerror(errno));
+    close(fd);
+    return ncclSystemError;
+  }
+
+  // The sub-root may have bound its socket but not be listening yet
+  SYSCHECKVAL(socket(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0), "socket", fd);
+  for (int retries=0; connect(fd, (struct sockaddr*)&addr, addrLen) != 0; retries++) {
+    if ((errno != ECONNREFUSED && errno != EINTR) || retries == RETRY_REFUSED_TIMES) {
+      WARN("Bootstrap : connection to sub-root failed : %s", strerror(errno));
+      close(fd);
+      return ncclSystemError;
+    }
+    usleep(SLEEP_INT);
+  }
+  int valid;
+  uint64_t magic;
+  NCCLCHECKGOTO(bootstrapUnixPeerCheck(fd, &valid), ret, fail);
+  if (valid == 0) {
+    WARN("Bootstrap : sub-root socket name is held by another user");
+    ret = ncclSystemError;
+    goto fail;
+  }
+  NCCLCHECKGOTO(bootstrapUnixSocket(fd, sock, handle->magic, abortFlag), ret, fail);
+  NCCLCHECKGOTO(ncclSocketSend(sock, &sock->magic, sizeof(sock->magic)), ret, fail);
+  NCCLCHECKGOTO(ncclSocketRecv(sock, &magic, sizeof(magic)), ret, fail);
+  if (magic != sock->magic) {
+    WARN("Bootstrap : sub-root socket answered with wrong magic %lx != %lx", magic, sock->magic);
+    ret = ncclSystemError;
+    goto fail;
+  }
+  return ncclSuccess;
+fail:
+  close(fd);
+  return ret;
+}
+
 ncclResult_t bootstrapCreateRoot(struct ncclBootstrapHandle* handle, bool idFromEnv) {
   struct ncclSocket* listenSock;
   struct bootstrapRootArgs* args;
   pthread_t thread;
 
   NCCLCHECK(ncclCalloc(&listenSock, 1));
-  NCCLCHECK(ncclSocketInit(listenSock, &handle->addr, handle->magic, ncclSocketTypeBootstrap, NULL, 0));
+  NCCLCHECK(ncclSocketInit(listenSock, &handle->addr, handle->magic, ncclSocketTypeBootstrap, NULL, 1));
   NCCLCHECK(ncclSocketListen(listenSock));
   NCCLCHECK(ncclSocketGetAddr(listenSock, &handle->addr));
 
@@ -219,11 +776,92 @@ ncclResult_t bootstrapGetUniqueId(struct ncclBootstrapHandle* handle) {
   return ncclSuccess;
 }
 
-struct unexConn {
+ncclResult_t bootstrapRingAllGather(struct ncclSocket* prevSocket, struct ncclSocket* nextSocket, int rank, int nranks, char* data, int size);
+
+// Message received from a peer before we asked for it
+struct unexMsg {
   int peer;
+  uint32_t id;
   int tag;
-  struct ncclSocket sock;
-  struct unexConn* next;
+  int size;
+  char* data;
+  struct unexMsg* next;
+};
+
+// Unexpected messages, hashed on (peer, id, tag). Each bucket is a list in arrival order, which
+// keeps messages with the same key in FIFO order.
+struct unexTable {
+  struct unexMsg** heads;
+  struct unexMsg** tails;
+  int nBuckets;
+  int count;
+  size_t bytes;
+  int peakCount;
+  size_t peakBytes;
+};
+
+// Shared memory segment of the ranks of a node, on which intra-node collectives run when they
+// involve all of them. Two sets of per-rank slots follow the control block. Collectives move data
+// in steps alternating between them, so that a single barrier per step is enough: a rank cannot
+// write slots again before everyone went through the next barrier, after reading them.
+#define BOOTSTRAP_SHM_CTRL_SIZE 64
+
+// Ranks sleep on gen, which the last one to reach a barrier bumps
+struct bootstrapShmCtrl {
+  uint32_t count;
+  uint32_t gen;
+};
+
+struct bootstrapShm {
+  ncclShmHandle_t handle;
+  struct bootstrapShmCtrl* ctrl;
+  char* slots;
+  size_t slotSize;
+  int* ranks; // ranks of our node, in ascending order
+  int nranks;
+  int step;
+};
+
+// Each message carries the id its receiver gave the comm it is for, its tag and its size
+struct bootstrapMsgHdr {
+  uint32_t id;
+  int tag;
+  int size;
+};
+
+// Send queued on the connection to a peer
+struct bootstrapSendOp {
+  struct bootstrapMsgHdr hdr;
+  struct iovec iov[2];
+  int offset;  // header included
+  int done;
+  int orphan;  // left by a send which gave up halfway, to finish and free
+  struct bootstrapSendOp* next;
+};
+
+// Receive posted for a message from a peer
+struct bootstrapRecvOp {
+  uint32_t id;
+  int tag;
+  char* data;
+  int size;
+  int done;
+  struct bootstrapRecvOp* next;
+};
+
+// Persistent connections with a peer: we send on the one we opened, and receive on the one it opened
+struct bootstrapPeer {
+  struct ncclSocket sendSock;
+  struct ncclSocket recvSock;
+  struct bootstrapSendOp* sendHead; // in progress
+  struct bootstrapSendOp* sendTail;
+  struct bootstrapRecvOp* recvOps;
+  uint64_t lastSend; // sendClock of the owner when we last sent to the peer
+  // Message arriving on recvSock, into the receive posted for it or an unexpected buffer
+  struct bootstrapMsgHdr hdr;
+  int offset;  // header included
+  char* data;
+  struct bootstrapRecvOp* recvOp;
 };
 
 struct bootstrapState {
@@ -233,14 +871,218 @@ struct bootstrapState {
   union ncclSocketAddress* peerCommAddresses;
   union ncclSocketAddress* peerProxyAddresses;
   uint64_t* peerProxyAddressesUDS;
-  struct unexConn* unexpectedConnections;
+  struct bootstrapPeer* peers;
+  struct unexTable unexpected;
+  struct bootstrapShm shm;
   int cudaDev;
   int rank;
   int nranks;
   uint64_t magic;
   volatile uint32_t *abortFlag;
+  // Comms split with NCCL_BOOTSTRAP_SPLIT_SHARED have no sockets of their own: they go through
+  // the connections of the comm they were split from. The state owning the connections holds
+  // listenSock, peers and the unexpected messages, under its lock, and lives as long as a comm
+  // uses them. owner points to the state itself when it has its own connections.
+  struct bootstrapState* owner;
+  int* ownerRanks;    // ranks of our peers in the owner, NULL for the owner
+  uint32_t* peerIds;  // ids our peers gave the comm, NULL for the owner (id 0)
+  uint32_t id;        // id we gave the comm
+  pthread_mutex_t lock;
+  struct ncclSocket acceptSock; // connection being accepted from listenSock
+  uint32_t nextId;
+  int refCount;
+  // Peer connections open, and how many of each kind we keep: past maxSendSocks the least recently
+  // used idle send socket is closed, and receive sockets are checked for peers having closed theirs
+  // whenever their number reaches recvSweep.
+  int nSendSocks;
+  int nRecvSocks;
+  int maxSendSocks;
+  int recvSweep;
+  uint64_t sendClock;
+};
+
+// Send sockets we keep open, 0 for an eighth of the files we may open. Every one of them is also
+// a receive socket for a peer, and NET transports need many more files.
+NCCL_PARAM(BootstrapMaxPeerConns, "BOOTSTRAP_MAX_PEER_CONNS", 0);
+
+static void bootstrapOwnerInit(struct bootstrapState* state) {
+  struct rlimit filesLimit;
+  int64_t maxSocks = ncclParamBootstrapMaxPeerConns();
+  if (maxSocks <= 0) {
+    maxSocks = 1024;
+    if (getrlimit(RLIMIT_NOFILE, &filesLimit) == 0 && filesLimit.rlim_cur != RLIM_INFINITY) maxSocks = filesLimit.rlim_cur/8;
+  }
+  state->owner = state;
+  state->nextId = 1;
+  state->refCount = 1;
+  state->maxSendSocks = std::max<int64_t>(1, std::min<int64_t>(maxSocks, INT_MAX));
+  state->recvSweep = state->maxSendSocks;
+  pthread_mutex_init(&state->lock, NULL);
+}
+
+static inline int bootstrapOwnerRank(struct bootstrapState* state, int peer) {
+  return state->ownerRanks ? state->ownerRanks[peer] : peer;
+}
+
+static inline uint32_t bootstrapPeerId(struct bootstrapState* state, int peer) {
+  return state->peerIds ? state->peerIds[peer] : 0;
+}
+
+// listenSock is non-blocking, for any thread to accept peer connections while others use the
+// connections already established. Accept a connection we wait for.
+static ncclResult_t bootstrapAccept(struct ncclSocket* sock, struct ncclSocket* listenSock) {
+  uint64_t idleStart = 0;
+  int ready, op = NCCL_SOCKET_RECV;
+  NCCLCHECK(ncclSocketInit(sock));
+  NCCLCHECK(ncclSocketAccept(sock, listenSock));
+  while (1) {
+    NCCLCHECK(ncclSocketReady(sock, &ready));
+    if (ready) return ncclSuccess;
+    if (sock->abortFlag && __atomic_load_n(sock->abortFlag, __ATOMIC_ACQUIRE)) return ncclInternalError;
+    NCCLCHECK(ncclSocketWaitIdle(1, &sock, &op, &idleStart));
+  }
+}
+
+NCCL_PARAM(BootstrapShm, "BOOTSTRAP_SHM", 1);
+NCCL_PARAM(BootstrapShmSlotSize, "BOOTSTRAP_SHM_SLOT_SIZE", 128*1024);
+
+#define BOOTSTRAP_SHM_SPIN_NS 5000
+#define BOOTSTRAP_SHM_WAIT_NS 10000000 // bounds futex waits, to check abortFlag
+
+// Address of a rank's listen socket, gathered with the node it runs on
+struct bootstrapAddrInfo {
+  union ncclSocketAddress addr;
+  uint64_t nodeHash;
 };
 
+// Ranks can share memory when they run on the same host and see the same /dev/shm
+static ncclResult_t bootstrapNodeHash(uint64_t* hash) {
+  struct stat statbuf;
+  SYSCHECK(stat("/dev/shm", &statbuf), "stat");
+  uint64_t node[2] = { getHostHash(), (uint64_t)statbuf.st_dev };
+  *hash = getHash((const char*)node, sizeof(node));
+  return ncclSuccess;
+}
+
+// Set up the segment of our node once peers can be reached. The lowest rank creates it and sends
+// its path to the others, or an empty path when it could not, in which case we keep using sockets.
+static ncclResult_t bootstrapShmInit(struct bootstrapState* state, uint64_t* nodeHashes) {
+  struct bootstrapShm* shm = &state->shm;
+  char shmPath[sizeof("/dev/shm/nccl-XXXXXX")] = "";
+  void* ptr = NULL;
+  int nLocal = 0;
+  size_t size;
+
+  if (ncclParamBootstrapShm() == 0) return ncclSuccess;
+  for (int r=0; r<state->nranks; r++) {
+    if (nodeHashes[r] == nodeHashes[state->rank]) nLocal++;
+  }
+  if (nLocal == 1) return ncclSuccess;
+  NCCLCHECK(ncclCalloc(&shm->ranks, nLocal));
+  for (int r=0; r<state->nranks; r++) {
+    if (nodeHashes[r] == nodeHashes[state->rank]) shm->ranks[shm->nranks++] = r;
+  }
+  shm->slotSize = std::max(ncclParamBootstrapShmSlotSize(), (int64_t)BOOTSTRAP_SHM_CTRL_SIZE);
+  shm->slotSize = ROUNDUP(shm->slotSize, BOOTSTRAP_SHM_CTRL_SIZE);
+  size = BOOTSTRAP_SHM_CTRL_SIZE + 2*nLocal*shm->slotSize;
+
+  if (shm->ranks[0] == state->rank) {
+    if (ncclShmOpen(shmPath, size, &ptr, NULL, nLocal-1, &shm->handle) != ncclSuccess) {
+      INFO(NCCL_BOOTSTRAP, "Bootstrap : could not create a shared memory segment, intra-node collectives will use sockets");
+      shmPath[0] = '\0';
+    }
+    for (int i=1; i<nLocal; i++) NCCLCHECK(bootstrapSend(state, shm->ranks[i], BOOTSTRAP_TAG_SHM, shmPath, sizeof(shmPath)));
+  } else {
+    NCCLCHECK(bootstrapRecv(state, shm->ranks[0], BOOTSTRAP_TAG_SHM, shmPath, sizeof(shmPath)));
+    if (shmPath[0] != '\0') NCCLCHECK(ncclShmOpen(shmPath, size, &ptr, NULL, -1, &shm->handle));
+  }
+  if (shmPath[0] == '\0') {
+    free(shm->ranks);
+    memset(shm, 0, sizeof(*shm));
+    return ncclSuccess;
+  }
+  shm->ctrl = (struct bootstrapShmCtrl*)ptr;
+  shm->slots = (char*)ptr + BOOTSTRAP_SHM_CTRL_SIZE;
+  INFO(NCCL_BOOTSTRAP, "Bootstrap : rank %d shares %s with %d ranks of its node", state->rank, shmPath, nLocal-1);
+  return ncclSuccess;
+}
+
+static ncclResult_t bootstrapShmFree(struct bootstrapState* state) {
+  struct bootstrapShm* shm = &state->shm;
+  ncclResult_t ret = ncclShmClose(shm->handle);
+  free(shm->ranks);
+  memset(shm, 0, sizeof(*shm));
+  return ret;
+}
+
+// Whether a collective among ranks (all ranks when NULL) can run on the segment, which requires
+// all ranks of our node to take part. Ranks of a node agree on it, as they share the same set.
+static bool bootstrapShmCovers(struct bootstrapState* state, int* ranks, int nranks) {
+  struct bootstrapShm* shm = &state->shm;
+  if (shm->ctrl == NULL || nranks != shm->nranks) return false;
+  for (int i=0; i<nranks; i++) {
+    int r = ranks ? ranks[i] : i;
+    if (!std::binary_search(shm->ranks, shm->ranks+shm->nranks, r)) return false;
+  }
+  return true;
+}
+
+static ncclResult_t bootstrapShmBarrier(struct bootstrapState* state) {
+  struct bootstrapShmCtrl* ctrl = state->shm.ctrl;
+  // Read before arriving: gen cannot move on until we do
+  uint32_t gen = __atomic_load_n(&ctrl->gen, __ATOMIC_ACQUIRE);
+  if (__atomic_add_fetch(&ctrl->count, 1, __ATOMIC_ACQ_REL) == (uint32_t)state->shm.nranks) {
+    __atomic_store_n(&ctrl->count, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&ctrl->gen, gen+1, __ATOMIC_RELEASE);
+    syscall(SYS_futex, &ctrl->gen, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+    return ncclSuccess;
+  }
+  uint64_t t0 = clockNano();
+  while (__atomic_load_n(&ctrl->gen, __ATOMIC_ACQUIRE) == gen) {
+    if (__atomic_load_n(state->abortFlag, __ATOMIC_ACQUIRE)) return ncclInternalError;
+    if (clockNano() - t0 < BOOTSTRAP_SHM_SPIN_NS) continue;
+    // Returns right away if gen already moved on
+    struct timespec timeout = { 0, BOOTSTRAP_SHM_WAIT_NS };
+    if (syscall(SYS_futex, &ctrl->gen, FUTEX_WAIT, gen, &timeout, NULL, 0) != 0 &&
+        errno != EAGAIN && errno != ETIMEDOUT && errno != EINTR) {
+      WARN("Bootstrap : futex wait failed : %s", strerror(errno));
+      return ncclSystemError;
+    }
+  }
+  return ncclSuccess;
+}
+
+// Slots to use for the next step
+static char* bootstrapShmStep(struct bootstrapShm* shm) {
+  return shm->slots + (size_t)(shm->step++ & 1)*shm->nranks*shm->slotSize;
+}
+
+static ncclResult_t bootstrapShmAllGather(struct bootstrapState* state, int rank, int nranks, char* data, size_t size) {
+  struct bootstrapShm* shm = &state->shm;
+  for (size_t offset=0; offset<size; offset+=shm->slotSize) {
+    size_t n = std::min(shm->slotSize, size-offset);
+    char* slots = bootstrapShmStep(shm);
+    memcpy(slots+rank*shm->slotSize, data+rank*size+offset, n);
+    NCCLCHECK(bootstrapShmBarrier(state));
+    for (int r=0; r<nranks; r++) {
+      if (r != rank) memcpy(data+r*size+offset, slots+r*shm->slotSize, n);
+    }
+  }
+  return ncclSuccess;
+}
+
+static ncclResult_t bootstrapShmBroadcast(struct bootstrapState* state, int rank, int root, char* data, size_t size) {
+  struct bootstrapShm* shm = &state->shm;
+  for (size_t offset=0; offset<size; offset+=shm->slotSize) {
+    size_t n = std::min(shm->slotSize, size-offset);
+    char* slot = bootstrapShmStep(shm) + root*shm->slotSize;
+    if (rank == root) memcpy(slot, data+offset, n);
+    NCCLCHECK(bootstrapShmBarrier(state));
+    if (rank != root) memcpy(data+offset, slot, n);
+  }
+  return ncclSuccess;
+}
+
 ncclResult_t bootstrapInit(struct ncclBootstrapHandle* handle, struct ncclComm* comm) {
   int rank = comm->rank;
   int nranks = comm->nRanks;
@@ -249,11 +1091,17 @@ ncclResult_t bootstrapInit(struct ncclBootstrapHandle* handle, struct ncclComm*
   ncclSocketAddress nextAddr;
   struct ncclSocket sock, listenSockRoot;
   struct extInfo info = { 0 };
+  struct bootstrapAddrInfo* addrInfo;
+  uint64_t* nodeHashes;
+
+  // We keep connections open with the peers we talk to
+  setFilesLimit();
 
   NCCLCHECK(ncclCalloc(&state, 1));
   state->rank = rank;
   state->nranks = nranks;
   state->abortFlag = comm->abortFlag;
+  bootstrapOwnerInit(state);
   comm->bootstrap = state;
   comm->magic = state->magic = handle->magic;
 
@@ -262,48 +1110,68 @@ ncclResult_t bootstrapInit(struct ncclBootstrapHandle* handle, struct ncclComm*
   info.rank = rank;
   info.nranks = nranks;
   // Create socket for other ranks to contact me
-  NCCLCHECK(ncclSocketInit(&state->listenSock, &bootstrapNetIfAddr, comm->magic, ncclSocketTypeBootstrap, comm->abortFlag));
+  NCCLCHECK(ncclSocketInit(&state->listenSock, &bootstrapNetIfAddr, comm->magic, ncclSocketTypeBootstrap, comm->abortFlag, 1));
   NCCLCHECK(ncclSocketListen(&state->listenSock));
   NCCLCHECK(ncclSocketGetAddr(&state->listenSock, &info.extAddressListen));
 
-  // Create socket for root to contact me
-  NCCLCHECK(ncclSocketInit(&listenSockRoot, &bootstrapNetIfAddr, comm->magic, ncclSocketTypeBootstrap, comm->abortFlag));
-  NCCLCHECK(ncclSocketListen(&listenSockRoot));
-  NCCLCHECK(ncclSocketGetAddr(&listenSockRoot, &info.extAddressListenRoot));
-
-  // stagger connection times to avoid an overload of the root
-  if (nranks > 128) {
-    long msec = rank;
-    struct timespec tv;
-    tv.tv_sec = msec / 1000;
-    tv.tv_nsec = 1000000 * (msec % 1000);
-    TRACE(NCCL_INIT, "rank %d delaying connection to root by %ld msec", rank, msec);
-    (void) nanosleep(&tv, NULL);
-  }
-
-  // send info on my listening socket to root
-  NCCLCHECK(ncclSocketInit(&sock, &handle->addr, comm->magic, ncclSocketTypeBootstrap, comm->abortFlag));
-  NCCLCHECK(ncclSocketConnect(&sock));
-  NCCLCHECK(bootstrapNetSend(&sock, &info, sizeof(info)));
-  NCCLCHECK(ncclSocketClose(&sock));
-
-  // get info on my "next" rank in the bootstrap ring from root
-  NCCLCHECK(ncclSocketInit(&sock));
-  NCCLCHECK(ncclSocketAccept(&sock, &listenSockRoot));
-  NCCLCHECK(bootstrapNetRecv(&sock, &nextAddr, sizeof(union ncclSocketAddress)));
-  NCCLCHECK(ncclSocketClose(&sock));
-  NCCLCHECK(ncclSocketClose(&listenSockRoot));
+  if (ncclParamBootstrapHierarchical()) {
+    // Go through the sub-root of our node, which sends us the reply of the root on the same connection
+    NCCLCHECK(bootstrapSubRootConnect(handle, rank, &sock, comm->abortFlag));
+    NCCLCHECK(bootstrapNetSend(&sock, &info, sizeof(info)));
+    NCCLCHECK(bootstrapNetRecv(&sock, &nextAddr, sizeof(union ncclSocketAddress)));
+    NCCLCHECK(ncclSocketClose(&sock));
+  } else {
+    // Create socket for root to contact me
+    NCCLCHECK(ncclSocketInit(&listenSockRoot, &bootstrapNetIfAddr, comm->magic, ncclSocketTypeBootstrap, comm->abortFlag));
+    NCCLCHECK(ncclSocketListen(&listenSockRoot));
+    NCCLCHECK(ncclSocketGetAddr(&listenSockRoot, &info.extAddressListenRoot));
+
+    // stagger connection times to avoid an overload of the root's accept queue; the root serves
+    // connections concurrently, so let them through BOOTSTRAP_ROOT_STAGGER at a time
+    if (nranks > 128) {
+      long msec = rank / BOOTSTRAP_ROOT_STAGGER;
+      struct timespec tv;
+      tv.tv_sec = msec / 1000;
+      tv.tv_nsec = 1000000 * (msec % 1000);
+      TRACE(NCCL_INIT, "rank %d delaying connection to root by %ld msec", rank, msec);
+      (void) nanosleep(&tv, NULL);
+    }
+
+    // send info on my listening socket to root
+    NCCLCHECK(ncclSocketInit(&sock, &handle->addr, comm->magic, ncclSocketTypeBootstrap, comm->abortFlag));
+    NCCLCHECK(ncclSocketConnect(&sock));
+    NCCLCHECK(bootstrapNetSend(&sock, &info, sizeof(info)));
+    NCCLCHECK(ncclSocketClose(&sock));
+
+    // get info on my "next" rank in the bootstrap ring from root
+    NCCLCHECK(ncclSocketInit(&sock));
+    NCCLCHECK(ncclSocketAccept(&sock, &listenSockRoot));
+    NCCLCHECK(bootstrapNetRecv(&sock, &nextAddr, sizeof(union ncclSocketAddress)));
+    NCCLCHECK(ncclSocketClose(&sock));
+    NCCLCHECK(ncclSocketClose(&listenSockRoot));
+  }
 
   NCCLCHECK(ncclSocketInit(&state->ringSendSocket, &nextAddr, comm->magic, ncclSocketTypeBootstrap, comm->abortFlag));
   NCCLCHECK(ncclSocketConnect(&state->ringSendSocket));
   // Accept the connect request from the previous rank in the AllGather ring
-  NCCLCHECK(ncclSocketInit(&state->ringRecvSocket));
-  NCCLCHECK(ncclSocketAccept(&state->ringRecvSocket, &state->listenSock));
+  NCCLCHECK(bootstrapAccept(&state->ringRecvSocket, &state->listenSock));
 
-  // AllGather all listen handlers
+  // AllGather all listen handlers, and the nodes ranks run on
   NCCLCHECK(ncclCalloc(&state->peerCommAddresses, nranks));
-  NCCLCHECK(ncclSocketGetAddr(&state->listenSock, state->peerCommAddresses+rank));
-  NCCLCHECK(bootstrapAllGather(state, state->peerCommAddresses, sizeof(union ncclSocketAddress)));
+  NCCLCHECK(ncclCalloc(&state->peers, nranks));
+  NCCLCHECK(ncclCalloc(&addrInfo, nranks));
+  NCCLCHECK(ncclSocketGetAddr(&state->listenSock, &addrInfo[rank].addr));
+  NCCLCHECK(bootstrapNodeHash(&addrInfo[rank].nodeHash));
+  // Peers cannot be reached directly until we have their addresses: use the ring
+  NCCLCHECK(bootstrapRingAllGather(&state->ringRecvSocket, &state->ringSendSocket, rank, nranks, (char*)addrInfo, sizeof(struct bootstrapAddrInfo)));
+  NCCLCHECK(ncclCalloc(&nodeHashes, nranks));
+  for (int r=0; r<nranks; r++) {
+    state->peerCommAddresses[r] = addrInfo[r].addr;
+    nodeHashes[r] = addrInfo[r].nodeHash;
+  }
+  NCCLCHECK(bootstrapShmInit(state, nodeHashes));
+  free(nodeHashes);
+  free(addrInfo);
 
   // Create the service proxy
   NCCLCHECK(ncclCalloc(&state->peerProxyAddresses, nranks));
@@ -328,14 +1196,108 @@ ncclResult_t bootstrapInit(struct ncclBootstrapHandle* handle, struct ncclComm*
   return ncclSuccess;
 }
 
+NCCL_PARAM(BootstrapSplitShared, "BOOTSTRAP_SPLIT_SHARED", 0);
+
+static ncclResult_t bootstrapBruckAllGather(void* commState, int* ranks, int rank, int nranks, int tag, char* data, int size);
+
+// Information each rank of a comm split in shared mode gives the others
+struct bootstrapSplitInfo {
+  uint64_t nodeHash;
+  uint32_t id;
+};
+
+// Use the connections of the parent: pick the id messages for the comm will carry when they reach
+// us, and learn the ones our peers picked. The parent, which all ranks of the comm are part of,
+// carries the exchange.
+static ncclResult_t bootstrapSplitShared(struct bootstrapState* state, struct bootstrapState* parent, int* parentRanks) {
+  ncclResult_t ret = ncclSuccess;
+  struct bootstrapState* owner = parent->owner;
+  struct bootstrapSplitInfo* info = NULL;
+  uint64_t* nodeHashes = NULL;
+  int rank = state->rank;
+  int nranks = state->nranks;
+
+  NCCLCHECK(ncclCalloc(&state->ownerRanks, nranks));
+  NCCLCHECK(ncclCalloc(&state->peerIds, nranks));
+  for (int r=0; r<nranks; r++) state->ownerRanks[r] = bootstrapOwnerRank(parent, parentRanks[r]);
+
+  // From here on, closing the comm drops its reference to the connections of the owner
+  pthread_mutex_lock(&owner->lock);
+  state->owner = owner;
+  state->id = owner->nextId++;
+  owner->refCount++;
+  pthread_mutex_unlock(&owner->lock);
+
+  NCCLCHECKGOTO(ncclCalloc(&info, nranks), ret, exit);
+  NCCLCHECKGOTO(ncclCalloc(&nodeHashes, nranks), ret, exit);
+  info[rank].id = state->id;
+  NCCLCHECKGOTO(bootstrapNodeHash(&info[rank].nodeHash), ret, exit);
+  NCCLCHECKGOTO(bootstrapBruckAllGather(parent, parentRanks, rank, nranks, BOOTSTRAP_TAG_SPLIT, (char*)info, sizeof(struct bootstrapSplitInfo)), ret, exit);
+  for (int r=0; r<nranks; r++) {
+    state->peerIds[r] = info[r].id;
+    nodeHashes[r] = info[r].nodeHash;
+  }
+  NCCLCHECKGOTO(bootstrapShmInit(state, nodeHashes), ret, exit);
+exit:
+  free(info);
+  free(nodeHashes);
+  return ret;
+}
+
+// Set up our own connections, the peers of the ring reaching each other through the parent
+static ncclResult_t bootstrapSplitConnect(struct bootstrapState* state, struct bootstrapState* parent, int* parentRanks) {
+  ncclResult_t ret = ncclSuccess;
+  int rank = state->rank;
+  int nranks = state->nranks;
+  int prev = parentRanks[(rank-1+nranks)%nranks];
+  int next = parentRanks[(rank+1)%nranks];
+  ncclSocketAddress listenAddr, nextAddr;
+  struct bootstrapAddrInfo* addrInfo = NULL;
+  uint64_t* nodeHashes = NULL;
+
+  NCCLCHECK(ncclSocketInit(&state->ringRecvSocket));
+  // Create socket for other ranks to contact me
+  NCCLCHECK(ncclSocketInit(&state->listenSock, &bootstrapNetIfAddr, state->magic, ncclSocketTypeBootstrap, state->abortFlag, 1));
+  NCCLCHECK(ncclSocketListen(&state->listenSock));
+
+  // Get addr from next rank
+  NCCLCHECK(ncclSocketGetAddr(&state->listenSock, &listenAddr));
+  NCCLCHECK(bootstrapSend(parent, prev, BOOTSTRAP_TAG_SPLIT, &listenAddr, sizeof(union ncclSocketAddress)));
+  NCCLCHECK(bootstrapRecv(parent, next, BOOTSTRAP_TAG_SPLIT, &nextAddr, sizeof(union ncclSocketAddress)));
+
+  NCCLCHECK(ncclSocketInit(&state->ringSendSocket, &nextAddr, state->magic, ncclSocketTypeBootstrap, state->abortFlag, 0));
+  NCCLCHECK(ncclSocketConnect(&state->ringSendSocket));
+  // Accept the connect request from the previous rank in the AllGather ring
+  NCCLCHECK(bootstrapAccept(&state->ringRecvSocket, &state->listenSock));
+
+  // AllGather all listen handlers, and the nodes ranks run on
+  NCCLCHECK(ncclCalloc(&state->peerCommAddresses, nranks));
+  NCCLCHECK(ncclCalloc(&state->peers, nranks));
+  NCCLCHECKGOTO(ncclCalloc(&addrInfo, nranks), ret, exit);
+  NCCLCHECKGOTO(ncclCalloc(&nodeHashes, nranks), ret, exit);
+  memcpy(&addrInfo[rank].addr, &listenAddr, sizeof(union ncclSocketAddress));
+  NCCLCHECKGOTO(bootstrapNodeHash(&addrInfo[rank].nodeHash), ret, exit);
+  // Peers cannot be reached directly until we have their addresses: use the ring
+  NCCLCHECKGOTO(bootstrapRingAllGather(&state->ringRecvSocket, &state->ringSendSocket, rank, nranks, (char*)addrInfo, sizeof(struct bootstrapAddrInfo)), ret, exit);
+  for (int r=0; r<nranks; r++) {
+    state->peerCommAddresses[r] = addrInfo[r].addr;
+    nodeHashes[r] = addrInfo[r].nodeHash;
+  }
+  NCCLCHECKGOTO(bootstrapShmInit(state, nodeHashes), ret, exit);
+exit:
+  free(addrInfo);
+  free(nodeHashes);
+  return ret;
+}
+
 ncclResult_t bootstrapSplit(struct ncclBootstrapHandle* handle, struct ncclComm* comm, struct ncclComm* parent, int color, int key, int* parentRanks) {
   ncclResult_t ret = ncclSuccess;
   int rank = comm->rank;
   int nranks = comm->nRanks;
-  int prev, next;
-  ncclSocketAddress listenAddr, tmpAddr;
+  ncclSocketAddress tmpAddr;
   struct ncclSocket* proxySocket;
   struct bootstrapState* state;
+  int shared = ncclParamBootstrapSplitShared();
 
   NCCLCHECKGOTO(ncclCalloc(&state, 1), ret, fail);
   state->rank = rank;
@@ -344,30 +1306,13 @@ ncclResult_t bootstrapSplit(struct ncclBootstrapHandle* handle, struct ncclComm*
   comm->bootstrap = state;
   comm->magic = state->magic = handle->magic;
 
-  prev = parentRanks[(rank-1+nranks)%nranks];
-  next = parentRanks[(rank+1)%nranks];
-
-  // Setup my sockets for the allgather ring and other p2p connections
-  NCCLCHECKGOTO(ncclSocketInit(&state->listenSock, &bootstrapNetIfAddr, comm->magic, ncclSocketTypeBootstrap, comm->abortFlag, 0), ret, fail);
-  NCCLCHECKGOTO(ncclSocketInit(&state->ringRecvSocket, NULL, comm->magic, ncclSocketTypeBootstrap, comm->abortFlag, 0), ret, fail);
-
-  // Create socket for other ranks to contact me
-  NCCLCHECKGOTO(ncclSocketListen(&state->listenSock), ret, fail);
-
-  // Get addr from next rank
-  NCCLCHECKGOTO(ncclSocketGetAddr(&state->listenSock, &listenAddr), ret, fail);
-  NCCLCHECKGOTO(bootstrapSend(parent->bootstrap, prev, -2, &listenAddr, sizeof(union ncclSocketAddress)), ret, fail);
-  NCCLCHECKGOTO(bootstrapRecv(parent->bootstrap, next, -2, &tmpAddr, sizeof(union ncclSocketAddress)), ret, fail);
-
-  NCCLCHECKGOTO(ncclSocketInit(&state->ringSendSocket, &tmpAddr, comm->magic, ncclSocketTypeBootstrap, comm->abortFlag, 0), ret, fail);
-  NCCLCHECKGOTO(ncclSocketConnect(&state->ringSendSocket), ret, fail);
-  // Accept the connect request from the previous rank in the AllGather ring
-  NCCLCHECKGOTO(ncclSocketAccept(&state->ringRecvSocket, &state->listenSock), ret, fail);
-
-  // AllGather all listen handlers
-  NCCLCHECKGOTO(ncclCalloc(&state->peerCommAddresses, nranks), ret, fail);
-  memcpy(state->peerCommAddresses+rank, &listenAddr, sizeof(union ncclSocketAddress));
-  NCCLCHECKGOTO(bootstrapAllGather(state, state->peerCommAddresses, sizeof(union ncclSocketAddress)), ret, fail);
+  if (shared) {
+    // No new sockets: messages of the comm go over the connections of the parent
+    NCCLCHECKGOTO(bootstrapSplitShared(state, (struct bootstrapState*)parent->bootstrap, parentRanks), ret, fail);
+  } else {
+    bootstrapOwnerInit(state);
+    NCCLCHECKGOTO(bootstrapSplitConnect(state, (struct bootstrapState*)parent->bootstrap, parentRanks), ret, fail);
+  }
 
   if (parent->config.splitShare) {
     /* map local rank to top parent local rank. */
@@ -393,7 +1338,8 @@ ncclResult_t bootstrapSplit(struct ncclBootstrapHandle* handle, struct ncclComm*
     NCCLCHECKGOTO(ncclProxyInit(comm, proxySocket, state->peerProxyAddresses, state->peerProxyAddressesUDS), ret, fail);
   }
 
-  INFO(NCCL_INIT, "bootstrapSplit: comm %p parent %p rank %d nranks %d color %d key %d prev %d next %d - DONE", comm, parent, rank, nranks, color, key, prev, next);
+  INFO(NCCL_INIT, "bootstrapSplit: comm %p parent %p rank %d nranks %d color %d key %d %s - DONE", comm, parent, rank, nranks, color, key,
+      shared ? "sharing parent connections" : "own connections");
 
 exit:
   return ret;
@@ -403,74 +1349,193 @@ fail:
 
 // Bootstrap send/receive functions
 //
-// We do not keep connections opened with all ranks at all times, and we have no guarantee
-// that connections to our unique listen socket will arrive in the same order as we need
-// them. Therefore, when establishing a connection, the sender sends a (peer, tag) tuple to
-// allow the receiver to identify the flow, and keep it in an unexpected queue if needed.
+// We keep a connection open with each peer we send to, created with the first message and
+// announced by sending our rank, and accepted by the peer from its unique listen socket. Each
+// message carries its tag and size. A peer may send us messages in a different order than we ask
+// for them, so those we are not looking for yet are kept in an unexpected queue.
+//
+// To bound the number of files we use, we close the least recently used connection we send on,
+// once nothing is left to send on it, when opening one more would exceed maxSendSocks. The peer
+// receives what is left on it until it sees it closed, before moving to the next one we open.
+//
+// Comms split in shared mode multiplex their messages over the connections of their owner, and
+// may be used from different threads. Sends are queued on a connection and receives posted on
+// it; the thread holding the owner lock moves data for all of them, and threads wait for their
+// sockets without holding it. Functions taking the owner are called with it locked.
+
+// Close the least recently used send socket with nothing left to send, if any
+static void bootstrapPeerEvict(struct bootstrapState* owner) {
+  int lru = -1;
+  for (int r=0; r<owner->nranks; r++) {
+    struct bootstrapPeer* p = owner->peers+r;
+    if (p->sendSock.state != ncclSocketStateReady || p->sendHead) continue;
+    if (lru == -1 || p->lastSend < owner->peers[lru].lastSend) lru = r;
+  }
+  if (lru == -1) return;
+  ncclSocketClose(&owner->peers[lru].sendSock);
+  owner->nSendSocks--;
+}
 
-ncclResult_t bootstrapConnect(void* commState, int peer, int tag, struct ncclSocket* sock) {
-  ncclResult_t ret = ncclSuccess;
-  struct bootstrapState* state = (struct bootstrapState*)commState;
+static ncclResult_t bootstrapPeerConnect(struct bootstrapState* owner, int peer) {
+  struct ncclSocket* sock = &owner->peers[peer].sendSock;
+  owner->peers[peer].lastSend = ++owner->sendClock;
+  if (sock->state == ncclSocketStateReady) return ncclSuccess;
+  if (owner->nSendSocks >= owner->maxSendSocks) bootstrapPeerEvict(owner);
+  NCCLCHECK(ncclSocketInit(sock, owner->peerCommAddresses+peer, owner->magic, ncclSocketTypeBootstrap, owner->abortFlag));
+  NCCLCHECK(ncclSocketConnect(sock));
+  owner->nSendSocks++;
+  NCCLCHECK(ncclSocketSend(sock, &owner->rank, sizeof(int)));
+  return ncclSuccess;
+}
+
+static ncclResult_t bootstrapRecvProgress(struct bootstrapState* owner, int peer, int* progress);
+
+// Receive what is left on the connection a peer closed, before using the next one it opened
+static ncclResult_t bootstrapRecvDrain(struct bootstrapState* owner, int peer) {
+  struct bootstrapPeer* p = owner->peers+peer;
+  struct ncclSocket* sock = &p->recvSock;
+  int op = NCCL_SOCKET_RECV;
+  uint64_t idleStart = 0;
+  while (p->recvSock.state == ncclSocketStateReady) {
+    int progress = 0;
+    if (owner->abortFlag && __atomic_load_n(owner->abortFlag, __ATOMIC_ACQUIRE)) return ncclInternalError;
+    NCCLCHECK(bootstrapRecvProgress(owner, peer, &progress));
+    if (progress) idleStart = 0;
+    else NCCLCHECK(ncclSocketWaitIdle(1, &sock, &op, &idleStart));
+  }
+  return ncclSuccess;
+}
+
+// Progress the receive sockets of all peers, which closes those the peers closed
+static ncclResult_t bootstrapRecvSweep(struct bootstrapState* owner) {
+  for (int r=0; r<owner->nranks; r++) {
+    int progress = 0;
+    if (owner->peers[r].recvSock.state != ncclSocketStateReady) continue;
+    NCCLCHECK(bootstrapRecvProgress(owner, r, &progress));
+  }
+  owner->recvSweep = std::max(owner->maxSendSocks, 2*owner->nRecvSocks);
+  return ncclSuccess;
+}
 
-  NCCLCHECKGOTO(ncclSocketInit(sock, state->peerCommAddresses+peer, state->magic, ncclSocketTypeBootstrap), ret, fail);
-  NCCLCHECKGOTO(ncclSocketConnect(sock), ret, fail);
-  NCCLCHECKGOTO(bootstrapNetSend(sock, &state->rank, sizeof(int)), ret, fail);
-  NCCLCHECKGOTO(bootstrapNetSend(sock, &tag, sizeof(int)), ret, fail);
+// Progress the connection being accepted, from whichever peer it comes
+static ncclResult_t bootstrapAcceptProgress(struct bootstrapState* owner, int* progress) {
+  ncclResult_t ret = ncclSuccess;
+  struct ncclSocket* sock = &owner->acceptSock;
+  int ready, newPeer;
+  if (sock->state == ncclSocketStateNone) {
+    NCCLCHECK(ncclSocketInit(sock));
+    NCCLCHECKGOTO(ncclSocketAccept(sock, &owner->listenSock), ret, fail);
+  }
+  NCCLCHECKGOTO(ncclSocketReady(sock, &ready), ret, fail);
+  if (!ready) return ncclSuccess;
+  NCCLCHECKGOTO(ncclSocketRecv(sock, &newPeer, sizeof(int)), ret, fail);
+  if (newPeer < 0 || newPeer >= owner->nranks) {
+    WARN("Bootstrap : unexpected connection from rank %d", newPeer);
+    ret = ncclInternalError;
+    goto fail;
+  }
+  // The peer only opens a new connection after closing the previous one
+  if (owner->peers[newPeer].recvSock.state == ncclSocketStateReady) NCCLCHECKGOTO(bootstrapRecvDrain(owner, newPeer), ret, fail);
+  memcpy(&owner->peers[newPeer].recvSock, sock, sizeof(struct ncclSocket));
+  memset(sock, 0, sizeof(struct ncclSocket));
+  *progress = 1;
+  if (++owner->nRecvSocks >= owner->recvSweep) NCCLCHECK(bootstrapRecvSweep(owner));
   return ncclSuccess;
 fail:
-  NCCLCHECK(ncclSocketClose(sock));
+  ncclSocketClose(sock);
+  memset(sock, 0, sizeof(struct ncclSocket));
   return ret;
 }
 
-ncclResult_t bootstrapSend(void* commState, int peer, int tag, void* data, int size) {
-  ncclResult_t ret = ncclSuccess;
-  struct ncclSocket sock;
+#define UNEX_INIT_BUCKETS 64
 
-  TRACE(NCCL_BOOTSTRAP, "Sending to peer=%d tag=%d size=%d", peer, tag, size);
-  NCCLCHECK(bootstrapConnect(commState, peer, tag, &sock));
-  NCCLCHECKGOTO(bootstrapNetSend(&sock, data, size), ret, exit);
+static inline int unexpectedBucket(struct unexTable* table, int peer, uint32_t id, int tag) {
+  uint32_t h = (uint32_t)peer*2654435761U ^ id*2246822519U ^ (uint32_t)tag*40503U;
+  return (h ^ (h >> 16)) & (table->nBuckets-1);
+}
 
-  TRACE(NCCL_BOOTSTRAP, "Sent to peer=%d tag=%d size=%d", peer, tag, size);
+static void unexpectedAppend(struct unexTable* table, struct unexMsg* unex) {
+  int b = unexpectedBucket(table, unex->peer, unex->id, unex->tag);
+  unex->next = NULL;
+  if (table->tails[b]) table->tails[b]->next = unex;
+  else table->heads[b] = unex;
+  table->tails[b] = unex;
+}
 
-exit:
-  NCCLCHECK(ncclSocketClose(&sock));
-  return ret;
+// Double the number of buckets, keeping the order of messages within each key
+static ncclResult_t unexpectedGrow(struct unexTable* table) {
+  struct unexMsg** heads = table->heads;
+  struct unexMsg** tails = table->tails;
+  int nBuckets = table->nBuckets;
+  table->nBuckets = nBuckets ? 2*nBuckets : UNEX_INIT_BUCKETS;
+  NCCLCHECK(ncclCalloc(&table->heads, table->nBuckets));
+  NCCLCHECK(ncclCalloc(&table->tails, table->nBuckets));
+  for (int b=0; b<nBuckets; b++) {
+    for (struct unexMsg* elem = heads[b]; elem; ) {
+      struct unexMsg* next = elem->next;
+      unexpectedAppend(table, elem);
+      elem = next;
+    }
+  }
+  free(heads);
+  free(tails);
+  return ncclSuccess;
 }
 
-ncclResult_t unexpectedEnqueue(struct bootstrapState* state, int peer, int tag, struct ncclSocket* sock) {
+ncclResult_t unexpectedEnqueue(struct bootstrapState* state, int peer, uint32_t id, int tag, char* data, int size) {
+  struct unexTable* table = &state->unexpected;
+  if (table->count >= 2*table->nBuckets) NCCLCHECK(unexpectedGrow(table));
+
   // New unex
-  struct unexConn* unex;
+  struct unexMsg* unex;
   NCCLCHECK(ncclCalloc(&unex, 1));
   unex->peer = peer;
+  unex->id = id;
   unex->tag = tag;
-  memcpy(&unex->sock, sock, sizeof(struct ncclSocket));
+  unex->size = size;
+  unex->data = data;
+  unexpectedAppend(table, unex);
+
+  table->count++;
+  table->bytes += size;
+  table->peakCount = std::max(table->peakCount, table->count);
+  table->peakBytes = std::max(table->peakBytes, table->bytes);
+  return ncclSuccess;
+}
 
-  // Enqueue
-  struct unexConn* list = state->unexpectedConnections;
-  if (list == NULL) {
-    state->unexpectedConnections = unex;
-    return ncclSuccess;
+static void unexpectedRemove(struct unexTable* table, int b, struct unexMsg* prev, struct unexMsg* elem) {
+  if (prev == NULL) {
+    table->heads[b] = elem->next;
+  } else {
+    prev->next = elem->next;
   }
-  while (list->next) list = list->next;
-  list->next = unex;
-  return ncclSuccess;
+  if (table->tails[b] == elem) table->tails[b] = prev;
+  table->count--;
+  table->bytes -= elem->size;
+  free(elem->data);
+  free(elem);
 }
 
-ncclResult_t unexpectedDequeue(struct bootstrapState* state, int peer, int tag, struct ncclSocket* sock, int* found) {
-  struct unexConn* elem = state->unexpectedConnections;
-  struct unexConn* prev = NULL;
+// Copy the first unexpected message from (peer, id, tag), if any, to data
+ncclResult_t unexpectedDequeue(struct bootstrapState* state, int peer, uint32_t id, int tag, void* data, int size, int* found) {
+  struct unexTable* table = &state->unexpected;
   *found = 0;
+  if (table->count == 0) return ncclSuccess;
+  int b = unexpectedBucket(table, peer, id, tag);
+  struct unexMsg* elem = table->heads[b];
+  struct unexMsg* prev = NULL;
   while (elem) {
-    if (elem->peer == peer && elem->tag == tag) {
-      if (prev == NULL) {
-        state->unexpectedConnections = elem->next;
+    if (elem->peer == peer && elem->id == id && elem->tag == tag) {
+      ncclResult_t ret = ncclSuccess;
+      if (elem->size > size) {
+        WARN("Message truncated : received %d bytes instead of %d", elem->size, size);
+        ret = ncclInternalError;
       } else {
-        prev->next = elem->next;
+        memcpy(data, elem->data, elem->size);
       }
-      memcpy(sock, &elem->sock, sizeof(struct ncclSocket));
-      free(elem);
+      unexpectedRemove(table, b, prev, elem);
       *found = 1;
-      return ncclSuccess;
+      return ret;
     }
     prev = elem;
     elem = elem->next;
@@ -478,57 +1543,281 @@ ncclResult_t unexpectedDequeue(struct bootstrapState* state, int peer, int tag,
   return ncclSuccess;
 }
 
-static void unexpectedFree(struct bootstrapState* state) {
-  struct unexConn* elem = state->unexpectedConnections;
-  struct unexConn* prev = NULL;
+// Drop the unexpected messages of comm id. Returns how many there were.
+static int unexpectedPurge(struct bootstrapState* state, uint32_t id) {
+  struct unexTable* table = &state->unexpected;
+  int count = 0;
+  for (int b=0; b<table->nBuckets; b++) {
+    struct unexMsg* elem = table->heads[b];
+    struct unexMsg* prev = NULL;
+    while (elem) {
+      struct unexMsg* next = elem->next;
+      if (elem->id == id) {
+        unexpectedRemove(table, b, prev, elem);
+        count++;
+      } else {
+        prev = elem;
+      }
+      elem = next;
+    }
+  }
+  return count;
+}
 
-  while (elem) {
-    prev = elem;
-    elem = elem->next;
-    free(prev);
+static void unexpectedFree(struct bootstrapState* state) {
+  struct unexTable* table = &state->unexpected;
+  for (int b=0; b<table->nBuckets; b++) {
+    struct unexMsg* elem = table->heads[b];
+    while (elem) {
+      struct unexMsg* next = elem->next;
+      free(elem->data);
+      free(elem);
+      elem = next;
+    }
   }
+  free(table->heads);
+  free(table->tails);
+  table->heads = table->tails = NULL;
+  table->nBuckets = table->count = 0;
+  table->bytes = 0;
   return;
 }
 
-// We can't know who we'll receive from, so we need to receive everything at once
-ncclResult_t bootstrapAccept(void* commState, int peer, int tag, struct ncclSocket* sock) {
+static ncclResult_t bootstrapSendProgress(struct bootstrapState* owner, int peer, int* progress) {
+  struct bootstrapPeer* p = owner->peers+peer;
+  while (p->sendHead) {
+    struct bootstrapSendOp* op = p->sendHead;
+    int offset = op->offset;
+    NCCLCHECK(ncclSocketProgressIov(NCCL_SOCKET_SEND, &p->sendSock, op->iov, 2, &op->offset));
+    if (op->offset != offset) *progress = 1;
+    if (op->offset < (int)sizeof(op->hdr)+op->hdr.size) return ncclSuccess;
+    p->sendHead = op->next;
+    if (p->sendHead == NULL) p->sendTail = NULL;
+    if (op->orphan) free(op);
+    else op->done = 1;
+  }
+  return ncclSuccess;
+}
+
+// Withdraw a send we stop waiting for. Once started, it has to go out entirely for the connection
+// to remain usable, so the rest is sent from a copy.
+static void bootstrapSendCancel(struct bootstrapState* owner, int peer, struct bootstrapSendOp* op) {
+  struct bootstrapPeer* p = owner->peers+peer;
+  struct bootstrapSendOp** ptr = &p->sendHead;
+  struct bootstrapSendOp* prev = NULL;
+  struct bootstrapSendOp* copy = NULL;
+  while (*ptr && *ptr != op) {
+    prev = *ptr;
+    ptr = &prev->next;
+  }
+  if (*ptr == NULL) return;
+  if (op->offset > 0) {
+    char* buf;
+    if (ncclCalloc(&buf, sizeof(struct bootstrapSendOp)+op->hdr.size) == ncclSuccess) {
+      copy = (struct bootstrapSendOp*)buf;
+      memcpy(copy, op, sizeof(struct bootstrapSendOp));
+      memcpy(buf+sizeof(struct bootstrapSendOp), op->iov[1].iov_base, op->hdr.size);
+      copy->iov[0].iov_base = &copy->hdr;
+      copy->iov[1].iov_base = buf+sizeof(struct bootstrapSendOp);
+      copy->orphan = 1;
+    }
+  }
+  if (copy) {
+    *ptr = copy;
+    if (p->sendTail == op) p->sendTail = copy;
+  } else {
+    *ptr = op->next;
+    if (p->sendTail == op) p->sendTail = prev;
+  }
+}
+
+// Receive data from a peer until a message for a posted receive is complete
+static ncclResult_t bootstrapRecvProgress(struct bootstrapState* owner, int peer, int* progress) {
+  struct bootstrapPeer* p = owner->peers+peer;
+  const int hdrSize = sizeof(struct bootstrapMsgHdr);
+  if (p->recvSock.state != ncclSocketStateReady) return bootstrapAcceptProgress(owner, progress);
+  while (1) {
+    if (p->offset < hdrSize) {
+      int offset = p->offset, closed;
+      struct iovec iov = { &p->hdr, (size_t)hdrSize };
+      NCCLCHECK(ncclSocketProgressIov(NCCL_SOCKET_RECV, &p->recvSock, &iov, 1, &p->offset, &closed));
+      if (closed) {
+        if (p->offset > 0) {
+          WARN("Bootstrap : connection from rank %d closed in the middle of a message", peer);
+          return ncclRemoteError;
+        }
+        // The peer closed an idle connection; it opens a new one for its next messages
+        ncclSocketClose(&p->recvSock);
+        memset(&p->recvSock, 0, sizeof(struct ncclSocket));
+        owner->nRecvSocks--;
+        *progress = 1;
+        return ncclSuccess;
+      }
+      if (p->offset != offset) *progress = 1;
+      if (p->offset < hdrSize) return ncclSuccess;
+      // Receive straight into the receive posted for the message, if any
+      struct bootstrapRecvOp** op = &p->recvOps;
+      while (*op && ((*op)->id != p->hdr.id || (*op)->tag != p->hdr.tag)) op = &(*op)->next;
+      if (*op == NULL) {
+        NCCLCHECK(ncclCalloc(&p->data, p->hdr.size));
+      } else if (p->hdr.size > (*op)->size) {
+        WARN("Message truncated : received %d bytes instead of %d", p->hdr.size, (*op)->size);
+        return ncclInternalError;
+      } else {
+        p->recvOp = *op;
+        p->data = (*op)->data;
+        *op = (*op)->next;
+      }
+    }
+    int offset = p->offset-hdrSize;
+    if (offset < p->hdr.size) {
+      NCCLCHECK(ncclSocketProgress(NCCL_SOCKET_RECV, &p->recvSock, p->data, p->hdr.size, &offset));
+      if (offset+hdrSize != p->offset) *progress = 1;
+      p->offset = offset+hdrSize;
+      if (offset < p->hdr.size) return ncclSuccess;
+    }
+    struct bootstrapRecvOp* op = p->recvOp;
+    if (op == NULL) NCCLCHECK(unexpectedEnqueue(owner, peer, p->hdr.id, p->hdr.tag, p->data, p->hdr.size));
+    p->offset = 0;
+    p->data = NULL;
+    p->recvOp = NULL;
+    if (op) {
+      op->done = 1;
+      return ncclSuccess;
+    }
+  }
+}
+
+// Withdraw a receive we stop waiting for. If its message is arriving, the rest of it goes to the
+// unexpected queue.
+static void bootstrapRecvCancel(struct bootstrapState* owner, int peer, struct bootstrapRecvOp* op) {
+  struct bootstrapPeer* p = owner->peers+peer;
+  if (p->recvOp == op) {
+    char* data;
+    if (ncclCalloc(&data, p->hdr.size) != ncclSuccess) {
+      // Cannot keep the message, nor the connection
+      ncclSocketClose(&p->recvSock);
+      owner->nRecvSocks--;
+      return;
+    }
+    memcpy(data, op->data, p->offset-sizeof(struct bootstrapMsgHdr));
+    p->data = data;
+    p->recvOp = NULL;
+    return;
+  }
+  for (struct bootstrapRecvOp** ptr = &p->recvOps; *ptr; ptr = &(*ptr)->next) {
+    if (*ptr == op) {
+      *ptr = op->next;
+      return;
+    }
+  }
+}
+
+// Send to a peer and receive from another at the same time, so that large messages cannot
+// deadlock. A negative peer skips that side.
+static ncclResult_t bootstrapSendRecv(void* commState, int sendPeer, int sendTag, void* sendData, int sendSize,
+    int recvPeer, int recvTag, void* recvData, int recvSize) {
   ncclResult_t ret = ncclSuccess;
   struct bootstrapState* state = (struct bootstrapState*)commState;
-  int newPeer, newTag;
+  struct bootstrapState* owner = state->owner;
+  struct bootstrapSendOp send;
+  struct bootstrapRecvOp recv;
+  int sendPosted = 0, recvPosted = 0;
+  uint64_t idleStart = 0;
+  memset(&send, 0, sizeof(send));
+  memset(&recv, 0, sizeof(recv));
+  send.done = sendPeer < 0;
+  recv.done = recvPeer < 0;
+  if (!send.done) {
+    send.hdr.id = bootstrapPeerId(state, sendPeer);
+    send.hdr.tag = sendTag;
+    send.hdr.size = sendSize;
+    send.iov[0].iov_base = &send.hdr;
+    send.iov[0].iov_len = sizeof(send.hdr);
+    send.iov[1].iov_base = sendData;
+    send.iov[1].iov_len = sendSize;
+    sendPeer = bootstrapOwnerRank(state, sendPeer);
+  }
+  if (!recv.done) {
+    recv.id = state->id;
+    recv.tag = recvTag;
+    recv.data = (char*)recvData;
+    recv.size = recvSize;
+    recvPeer = bootstrapOwnerRank(state, recvPeer);
+  }
 
-  // Search unexpected connections first
-  int found;
-  NCCLCHECK(unexpectedDequeue(state, peer, tag, sock, &found));
-  if (found) return ncclSuccess;
+  pthread_mutex_lock(&owner->lock);
+  // Connecting does not depend on the peer accepting, so every rank can connect before accepting
+  if (!send.done) {
+    struct bootstrapPeer* p = owner->peers+sendPeer;
+    NCCLCHECKGOTO(bootstrapPeerConnect(owner, sendPeer), ret, exit);
+    if (p->sendTail) p->sendTail->next = &send;
+    else p->sendHead = &send;
+    p->sendTail = &send;
+    sendPosted = 1;
+  }
+  if (!recv.done) {
+    NCCLCHECKGOTO(unexpectedDequeue(owner, recvPeer, recv.id, recvTag, recvData, recvSize, &recv.done), ret, exit);
+  }
+  if (!recv.done) {
+    struct bootstrapRecvOp** ptr = &owner->peers[recvPeer].recvOps;
+    while (*ptr) ptr = &(*ptr)->next;
+    *ptr = &recv;
+    recvPosted = 1;
+  }
 
-  // Then look for new connections
-  while (1) {
-    NCCLCHECKGOTO(ncclSocketInit(sock), ret, fail);
-    NCCLCHECKGOTO(ncclSocketAccept(sock, &state->listenSock), ret, fail);
-    NCCLCHECKGOTO(bootstrapNetRecv(sock, &newPeer, sizeof(int)), ret, fail);
-    NCCLCHECKGOTO(bootstrapNetRecv(sock, &newTag, sizeof(int)), ret, fail);
-    if (newPeer == peer && newTag == tag) return ncclSuccess;
-    NCCLCHECKGOTO(unexpectedEnqueue(state, newPeer, newTag, sock), ret, fail);
+  while (!send.done || !recv.done) {
+    int progress = 0;
+    if (__atomic_load_n(state->abortFlag, __ATOMIC_ACQUIRE)) {
+      ret = ncclInternalError;
+      goto exit;
+    }
+    if (!send.done) NCCLCHECKGOTO(bootstrapSendProgress(owner, sendPeer, &progress), ret, exit);
+    if (!recv.done) NCCLCHECKGOTO(bootstrapRecvProgress(owner, recvPeer, &progress), ret, exit);
+    if (progress || (send.done && recv.done)) {
+      idleStart = 0;
+    } else {
+      // Wait on copies of the sockets, which other threads may progress meanwhile
+      struct ncclSocket socks[2];
+      struct ncclSocket* sockPtrs[2] = { socks, socks+1 };
+      int ops[2], n = 0;
+      if (!send.done) {
+        socks[n] = owner->peers[sendPeer].sendSock;
+        ops[n++] = NCCL_SOCKET_SEND;
+      }
+      if (!recv.done) {
+        struct ncclSocket* recvSock = &owner->peers[recvPeer].recvSock;
+        socks[n] = recvSock->state == ncclSocketStateReady ? *recvSock : owner->acceptSock;
+        ops[n++] = NCCL_SOCKET_RECV;
+      }
+      pthread_mutex_unlock(&owner->lock);
+      ret = ncclSocketWaitIdle(n, sockPtrs, ops, &idleStart);
+      pthread_mutex_lock(&owner->lock);
+      if (ret != ncclSuccess) goto exit;
+    }
   }
-  return ncclSuccess;
-fail:
-  NCCLCHECK(ncclSocketClose(sock));
+exit:
+  if (sendPosted && !send.done) bootstrapSendCancel(owner, sendPeer, &send);
+  if (recvPosted && !recv.done) bootstrapRecvCancel(owner, recvPeer, &recv);
+  pthread_mutex_unlock(&owner->lock);
   return ret;
 }
 
+ncclResult_t bootstrapSend(void* commState, int peer, int tag, void* data, int size) {
+  TRACE(NCCL_BOOTSTRAP, "Sending to peer=%d tag=%d size=%d", peer, tag, size);
+  NCCLCHECK(bootstrapSendRecv(commState, peer, tag, data, size, -1, 0, NULL, 0));
+  TRACE(NCCL_BOOTSTRAP, "Sent to peer=%d tag=%d size=%d", peer, tag, size);
+  return ncclSuccess;
+}
+
 // We can't know who we'll receive from, so we need to receive everything at once
 ncclResult_t bootstrapRecv(void* commState, int peer, int tag, void* data, int size) {
-  ncclResult_t ret;
-  struct ncclSocket sock;
-  NCCLCHECK(bootstrapAccept(commState, peer, tag, &sock));
   TRACE(NCCL_BOOTSTRAP, "Receiving tag=%d peer=%d size=%d", tag, peer, size);
-  NCCLCHECKGOTO(bootstrapNetRecv(&sock, ((char*)data), size), ret, exit);
-exit:
-  NCCLCHECK(ncclSocketClose(&sock));
-  return ret;
+  NCCLCHECK(bootstrapSendRecv(commState, -1, 0, NULL, 0, peer, tag, data, size));
+  return ncclSuccess;
 }
 
-// Collective algorithms, based on bootstrapSend/Recv, and sometimes bootstrapConnect/Accept
+// Collective algorithms, based on bootstrapSend/Recv
 
 ncclResult_t bootstrapRingAllGather(struct ncclSocket* prevSocket, struct ncclSocket* nextSocket, int rank, int nranks, char* data, int size) {
   /* Simple ring based AllGather
@@ -544,6 +1833,52 @@ ncclResult_t bootstrapRingAllGather(struct ncclSocket* prevSocket, struct ncclSo
   }
   return ncclSuccess;
 }
+
+// Bruck AllGather, in ceil(log2(nranks)) steps: at step k, send the slices gathered so far (at
+// most 2^k of them) to rank-2^k and receive as many from rank+2^k. Slices are gathered in a
+// temporary buffer starting with our own, then rotated into place. Runs among ranks (all ranks
+// when NULL), rank being our index in it.
+static ncclResult_t bootstrapBruckAllGather(void* commState, int* ranks, int rank, int nranks, int tag, char* data, int size) {
+  ncclResult_t ret = ncclSuccess;
+  char* tmp;
+  NCCLCHECK(ncclCalloc(&tmp, (size_t)nranks*size));
+  memcpy(tmp, data+(size_t)rank*size, size);
+  for (int dist=1; dist<nranks; dist<<=1) {
+    int n = std::min(dist, nranks-dist);
+    int dst = (rank-dist+nranks)%nranks;
+    int src = (rank+dist)%nranks;
+    NCCLCHECKGOTO(bootstrapSendRecv(commState, ranks ? ranks[dst] : dst, tag, tmp, n*size,
+          ranks ? ranks[src] : src, tag, tmp+(size_t)dist*size, n*size), ret, exit);
+  }
+  // tmp now holds the slices of ranks rank, rank+1, ...
+  for (int i=0; i<nranks; i++) memcpy(data+(size_t)((rank+i)%nranks)*size, tmp+(size_t)i*size, size);
+exit:
+  free(tmp);
+  return ret;
+}
+
+// Ring AllGather among ranks (all ranks when NULL), over the connections to our neighbors
+static ncclResult_t bootstrapPeerRingAllGather(void* commState, int* ranks, int rank, int nranks, int tag, char* data, int size) {
+  int prev = (rank - 1 + nranks) % nranks;
+  int next = (rank + 1) % nranks;
+  if (ranks) {
+    prev = ranks[prev];
+    next = ranks[next];
+  }
+  for (int i=0; i<nranks-1; i++) {
+    size_t rslice = (rank - i - 1 + nranks) % nranks;
+    size_t sslice = (rank - i + nranks) % nranks;
+    NCCLCHECK(bootstrapSendRecv(commState, next, tag, data+sslice*size, size, prev, tag, data+rslice*size, size));
+  }
+  return ncclSuccess;
+}
+
+// The ring takes nranks-1 steps over the ring sockets, Bruck ceil(log2(nranks)) steps over peer
+// connections, opened on first use and kept for later calls. Past a few MB the data transferred
+// dominates, and both move the same amount.
+NCCL_PARAM(BootstrapBruckMinRanks, "BOOTSTRAP_BRUCK_MIN_RANKS", 16);
+NCCL_PARAM(BootstrapBruckMaxBytes, "BOOTSTRAP_BRUCK_MAX_BYTES", 8*1024*1024);
+
 ncclResult_t bootstrapAllGather(void* commState, void* allData, int size) {
   struct bootstrapState* state = (struct bootstrapState*)commState;
   int rank = state->rank;
@@ -551,7 +1886,14 @@ ncclResult_t bootstrapAllGather(void* commState, void* allData, int size) {
 
   TRACE(NCCL_INIT, "rank %d nranks %d size %d", rank, nranks, size);
 
-  NCCLCHECK(bootstrapRingAllGather(&state->ringRecvSocket, &state->ringSendSocket, rank, nranks, (char*)allData, size));
+  if (nranks >= ncclParamBootstrapBruckMinRanks() && (int64_t)nranks*size <= ncclParamBootstrapBruckMaxBytes()) {
+    NCCLCHECK(bootstrapBruckAllGather(commState, NULL, rank, nranks, BOOTSTRAP_TAG_ALLGATHER, (char*)allData, size));
+  } else if (state->owner == state) {
+    NCCLCHECK(bootstrapRingAllGather(&state->ringRecvSocket, &state->ringSendSocket, rank, nranks, (char*)allData, size));
+  } else {
+    // No ring sockets: go through the connections of the owner
+    NCCLCHECK(bootstrapPeerRingAllGather(commState, NULL, rank, nranks, BOOTSTRAP_TAG_ALLGATHER, (char*)allData, size));
+  }
 
   TRACE(NCCL_INIT, "rank %d nranks %d size %d - DONE", rank, nranks, size);
   return ncclSuccess;
@@ -561,6 +1903,12 @@ ncclResult_t bootstrapIntraNodeBarrier(void* commState, int *ranks, int rank, in
   if (nranks == 1) return ncclSuccess;
   TRACE(NCCL_INIT, "rank %d nranks %d tag %x - ENTER", rank, nranks, tag);
 
+  if (bootstrapShmCovers((struct bootstrapState*)commState, ranks, nranks)) {
+    NCCLCHECK(bootstrapShmBarrier((struct bootstrapState*)commState));
+    TRACE(NCCL_INIT, "rank %d nranks %d tag %x - DONE", rank, nranks, tag);
+    return ncclSuccess;
+  }
+
   /* Simple [intra] process barrier
    *
    * Based on the dissemination algorithm by Debra Hensgen, Raphael Finkel, and Udi Manbet,
@@ -586,16 +1934,13 @@ ncclResult_t bootstrapIntraNodeAllGather(void* commState, int *ranks, int rank,
   if (nranks == 1) return ncclSuccess;
   TRACE(NCCL_INIT, "rank %d nranks %d size %d - ENTER", rank, nranks, size);
 
-  int prevRank = ranks[(rank - 1 + nranks)%nranks];
-  int nextRank = ranks[(rank + 1) % nranks];
-  struct ncclSocket prevSocket, nextSocket;
-  NCCLCHECK(bootstrapConnect(commState, nextRank, 0, &nextSocket));
-  NCCLCHECK(bootstrapAccept(commState, prevRank, 0, &prevSocket));
-
-  NCCLCHECK(bootstrapRingAllGather(&prevSocket, &nextSocket, rank, nranks, (char*)allData, size));
+  if (bootstrapShmCovers((struct bootstrapState*)commState, ranks, nranks)) {
+    NCCLCHECK(bootstrapShmAllGather((struct bootstrapState*)commState, rank, nranks, (char*)allData, size));
+    TRACE(NCCL_INIT, "rank %d nranks %d size %d - DONE", rank, nranks, size);
+    return ncclSuccess;
+  }
 
-  NCCLCHECK(ncclSocketClose(&nextSocket));
-  NCCLCHECK(ncclSocketClose(&prevSocket));
+  NCCLCHECK(bootstrapPeerRingAllGather(commState, ranks, rank, nranks, BOOTSTRAP_TAG_INTRANODE_ALLGATHER, (char*)allData, size));
 
   TRACE(NCCL_INIT, "rank %d nranks %d size %d - DONE", rank, nranks, size);
   return ncclSuccess;
@@ -606,7 +1951,9 @@ ncclResult_t bootstrapIntraNodeBroadcast(void* commState, int *ranks, int rank,
   if (nranks == 1) return ncclSuccess;
   TRACE(NCCL_INIT, "rank %d nranks %d root %d size %d - ENTER", rank, nranks, root, size);
 
-  if (rank == root) {
+  if (bootstrapShmCovers((struct bootstrapState*)commState, ranks, nranks)) {
+    NCCLCHECK(bootstrapShmBroadcast((struct bootstrapState*)commState, rank, root, (char*)bcastData, size));
+  } else if (rank == root) {
     for (int i=0; i<nranks; i++) {
       if (i != root) NCCLCHECK(bootstrapSend(commState, ranks ? ranks[i] : i, /*tag=*/ranks ? ranks[i] : i, bcastData, size));
     }
@@ -623,35 +1970,92 @@ ncclResult_t bootstrapBroadcast(void* commState, int rank, int nranks, int root,
   return bootstrapIntraNodeBroadcast(commState, NULL, rank, nranks, root, bcastData, size);
 }
 
-ncclResult_t bootstrapClose(void* commState) {
-  struct bootstrapState* state = (struct bootstrapState*)commState;
-  if (state->unexpectedConnections != NULL) {
-    unexpectedFree(state);
-    if (__atomic_load_n(state->abortFlag, __ATOMIC_ACQUIRE) == 0) {
-      WARN("Unexpected connections are not empty");
-      return ncclInternalError;
+static void bootstrapPeersClose(struct bootstrapState* state) {
+  if (state->peers == NULL) return;
+  for (int p=0; p<state->nranks; p++) {
+    struct bootstrapPeer* peer = state->peers+p;
+    // Sockets never initialized have no file descriptor to close
+    if (peer->sendSock.state != ncclSocketStateNone) ncclSocketClose(&peer->sendSock);
+    if (peer->recvSock.state != ncclSocketStateNone) ncclSocketClose(&peer->recvSock);
+    // Only what sends and receives which gave up left behind remains
+    while (peer->sendHead) {
+      struct bootstrapSendOp* op = peer->sendHead;
+      peer->sendHead = op->next;
+      if (op->orphan) free(op);
+    }
+    if (peer->recvOp == NULL) free(peer->data);
+  }
+  free(state->peers);
+  state->peers = NULL;
+}
+
+// Drop a reference to the connections of owner, closing them with the last one. The comm of the
+// owner may be gone already, along with its abortFlag.
+static void bootstrapOwnerRelease(struct bootstrapState* owner, bool ownerComm) {
+  pthread_mutex_lock(&owner->lock);
+  int refCount = --owner->refCount;
+  if (ownerComm && refCount > 0) {
+    owner->abortFlag = NULL;
+    owner->listenSock.abortFlag = NULL;
+    owner->acceptSock.abortFlag = NULL;
+    for (int p=0; p<owner->nranks; p++) {
+      owner->peers[p].sendSock.abortFlag = NULL;
+      owner->peers[p].recvSock.abortFlag = NULL;
     }
   }
+  pthread_mutex_unlock(&owner->lock);
+  if (refCount > 0) return;
 
-  NCCLCHECK(ncclSocketClose(&state->listenSock));
-  NCCLCHECK(ncclSocketClose(&state->ringSendSocket));
-  NCCLCHECK(ncclSocketClose(&state->ringRecvSocket));
+  if (owner->unexpected.peakCount > 0) {
+    INFO(NCCL_BOOTSTRAP, "Bootstrap : rank %d had up to %d unexpected messages (%ld bytes) queued", owner->rank,
+        owner->unexpected.peakCount, owner->unexpected.peakBytes);
+  }
+  unexpectedFree(owner);
+  ncclSocketClose(&owner->listenSock);
+  if (owner->acceptSock.state != ncclSocketStateNone) ncclSocketClose(&owner->acceptSock);
+  bootstrapPeersClose(owner);
+  free(owner->peerCommAddresses);
+  pthread_mutex_destroy(&owner->lock);
+  free(owner);
+}
 
-  free(state->peerCommAddresses);
-  free(state);
+// Free what belongs to the comm itself, connections apart
+static ncclResult_t bootstrapStateFree(struct bootstrapState* state) {
+  struct bootstrapState* owner = state->owner;
+  ncclResult_t ret = bootstrapShmFree(state);
+  if (owner == state) {
+    ncclSocketClose(&state->ringSendSocket);
+    ncclSocketClose(&state->ringRecvSocket);
+  } else {
+    free(state->ownerRanks);
+    free(state->peerIds);
+    free(state);
+  }
+  if (owner) bootstrapOwnerRelease(owner, owner == state);
+  return ret;
+}
 
+ncclResult_t bootstrapClose(void* commState) {
+  struct bootstrapState* state = (struct bootstrapState*)commState;
+  struct bootstrapState* owner = state->owner;
+  int count;
+  pthread_mutex_lock(&owner->lock);
+  count = unexpectedPurge(owner, state->id);
+  pthread_mutex_unlock(&owner->lock);
+  if (count != 0 && __atomic_load_n(state->abortFlag, __ATOMIC_ACQUIRE) == 0) {
+    WARN("Unexpected messages are not empty");
+    bootstrapStateFree(state);
+    return ncclInternalError;
+  }
+  NCCLCHECK(bootstrapStateFree(state));
   return ncclSuccess;
 }
 
 ncclResult_t bootstrapAbort(void* commState) {
   struct bootstrapState* state = (struct bootstrapState*)commState;
   if (commState == NULL) return ncclSuccess;
-  NCCLCHECK(ncclSocketClose(&state->listenSock));
-  NCCLCHECK(ncclSocketClose(&state->ringSendSocket));
-  NCCLCHECK(ncclSocketClose(&state->ringRecvSocket));
-  free(state->peerCommAddresses);
   free(state->peerProxyAddresses);
   free(state->peerProxyAddressesUDS);
-  free(state);
+  bootstrapStateFree(state);
   return ncclSuccess;
 }
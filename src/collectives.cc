@@ -94,9 +94,6 @@ NCCL_API(ncclResult_t, ncclAllReduce, const void* sendbuff, void* recvbuff, size
     ncclDataType_t datatype, ncclRedOp_t op, ncclComm* comm, cudaStream_t stream);
 ncclResult_t ncclAllReduce(const void* sendbuff, void* recvbuff, size_t count,
     ncclDataType_t datatype, ncclRedOp_t op, ncclComm* comm, cudaStream_t stream) {
-  
-  INFO(NCCL_ALL,"***** ncclAllReduce (collectives.cc)");
-  
   struct NvtxParamsAllReduce {
     size_t bytes;
     ncclRedOp_t op;
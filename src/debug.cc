@@ -27,6 +27,90 @@ static bool ncclWarnSetDebugInfo = false;
 
 static __thread int tid = -1;
 
+/* Parse a comma separated list of sub-systems such as INIT,COLL
+ * or ^INIT,COLL into a mask of NCCL_INIT, NCCL_COLL, ...
+ */
+uint64_t ncclDebugParseSubsys(const char* str) {
+  int invert = 0;
+  if (str[0] == '^') { invert = 1; str++; }
+  uint64_t result = invert ? ~0ULL : 0ULL;
+  char *subsysList = strdup(str);
+  char *subsys = strtok(subsysList, ",");
+  while (subsys != NULL) {
+    uint64_t mask = 0;
+    if (strcasecmp(subsys, "INIT") == 0) {
+      mask = NCCL_INIT;
+    } else if (strcasecmp(subsys, "COLL") == 0) {
+      mask = NCCL_COLL;
+    } else if (strcasecmp(subsys, "P2P") == 0) {
+      mask = NCCL_P2P;
+    } else if (strcasecmp(subsys, "SHM") == 0) {
+      mask = NCCL_SHM;
+    } else if (strcasecmp(subsys, "NET") == 0) {
+      mask = NCCL_NET;
+    } else if (strcasecmp(subsys, "GRAPH") == 0) {
+      mask = NCCL_GRAPH;
+    } else if (strcasecmp(subsys, "TUNING") == 0) {
+      mask = NCCL_TUNING;
+    } else if (strcasecmp(subsys, "ENV") == 0) {
+      mask = NCCL_ENV;
+    } else if (strcasecmp(subsys, "ALLOC") == 0) {
+      mask = NCCL_ALLOC;
+    } else if (strcasecmp(subsys, "CALL") == 0) {
+      mask = NCCL_CALL;
+    } else if (strcasecmp(subsys, "PROXY") == 0) {
+      mask = NCCL_PROXY;
+    } else if (strcasecmp(subsys, "NVLS") == 0) {
+      mask = NCCL_NVLS;
+    } else if (strcasecmp(subsys, "BOOTSTRAP") == 0) {
+      mask = NCCL_BOOTSTRAP;
+    } else if (strcasecmp(subsys, "REG") == 0) {
+      mask = NCCL_REG;
+    } else if (strcasecmp(subsys, "PROFILE") == 0) {
+      mask = NCCL_PROFILE;
+    } else if (strcasecmp(subsys, "ALL") == 0) {
+      mask = NCCL_ALL;
+    }
+    if (mask) {
+      if (invert) result &= ~mask; else result |= mask;
+    }
+    subsys = strtok(NULL, ",");
+  }
+  free(subsysList);
+  return result;
+}
+
+/* Expand %h (hostname) and %p (pid) in a file name pattern such as NCCL_DEBUG_FILE */
+void ncclDebugExpandFilename(const char* pattern, char* filename, int maxlen) {
+  char host[1024];
+  getHostName(host, sizeof(host), '.');
+  int c = 0;
+  char *fn = filename;
+  char *end = filename+maxlen-1;
+  while (pattern[c] != '\0' && fn < end) {
+    if (pattern[c++] != '%') {
+      *fn++ = pattern[c-1];
+      continue;
+    }
+    switch (pattern[c++]) {
+      case '%': // Double %
+        *fn++ = '%';
+        break;
+      case 'h': // %h = hostname
+        fn += snprintf(fn, end-fn, "%s", host);
+        break;
+      case 'p': // %p = pid
+        fn += snprintf(fn, end-fn, "%d", getpid());
+        break;
+      default: // Echo everything we don't understand
+        *fn++ = '%';
+        if (fn < end) *fn++ = pattern[c-1];
+        break;
+    }
+  }
+  *std::min(fn, end) = '\0';
+}
+
 static void ncclDebugInit() {
   pthread_mutex_lock(&ncclDebugLock);
   if (ncclDebugLevel != -1) { pthread_mutex_unlock(&ncclDebugLock); return; }
@@ -51,54 +135,7 @@ static void ncclDebugInit() {
    * or ^INIT,COLL etc
    */
   const char* ncclDebugSubsysEnv = ncclGetEnv("NCCL_DEBUG_SUBSYS");
-  if (ncclDebugSubsysEnv != NULL) {
-    int invert = 0;
-    if (ncclDebugSubsysEnv[0] == '^') { invert = 1; ncclDebugSubsysEnv++; }
-    ncclDebugMask = invert ? ~0ULL : 0ULL;
-    char *ncclDebugSubsys = strdup(ncclDebugSubsysEnv);
-    char *subsys = strtok(ncclDebugSubsys, ",");
-    while (subsys != NULL) {
-      uint64_t mask = 0;
-      if (strcasecmp(subsys, "INIT") == 0) {
-        mask = NCCL_INIT;
-      } else if (strcasecmp(subsys, "COLL") == 0) {
-        mask = NCCL_COLL;
-      } else if (strcasecmp(subsys, "P2P") == 0) {
-        mask = NCCL_P2P;
-      } else if (strcasecmp(subsys, "SHM") == 0) {
-        mask = NCCL_SHM;
-      } else if (strcasecmp(subsys, "NET") == 0) {
-        mask = NCCL_NET;
-      } else if (strcasecmp(subsys, "GRAPH") == 0) {
-        mask = NCCL_GRAPH;
-      } else if (strcasecmp(subsys, "TUNING") == 0) {
-        mask = NCCL_TUNING;
-      } else if (strcasecmp(subsys, "ENV") == 0) {
-        mask = NCCL_ENV;
-      } else if (strcasecmp(subsys, "ALLOC") == 0) {
-        mask = NCCL_ALLOC;
-      } else if (strcasecmp(subsys, "CALL") == 0) {
-        mask = NCCL_CALL;
-      } else if (strcasecmp(subsys, "PROXY") == 0) {
-        mask = NCCL_PROXY;
-      } else if (strcasecmp(subsys, "NVLS") == 0) {
-        mask = NCCL_NVLS;
-      } else if (strcasecmp(subsys, "BOOTSTRAP") == 0) {
-        mask = NCCL_BOOTSTRAP;
-      } else if (strcasecmp(subsys, "REG") == 0) {
-        mask = NCCL_REG;
-      } else if (strcasecmp(subsys, "PROFILE") == 0) {
-        mask = NCCL_PROFILE;
-      } else if (strcasecmp(subsys, "ALL") == 0) {
-        mask = NCCL_ALL;
-      }
-      if (mask) {
-        if (invert) ncclDebugMask &= ~mask; else ncclDebugMask |= mask;
-      }
-      subsys = strtok(NULL, ",");
-    }
-    free(ncclDebugSubsys);
-  }
+  if (ncclDebugSubsysEnv != NULL) ncclDebugMask = ncclDebugParseSubsys(ncclDebugSubsysEnv);
 
   const char* ncclWarnSetDebugInfoEnv = ncclGetEnv("NCCL_WARN_ENABLE_DEBUG_INFO");
   if (ncclWarnSetDebugInfoEnv != NULL && strlen(ncclWarnSetDebugInfoEnv) > 0) {
@@ -119,31 +156,8 @@ static void ncclDebugInit() {
    */
   const char* ncclDebugFileEnv = ncclGetEnv("NCCL_DEBUG_FILE");
   if (tempNcclDebugLevel > NCCL_LOG_VERSION && ncclDebugFileEnv != NULL) {
-    int c = 0;
     char debugFn[PATH_MAX+1] = "";
-    char *dfn = debugFn;
-    while (ncclDebugFileEnv[c] != '\0' && c < PATH_MAX) {
-      if (ncclDebugFileEnv[c++] != '%') {
-        *dfn++ = ncclDebugFileEnv[c-1];
-        continue;
-      }
-      switch (ncclDebugFileEnv[c++]) {
-        case '%': // Double %
-          *dfn++ = '%';
-          break;
-        case 'h': // %h = hostname
-          dfn += snprintf(dfn, PATH_MAX, "%s", hostname);
-          break;
-        case 'p': // %p = pid
-          dfn += snprintf(dfn, PATH_MAX, "%d", pid);
-          break;
-        default: // Echo everything we don't understand
-          *dfn++ = '%';
-          *dfn++ = ncclDebugFileEnv[c-1];
-          break;
-      }
-    }
-    *dfn = '\0';
+    ncclDebugExpandFilename(ncclDebugFileEnv, debugFn, PATH_MAX+1);
     if (debugFn[0] != '\0') {
       FILE *file = fopen(debugFn, "w");
       if (file != nullptr) {
@@ -47,11 +47,9 @@ namespace {
 
 ncclResult_t ncclLaunchOneRank(void* dst, void const* src, size_t nElts, struct ncclDevRedOpFull redOp, ncclDataType_t eltType, cudaStream_t stream) {
   size_t eltSize = ncclTypeSize(eltType);
-  INFO(NCCL_ALL,"*******ncclLaunchOneRank");
 
   if (redOp.op != ncclDevPreMulSum) {
     if (dst != src) {
-      INFO(NCCL_ALL,"*******ncclCudaMemcpyAsync");
       NCCLCHECK(ncclCudaMemcpyAsync((char*)dst, (char*)src, nElts*eltSize, stream));
     }
     return ncclSuccess;
@@ -78,7 +76,6 @@ ncclResult_t ncclLaunchOneRank(void* dst, void const* src, size_t nElts, struct
   dim3 block = {512, 1, 1};
   void* args[5] = {&dst, &src, &nElts, &redOp.scalarArg, &redOp.scalarArgIsPtr};
   volatile long long int my_counter=0;
-  INFO(NCCL_ALL,"cudaLaunchKernel in ncclLaunchOneRank");
   CUDACHECK(cudaLaunchKernel(kernel, grid, block, args, 0, stream));
   return ncclSuccess;
 }
@@ -12,6 +12,7 @@
 #include "channel.h"
 #include "cudawrap.h"
 #include "transport.h"
+#include "trace.h"
 
 #include <cstring> // std::memcpy
 #include <cinttypes> // PRIx64
@@ -80,7 +81,7 @@ static ncclResult_t addProxyOpIfNeeded(struct ncclComm* comm, struct ncclKernelP
   bool needed = true;
   NCCLCHECK(ncclProxySaveOp(comm, op, &needed));
   if (needed) {
-    INFO(NCCL_ALL,"addProxyOpIfNeeded -> needed");
+    NCCL_TRACEPOINT(NCCL_PROXY, ncclTraceProxyOpNeeded, op->channelId, op->pattern, op->nsteps);
     struct ncclProxyOp* q = ncclMemoryPoolAlloc<struct ncclProxyOp>(&comm->memPool_ncclProxyOp, &comm->memPermanent);
     *q = *op; // C++ struct assignment
     ncclIntruQueueEnqueue(&comm->planner.wipPlan.channels[op->channelId].proxyOpQueue, q);
@@ -167,9 +168,6 @@ static void finishPlan(struct ncclComm* comm, struct ncclKernelPlan* plan) {
   plan->kernelArgsSize = alignUp(plan->kernelArgsSize, 16);
   plan->kernelArgs = (struct ncclDevKernelArgs*)ncclMemoryStackAlloc(&comm->memScoped, plan->kernelArgsSize, /*align=*/16);
   plan->kernelArgs->comm = comm->devComm;
-  //INFO(NCCL_ALL,"p1 %p p2 %p \n", plan->kernelArgs->comm, comm->devComm);
-
-  
   plan->kernelArgs->channelMask = plan->channelMask;
   plan->kernelArgs->workStorageType = plan->workStorageType;
 
@@ -251,7 +249,6 @@ static ncclResult_t registerIntraNodeBuffers(
     bool* regNeedConnect
   ) {
 
-  //INFO(NCCL_ALL,"registerIntraNodeBuffers");
   //in our scenario, it enters here but it does not enter in any branch 
 
   ncclResult_t result = ncclSuccess;
@@ -354,8 +351,6 @@ static ncclResult_t registerIntraNodeBuffers(
     int recvRegBufFlag = 0;
     void *sendHandle, *recvHandle;
 
-    INFO(NCCL_ALL,"registerIntraNodeBuffers -> second elseif true");
-
     if (ncclParamLocalRegister()) {
       ncclCollnetLocalRegisterBuffer(comm, info->sendbuff, sendbuffSize, collNetSend, &sendRegBufFlag, &sendHandle);
       info->sendMhandle = sendHandle;
@@ -378,7 +373,7 @@ static ncclResult_t registerIntraNodeBuffers(
       info->nMaxChannels = std::max(comm->config.minCTAs, std::min(comm->config.maxCTAs, 1));
       info->regBufType = NCCL_COLLNET_REG_BUFFER;
       if (sendRegBufFlag == 1 && recvRegBufFlag == 1) {
-        INFO(NCCL_ALL, "rank %d successfully registered collNet sendbuff %p (handle %p), sendbuff size %ld, recvbuff %p (handle %p), recvbuff size %ld", comm->rank, info->sendbuff, sendHandle, sendbuffSize, info->recvbuff, recvHandle, recvbuffSize);
+        INFO(NCCL_REG, "rank %d successfully registered collNet sendbuff %p (handle %p), sendbuff size %ld, recvbuff %p (handle %p), recvbuff size %ld", comm->rank, info->sendbuff, sendHandle, sendbuffSize, info->recvbuff, recvHandle, recvbuffSize);
       }
     }
   }
@@ -770,7 +765,7 @@ static ncclResult_t scheduleCollTasksToPlan(
     plan->channelMask |= (2ull<<devWork->channelHi) - (1ull<<devWork->channelLo);
     plan->threadPerBlock = std::max(plan->threadPerBlock, task->nWarps*WARP_SIZE);
     if (!plan->kernelSpecialized) {
-      INFO(NCCL_ALL,"****scheduleCollTasksToPlan -> set kernelFn"); 
+      NCCL_TRACEPOINT(NCCL_COLL, ncclTraceSetKernelFn, task->devFuncId, 0, 0);
       plan->kernelFn = ncclDevKernelForFunc[task->devFuncId];
       plan->kernelSpecialized = ncclDevKernelForFuncIsSpecialized[task->devFuncId];
     }
@@ -1010,7 +1005,7 @@ static ncclResult_t scheduleP2pTasksToPlan(
 
   plan->threadPerBlock = std::max(plan->threadPerBlock, NCCL_MAX_NTHREADS);
   if (!plan->kernelSpecialized) {
-    INFO(NCCL_ALL,"****scheduleP2pTasksToPlan -> kernelFn ");  //not reached in our scenario
+    NCCL_TRACEPOINT(NCCL_COLL, ncclTraceSetKernelFn, ncclDevFuncId_P2p(), 1, 0);
     plan->kernelFn = ncclDevKernelForFunc[ncclDevFuncId_P2p()];
     plan->kernelSpecialized = ncclDevKernelForFuncIsSpecialized[ncclDevFuncId_P2p()];
   }
@@ -1282,7 +1277,7 @@ static void persistentDestructor(void* plans_) {
 }
 
 ncclResult_t ncclLaunchPrepare(struct ncclComm* comm) {
-  INFO(NCCL_ALL,"ncclLaunchPrepare");
+  NCCL_TRACEPOINT(NCCL_COLL, ncclTraceLaunchPrepare, comm->planner.nTasksColl, comm->planner.nTasksP2p, 0);
   ncclResult_t result = ncclSuccess;
   struct ncclKernelPlanner* planner = &comm->planner;
   bool persistent = ncclCudaGraphValid(planner->capturingGraph);
@@ -1466,19 +1461,18 @@ ncclResult_t ncclLaunchKernel(struct ncclComm* comm, struct ncclKernelPlan* plan
     launchConfig.hStream = launchStream;
 
 
-    //INFO(NCCL_ALL,"cudaLaunchKernelExC");
     //STEFANO
     // Parameters config : Launch configuration, func : Kernel to launch
     // args : Array of pointers to kernel parameters
     // see https://docs.nvidia.com/cuda/cuda-runtime-api/group__CUDART__EXECUTION.html#group__CUDART__EXECUTION_1g5064cdf5d8e6741ace56fd8be951783c
     //CUDACHECK(cudaLaunchKernelExC(&launchConfig, fnAddr, args));
 
-    INFO(NCCL_ALL,"cudaLaunchKernelEx");
+    NCCL_TRACEPOINT(NCCL_COLL, ncclTraceLaunchKernel, grid.x, block.x, 1);
     CUCHECK(cuLaunchKernelEx(&launchConfig, fn, nullptr, extra));
     return ncclSuccess;
   }
   #endif
-  INFO(NCCL_ALL,"Standard kernel launch");
+  NCCL_TRACEPOINT(NCCL_COLL, ncclTraceLaunchKernel, grid.x, block.x, 0);
   // Standard kernel launch
   CUCHECK(cuLaunchKernel(fn, grid.x, grid.y, grid.z, block.x, block.y, block.z, smem, launchStream, nullptr, extra));
   //CUDACHECK(cudaLaunchKernel(fnAddr, grid, block, args, smem, launchStream));
@@ -1968,12 +1962,10 @@ static ncclResult_t hostToDevRedOp(
 // single rank communicators, collectives are issued as `ncclMemcpyAsync`s and
 // thus don't need a task.
 static ncclResult_t taskAppend(struct ncclComm* comm, struct ncclInfo* info) {
-  INFO(NCCL_ALL,"************ taskAppend");
-
+  NCCL_TRACEPOINT(NCCL_COLL, ncclTraceTaskAppend, info->coll, info->count, info->root);
   struct ncclKernelPlanner *planner = &comm->planner;
 
   if (info->coll == ncclFuncSend || info->coll == ncclFuncRecv) {
-    INFO(NCCL_ALL,"*************** if branch");
     int peer = info->root;
     ssize_t nBytes = info->count*ncclTypeSize(info->datatype);
     bool isSendNotRecv = info->coll == ncclFuncSend;
@@ -2015,8 +2007,6 @@ static ncclResult_t taskAppend(struct ncclComm* comm, struct ncclInfo* info) {
       }
     }
   } else {
-    //INFO(NCCL_ALL,"*******else branch");
-
     // Empty collectives can be discarded.
     if (info->count == 0) return ncclSuccess;
 
@@ -2029,8 +2019,6 @@ static ncclResult_t taskAppend(struct ncclComm* comm, struct ncclInfo* info) {
       NCCLCHECK(ncclLaunchOneRank(info->recvbuff, info->sendbuff, info->count, opDev, info->datatype, info->stream));
       return ncclSuccess;
     } else {
-      INFO(NCCL_ALL,"*************** else else branch, comm->nRanks %d", comm->nRanks);
-      
       // Must be in thread local group before tasks can be alloc'd in `comm->memScoped`.
       ncclGroupCommJoin(info->comm);
       struct ncclTaskColl* t = ncclMemoryStackAlloc<struct ncclTaskColl>(&comm->memScoped);
@@ -2085,7 +2073,7 @@ static ncclResult_t taskAppend(struct ncclComm* comm, struct ncclInfo* info) {
 }
 
 ncclResult_t ncclEnqueueCheck(struct ncclInfo* info) {
-  INFO(NCCL_ALL,"********* ncclEnqueueCheck (enqueue.cc)");
+  NCCL_TRACEPOINT(NCCL_COLL, ncclTraceEnqueueCheck, info->coll, info->count, info->datatype);
   NCCLCHECK(ncclGroupStartInternal());
   ncclResult_t ret = ncclSuccess;
   int devOld = -1;
@@ -2100,7 +2088,7 @@ ncclResult_t ncclEnqueueCheck(struct ncclInfo* info) {
   }
   NCCLCHECKGOTO(ArgsCheck(info), ret, fail);
 
-  INFO(NCCL_ALL,"%s: opCount %lx sendbuff %p recvbuff %p count %zu datatype %d op %d root %d comm %p [nranks=%d] stream %p",
+  INFO(NCCL_COLL,"%s: opCount %lx sendbuff %p recvbuff %p count %zu datatype %d op %d root %d comm %p [nranks=%d] stream %p",
         info->opName, info->comm->opCount, info->sendbuff, info->recvbuff, info->count,
         info->datatype, info->op, info->root, info->comm, info->comm->nRanks, info->stream);
   TRACE_CALL("nccl%s(%" PRIx64 ",%" PRIx64 ",%zu,%d,%d,%d,%p,%p)", info->opName, reinterpret_cast<int64_t>(info->sendbuff), reinterpret_cast<int64_t>(info->recvbuff), info->count, info->datatype, info->op, info->root, info->comm, info->stream);
@@ -11,6 +11,7 @@
 #include "channel.h"
 #include <assert.h>
 #include "bootstrap.h"
+#include "trace.h"
 
 __thread int ncclGroupDepth = 0; // depth of ncclGroupStart nesting
 __thread ncclResult_t ncclGroupError = ncclSuccess;
@@ -126,9 +127,7 @@ ncclResult_t ncclP2PPreconnectFunc(struct ncclAsyncJob* job_) {
   CUDACHECK(cudaSetDevice(comm->cudaDev));
   if (CPU_COUNT(&comm->cpuAffinity)) sched_setaffinity(0, sizeof(cpu_set_t), &comm->cpuAffinity);
 
-  INFO(NCCL_ALL,"ncclP2PPreconnectFunc calls ncclTransportP2pSetup ");
   NCCLCHECK(ncclTransportP2pSetup(comm, NULL, 1));
-  INFO(NCCL_ALL,"ncclTransportP2pSetup ----------------DONE (ncclP2PPreconnectFunc)------------------------>");
   return ncclSuccess;
 }
 
@@ -143,7 +142,6 @@ ncclResult_t ncclCollPreconnectFunc(struct ncclAsyncJob* job_) {
     if (job->algoNeedConnect[i]) {
       switch (i) {
         case NCCL_ALGO_RING: {
-          INFO(NCCL_ALL,"ncclCollPreconnectFunc BEFORE ncclTransportRingConnect");
           NCCLCHECKGOTO(ncclTransportRingConnect(comm), ret, fail);
           break;
         }
@@ -232,7 +230,7 @@ static ncclResult_t doLaunches(struct ncclComm* head) {
             comm->planner.unlaunchedPlansHead = plan->next;
             CUDACHECKGOTO(cudaSetDevice(comm->cudaDev), result, failure);
             NCCLCHECKGOTO(ncclLaunchKernelBefore_NoUncapturedCuda(comm, plan), result, failure);
-            INFO(NCCL_ALL,"doLaunches -> ncclLaunchKernel");
+            NCCL_TRACEPOINT(NCCL_COLL, ncclTraceDoLaunches, comm->rank, plan->channelMask, 0);
             NCCLCHECKGOTO(ncclLaunchKernel(comm, plan), result, failure);
           }
           // Barrier reduction input indicates if we require further rounds.
@@ -452,12 +450,10 @@ static ncclResult_t groupLaunch(struct ncclAsyncJob *job_, ncclSimInfo_t* simInf
       comm = comm->groupNext;
     } while (comm);
 
-    INFO(NCCL_ALL,"groupLaunch -> asyncJobLaunch 2");
     NCCLCHECKGOTO(asyncJobLaunch(asyncJobsMain, groupAbortFlag), ret, fail);
   }
 
   if ((!simInfo) && (groupCommHeadMain != nullptr)) {
-    INFO(NCCL_ALL,"groupLaunch -> doLaunches");
     NCCLCHECKGOTO(doLaunches(groupCommHeadMain), ret, fail);
   }
 
@@ -551,7 +547,7 @@ ncclResult_t ncclGroupEndInternal(ncclSimInfo_t* simInfo) {
       ret = ncclInProgress;
     } else {
       /* blocking group */
-      INFO(NCCL_ALL,"ncclGroupEndInternal -> groupLaunch ");
+      NCCL_TRACEPOINT(NCCL_COLL, ncclTraceGroupLaunch, ncclGroupBlocking, 0, 0);
       NCCLCHECKGOTO(groupLaunch(&ncclGroupJobMainPtr->base, internalSimInfoPtr), ret, fail);
       if (simInfo) memcpy((void*)simInfo, (void*)internalSimInfoPtr, realSize);
       groupResetJobState(ncclGroupJobMainPtr);
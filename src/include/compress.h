@@ -0,0 +1,42 @@
+/*************************************************************************
+ * Copyright (c) 2024, NVIDIA CORPORATION. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#ifndef NCCL_COMPRESS_H_
+#define NCCL_COMPRESS_H_
+
+#include "nccl.h"
+#include <stdint.h>
+#include <stddef.h>
+
+// Lossless compression of network payloads. Data is cut into chunks, each one byte-shuffled
+// (byte i of every element grouped together, which lines up the exponents of floating point
+// values) then compressed with an LZ4-style codec. Chunks which do not compress well enough are
+// stored raw, so the output is at most a chunk header per chunk larger than the input.
+#define NCCL_COMPRESS_CHUNK_SIZE (64*1024)
+
+#define NCCL_COMPRESS_CODEC_RAW 0
+#define NCCL_COMPRESS_CODEC_LZ 1
+
+// Written in front of each chunk
+struct ncclCompressChunk {
+  uint32_t size;     // bytes once decompressed
+  uint32_t wireSize; // bytes following this header
+  uint8_t codec;
+  uint8_t elemSize;  // byte-shuffle width, 1 for none
+  uint16_t pad;
+};
+
+static inline size_t ncclCompressBound(size_t size) {
+  return size + (size/NCCL_COMPRESS_CHUNK_SIZE+1)*sizeof(struct ncclCompressChunk);
+}
+
+// Compress size bytes from src into dst, which must hold ncclCompressBound(size) bytes
+ncclResult_t ncclCompress(const void* src, int size, int elemSize, void* dst, int* dstSize);
+// Decompress a chunk whose wireSize bytes are at src into c->size bytes at dst. Fails with
+// ncclRemoteError on malformed input.
+ncclResult_t ncclDecompressChunk(const struct ncclCompressChunk* c, const void* src, void* dst);
+
+#endif
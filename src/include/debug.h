@@ -22,6 +22,10 @@ extern FILE *ncclDebugFile;
 void ncclDebugLog(ncclDebugLogLevel level, unsigned long flags, const char *filefunc, int line, const char *fmt, ...) __attribute__ ((format (printf, 5, 6)));
 
 extern char * getAddressOfStaticHostname(void);
+// Parse a NCCL_DEBUG_SUBSYS-like list (e.g. INIT,COLL or ^INIT) into a mask of sub-systems
+uint64_t ncclDebugParseSubsys(const char* str);
+// Expand %h and %p in a file name pattern, like NCCL_DEBUG_FILE
+void ncclDebugExpandFilename(const char* pattern, char* filename, int maxlen);
 
 // Let code temporarily downgrade WARN into INFO
 extern thread_local int ncclDebugNoWarn;
@@ -0,0 +1,58 @@
+/*************************************************************************
+ * Copyright (c) 2024, NVIDIA CORPORATION. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#ifndef NCCL_IOURING_H_
+#define NCCL_IOURING_H_
+
+#include "nccl.h"
+#include <stdint.h>
+#include <linux/io_uring.h>
+
+// Minimal io_uring wrapper built directly on the kernel ABI, so that we do not
+// depend on liburing being installed. Only one thread may use a given ring.
+struct ncclIoUring {
+  int fd;
+  unsigned features;
+  // Submission queue
+  unsigned* sqHead;
+  unsigned* sqTail;
+  unsigned* sqMask;
+  unsigned* sqArray;
+  unsigned sqEntries;
+  unsigned sqLocalTail; // SQEs prepared but not yet published to the kernel
+  unsigned sqPending;   // SQEs published but not yet submitted with io_uring_enter
+  struct io_uring_sqe* sqes;
+  // Completion queue
+  unsigned* cqHead;
+  unsigned* cqTail;
+  unsigned* cqMask;
+  struct io_uring_cqe* cqes;
+  // Mappings
+  void* sqRing;
+  size_t sqRingSize;
+  void* cqRing;
+  size_t cqRingSize;
+  size_t sqesSize;
+  int nBuffers; // Size of the (sparse) registered buffer table, 0 if unsupported
+};
+
+// Returns ncclSystemError (without warning) if io_uring is not available on this system.
+ncclResult_t ncclIoUringInit(struct ncclIoUring* ring, unsigned entries);
+ncclResult_t ncclIoUringClose(struct ncclIoUring* ring);
+// Register file descriptors to be used with IOSQE_FIXED_FILE.
+ncclResult_t ncclIoUringRegisterFiles(struct ncclIoUring* ring, int* fds, int nfds);
+// Create a sparse table of nBuffers registered buffers, filled with ncclIoUringUpdateBuffer.
+ncclResult_t ncclIoUringRegisterBufferTable(struct ncclIoUring* ring, int nBuffers);
+ncclResult_t ncclIoUringUpdateBuffer(struct ncclIoUring* ring, int index, void* data, size_t size);
+// Get a free SQE; returns NULL if the submission queue is full.
+struct io_uring_sqe* ncclIoUringGetSqe(struct ncclIoUring* ring);
+// Submit all prepared SQEs with a single system call.
+ncclResult_t ncclIoUringSubmit(struct ncclIoUring* ring);
+// Get the next completion without blocking; returns NULL if there is none.
+struct io_uring_cqe* ncclIoUringPeekCqe(struct ncclIoUring* ring);
+void ncclIoUringCqeSeen(struct ncclIoUring* ring);
+
+#endif
@@ -0,0 +1,49 @@
+/*************************************************************************
+ * Copyright (c) 2024, NVIDIA CORPORATION. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#ifndef NCCL_NET_SOCKET_H_
+#define NCCL_NET_SOCKET_H_
+
+#include "nccl.h"
+#include <stdint.h>
+
+#define NCCL_NET_SOCKET_MAX_SOCKETS 64
+#define NCCL_NET_SOCKET_MAX_THREADS 16
+
+// Statistics of a comm of the socket transport, collected when NCCL_SOCKET_STATS is set.
+// Latency bucket i counts the requests which completed in [2^i, 2^(i+1)) us after being
+// posted, the first bucket also counting faster ones and the last one slower ones.
+#define NCCL_NET_SOCKET_LATENCY_BUCKETS 24
+
+struct ncclNetSocketSockStats {
+  uint64_t bytes;   // payload and headers moved
+  uint64_t chunks;  // tasks completed (data sockets only)
+  uint64_t calls;   // send/receive attempts
+  uint64_t eagain;  // attempts which moved nothing
+  uint64_t partial; // attempts which moved some, but not all, of what was asked
+};
+
+// Time spent by a helper thread progressing tasks, polling without finding anything to do, and
+// blocked waiting for socket events or new tasks
+struct ncclNetSocketThreadStats {
+  uint64_t busyNs;
+  uint64_t idleNs;
+  uint64_t blockedNs;
+};
+
+struct ncclNetSocketStats {
+  int nSocks;
+  int nThreads;
+  // Data sockets, then the control socket and the latency lane
+  struct ncclNetSocketSockStats socks[NCCL_NET_SOCKET_MAX_SOCKETS+2];
+  struct ncclNetSocketThreadStats threads[NCCL_NET_SOCKET_MAX_THREADS];
+  // Legacy protocol: time requests waited for the size of their message to be exchanged
+  uint64_t sizeWaitNs;
+  uint64_t nSizeWaits;
+  uint64_t latency[2][NCCL_NET_SOCKET_LATENCY_BUCKETS]; // sends, receives
+};
+
+#endif
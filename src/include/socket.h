@@ -64,6 +64,7 @@ struct ncclSocket {
   int salen;
   uint64_t magic;
   enum ncclSocketType type;
+  int wouldBlock; // the last non-blocking transfer stopped because the kernel returned EAGAIN
 };
 
 const char *ncclSocketToString(union ncclSocketAddress *addr, char *buf, const int numericHostForm = 1);
@@ -89,10 +90,22 @@ ncclResult_t ncclSocketSetFd(int fd, struct ncclSocket* sock);
 #define NCCL_SOCKET_RECV 1
 
 ncclResult_t ncclSocketProgress(int op, struct ncclSocket* sock, void* ptr, int size, int* offset);
+#define NCCL_SOCKET_MAX_IOV 16
+// If closed is not NULL, a connection closed by the peer is reported there instead of as an error
+ncclResult_t ncclSocketProgressIov(int op, struct ncclSocket* sock, const struct iovec* iov, int iovcnt, int* offset, int* closed = NULL);
 ncclResult_t ncclSocketWait(int op, struct ncclSocket* sock, void* ptr, int size, int* offset);
 ncclResult_t ncclSocketSend(struct ncclSocket* sock, void* ptr, int size);
 ncclResult_t ncclSocketRecv(struct ncclSocket* sock, void* ptr, int size);
 ncclResult_t ncclSocketSendRecv(struct ncclSocket* sendSock, void* sendPtr, int sendSize, struct ncclSocket* recvSock, void* recvPtr, int recvSize);
 ncclResult_t ncclSocketTryRecv(struct ncclSocket* sock, void* ptr, int size, int* closed, bool blocking);
+// Called by blocking loops after an attempt which made no progress. Spins for a while, then sleeps
+// until one of the sockets is ready for its op (a socket being accepted waits for a connection),
+// waking up regularly for the caller to check abortFlag. *idleStart is the start of the idle
+// period, to reset to 0 whenever progress is made.
+ncclResult_t ncclSocketWaitIdle(int nSocks, struct ncclSocket** socks, const int* ops, uint64_t* idleStart);
+// MSG_ZEROCOPY support
+ncclResult_t ncclSocketEnableZeroCopy(struct ncclSocket* sock, int* enabled);
+ncclResult_t ncclSocketSendZeroCopy(struct ncclSocket* sock, void* ptr, int size, int* offset, uint32_t* nCalls);
+ncclResult_t ncclSocketZeroCopyPoll(struct ncclSocket* sock, uint32_t* completed, int* copied);
 ncclResult_t ncclSocketClose(struct ncclSocket* sock);
 #endif
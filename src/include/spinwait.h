@@ -0,0 +1,45 @@
+/*************************************************************************
+ * Copyright (c) 2024, NVIDIA CORPORATION. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#ifndef NCCL_SPINWAIT_H_
+#define NCCL_SPINWAIT_H_
+
+#include <stdint.h>
+
+// Adaptive wait policy for progress threads (proxy, socket helpers) which find nothing to do.
+// A thread first spins, polling for work, for up to a window of NCCL_SPIN_WAIT_NS, then parks
+// in whatever blocking call it has (epoll_wait, a condition variable), where the kernel may
+// busy-poll first. The window adapts to the idle periods seen: it shrinks each time it expires
+// and grows when work shows up shortly after parking, so that threads sharing their core with
+// other work only keep spinning while it pays off.
+enum ncclSpinWaitStage {
+  ncclSpinWaitSpin = 0,
+  ncclSpinWaitPark = 1
+};
+
+struct ncclSpinWait {
+  uint64_t maxWindow;  // NCCL_SPIN_WAIT_NS
+  uint64_t window;     // current spin window, in ns
+  uint64_t idleStart;  // start of the current idle period, 0 while busy
+  uint64_t parkStart;
+  enum ncclSpinWaitStage stage;
+  // Counters, reported by ncclSpinWaitReport
+  uint64_t idleNs;     // time spent idle, spinning or parked
+  uint64_t spinNs;     // time spent spinning
+  uint64_t nIdle;      // idle periods
+  uint64_t nSpinWakes; // idle periods which ended while spinning
+  uint64_t nParks;     // idle periods which ended parked
+};
+
+void ncclSpinWaitInit(struct ncclSpinWait* w);
+// The thread made progress: end the idle period, if any, and adapt the window.
+void ncclSpinWaitBusy(struct ncclSpinWait* w);
+// The thread found nothing to do: return whether it should keep spinning or park.
+enum ncclSpinWaitStage ncclSpinWaitIdle(struct ncclSpinWait* w);
+// Print the counters of a thread which is exiting
+void ncclSpinWaitReport(struct ncclSpinWait* w, uint64_t flags, const char* name);
+
+#endif
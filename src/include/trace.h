@@ -0,0 +1,70 @@
+/*************************************************************************
+ * Copyright (c) 2024, NVIDIA CORPORATION. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#ifndef NCCL_TRACE_H_
+#define NCCL_TRACE_H_
+
+#include "nccl.h"
+#include "nccl_common.h"
+#include <stdint.h>
+
+// Trace points are cheap binary events for hot paths, where INFO would take the debug lock
+// and format a string. They are compiled in with TRACEPOINTS=1 and enabled at runtime with
+// NCCL_TRACEPOINTS, a list of sub-systems using the NCCL_DEBUG_SUBSYS syntax (e.g. NET,PROXY).
+// Each thread records into its own ring, keeping the last NCCL_TRACEPOINTS_EVENTS events,
+// and all rings are written to NCCL_TRACEPOINTS_FILE (%h and %p are expanded) at exit.
+//
+// File format (native endianness): "NCCLTRC1", uint32_t number of trace points followed by
+// their NUL-terminated names, then for each thread: int32_t tid, uint32_t number of events
+// and that many struct ncclTraceEvent, oldest first.
+enum ncclTracePoint {
+  // transport/net.cc
+  ncclTraceSendProxyProgress,
+  ncclTraceSendPosted,
+  ncclTraceSendTest,
+  ncclTraceSendRegComplete,
+  ncclTraceSendDone,
+  ncclTraceRecvProxyProgress,
+  ncclTraceRecvPosted,
+  // transport/net_socket.cc
+  ncclTraceSocketGetTask,
+  ncclTraceSocketTaskDone,
+  // enqueue.cc, group.cc
+  ncclTraceEnqueueCheck,
+  ncclTraceTaskAppend,
+  ncclTraceProxyOpNeeded,
+  ncclTraceSetKernelFn,
+  ncclTraceLaunchPrepare,
+  ncclTraceLaunchKernel,
+  ncclTraceGroupLaunch,
+  ncclTraceDoLaunches,
+  // proxy.cc
+  ncclTraceProxyStart,
+  ncclTraceProxyProgressAsync,
+  ncclTraceNumPoints
+};
+
+struct ncclTraceEvent {
+  uint64_t time; // CLOCK_MONOTONIC, in ns
+  uint32_t point;
+  uint32_t pad;
+  uint64_t args[3];
+};
+
+extern uint64_t ncclTraceMask;
+void ncclTraceInit();
+void ncclTraceRecord(enum ncclTracePoint point, uint64_t arg0, uint64_t arg1, uint64_t arg2);
+
+#ifdef ENABLE_TRACEPOINTS
+#define NCCL_TRACEPOINT(FLAGS, POINT, A0, A1, A2) do { \
+  if (__builtin_expect((FLAGS) & __atomic_load_n(&ncclTraceMask, __ATOMIC_RELAXED), 0)) \
+    ncclTraceRecord((POINT), (uint64_t)(A0), (uint64_t)(A1), (uint64_t)(A2)); \
+} while (0)
+#else
+#define NCCL_TRACEPOINT(...)
+#endif
+
+#endif
@@ -0,0 +1,49 @@
+/*************************************************************************
+ * Copyright (c) 2024, NVIDIA CORPORATION. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#ifndef NCCL_XDP_H_
+#define NCCL_XDP_H_
+
+#include "nccl.h"
+#include "socket.h"
+#include <stdint.h>
+#include <sys/uio.h>
+
+// AF_XDP data path, built directly on the kernel ABI so that we do not depend on libbpf/libxdp.
+// Each process opens one AF_XDP socket per interface, bound to queue NCCL_SOCKET_XDP_QUEUE, and
+// attaches a small XDP program, in native mode if the driver supports it or in generic (skb)
+// mode otherwise, which redirects the UDP/IPv4 packets sent to our port to the socket and passes
+// everything else to the kernel. Traffic for that port must therefore arrive on that queue, and
+// only one process per interface can use it.
+//
+// Connections are reliable, in-order byte streams over UDP: go-back-N retransmission driven by
+// cumulative acknowledgements, which also carry the room left in the receive buffer. Frames sent
+// are kept in the UMEM until acknowledged. All calls are thread-safe.
+struct ncclXdpDev;
+struct ncclXdpConn;
+
+// Address of a connection, exchanged by the two ends when connecting
+struct ncclXdpAddr {
+  uint8_t mac[6];
+  uint16_t port; // network byte order
+  uint32_t ip;   // network byte order
+  uint32_t conn;
+  int valid;
+};
+
+// Returns ncclSystemError (without warning) if AF_XDP cannot be used on this interface.
+ncclResult_t ncclXdpOpen(const char* ifName, union ncclSocketAddress* addr, int genericOnly, struct ncclXdpDev** dev);
+ncclResult_t ncclXdpConnCreate(struct ncclXdpDev* dev, struct ncclXdpConn** conn, struct ncclXdpAddr* local);
+ncclResult_t ncclXdpConnConnect(struct ncclXdpConn* conn, struct ncclXdpAddr* remote);
+// Same semantics as ncclSocketProgressIov: send or receive what can be without blocking
+ncclResult_t ncclXdpConnProgressIov(struct ncclXdpConn* conn, int op, const struct iovec* iov, int iovcnt, int* offset);
+// Number of bytes sent so far on conn
+uint64_t ncclXdpConnSent(struct ncclXdpConn* conn);
+// Set *done once the first end bytes sent on conn have been acknowledged
+ncclResult_t ncclXdpConnAcked(struct ncclXdpConn* conn, uint64_t end, int* done);
+ncclResult_t ncclXdpConnClose(struct ncclXdpConn* conn);
+
+#endif
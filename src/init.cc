@@ -12,6 +12,7 @@
 #include "transport.h"
 #include "group.h"
 #include "net.h"
+#include "trace.h"
 #include "coll_net.h"
 #include "enqueue.h"
 #include "graph.h"
@@ -77,6 +78,7 @@ static pthread_once_t initOnceControl = PTHREAD_ONCE_INIT;
 
 static void initOnceFunc() {
   initEnv();
+  ncclTraceInit();
   initGdrCopy();
   // Always initialize bootstrap network
   NCCLCHECKGOTO(bootstrapNetInit(), initResult, exit);
@@ -350,7 +352,7 @@ static ncclResult_t commAlloc(struct ncclComm* comm, struct ncclComm* parent, in
 
   comm->compCap = ncclCudaCompCap();
   TRACE(NCCL_INIT,"comm %p rank %d nranks %d cudaDev %d busId %lx compCap %d", comm, rank, ndev, comm->cudaDev, comm->busId, comm->compCap);
-  INFO(NCCL_ALL,"commAlloc: comm %p rank %d nranks %d cudaDev %d busId %lx compCap %d", comm, rank, ndev, comm->cudaDev, comm->busId, comm->compCap);
+  TRACE(NCCL_INIT,"commAlloc: comm %p rank %d nranks %d cudaDev %d busId %lx compCap %d", comm, rank, ndev, comm->cudaDev, comm->busId, comm->compCap);
 
   comm->checkPointers = ncclParamCheckPointers() == 1 ? true : false;
   comm->dmaBufSupport = (dmaBufSupported(comm) == ncclSuccess) ? true : false;
@@ -402,7 +404,6 @@ static ncclResult_t commAlloc(struct ncclComm* comm, struct ncclComm* parent, in
 
 //called once in our scenario
 static ncclResult_t devCommSetup(ncclComm_t comm) {
-  INFO(NCCL_ALL,"devCommSetup"); 
   ncclResult_t ret = ncclSuccess;
   int nRanks = comm->nRanks;
   struct ncclDevCommAndChannels tmpCommAndChans;
@@ -547,7 +548,7 @@ static ncclResult_t fillInfo(struct ncclComm* comm, struct ncclPeerInfo* info, u
 
 static ncclResult_t setupChannel(struct ncclComm* comm, int channelId, int rank, int nranks, int* ringRanks) {
   TRACE(NCCL_INIT, "rank %d nranks %d", rank, nranks);
-  INFO(NCCL_ALL, "setupChannel : rank %d nranks %d channelId %d", rank, nranks, channelId);
+  TRACE(NCCL_INIT, "setupChannel : rank %d nranks %d channelId %d", rank, nranks, channelId);
   NCCLCHECK(initChannel(comm, channelId));
 
   struct ncclRing* ring = &comm->channels[channelId].ring;
@@ -584,7 +585,7 @@ static ncclResult_t computeBuffSizes(struct ncclComm* comm) {
 
   for (int p=0; p<NCCL_NUM_PROTOCOLS; p++) {
     comm->buffSizes[p] = envs[p] != -2 ? envs[p] : defaults[p];
-    INFO(NCCL_ALL,"in computeBuffSizes : DEFAULT BUF SIZE %d for protocol : %d",comm->buffSizes[p], p);
+    TRACE(NCCL_INIT, "computeBuffSizes : buffer size %d for protocol %d", comm->buffSizes[p], p);
   }
 
   if (comm->nNodes > 1) comm->p2pChunkSize = ncclParamP2pNetChunkSize();
@@ -1105,11 +1106,9 @@ static ncclResult_t initTransportsRank(struct ncclComm* comm, struct ncclComm* p
 
   // Launch proxy service thread, after this, the proxy calls can be used.
   if (parent && parent->config.splitShare) {
-    INFO(NCCL_ALL, "initTransportsRank (launch proxy service thread) -> if branch");
     comm->proxyState = parent->sharedRes->proxyState;
     ncclAtomicRefCountIncrement(&parent->sharedRes->proxyState->refCount);
   } else {
-    INFO(NCCL_ALL, "initTransportsRank (launch proxy service thread) -> ncclProxyCreate ");
     NCCLCHECKGOTO(ncclProxyCreate(comm), ret, fail);
   }
   
@@ -1172,7 +1171,6 @@ static ncclResult_t initTransportsRank(struct ncclComm* comm, struct ncclComm* p
 
   comm->runtimeConn = comm->cuMemSupport && ncclParamRuntimeConnect();
   if (comm->runtimeConn) {
-    INFO(NCCL_ALL,"initTransportsRank if (comm->runtimeConn)");
     for (int c=0; c<comm->nChannels; c++) {
       NCCLCHECKGOTO(setupChannel(comm, c, rank, nranks, rings+c*nranks), ret, fail);
     }
@@ -1182,16 +1180,12 @@ static ncclResult_t initTransportsRank(struct ncclComm* comm, struct ncclComm* p
     if (comm->collNetSupport > 0) ncclCollNetSetup(comm, parent, graphs);
   } else {
     //this branch not executed in our scenario
-    INFO(NCCL_ALL,"initTransportsRank else (comm->runtimeConn)");
-
     for (int c=0; c<comm->nChannels; c++) {
       NCCLCHECKGOTO(setupChannel(comm, c, rank, nranks, rings+c*nranks), ret, fail);
     }
     
-    INFO(NCCL_ALL,"initTransportsRank BEFORE ncclTransportRingConnect");
     // in our scenario ncclTransportRingConnect calls ncclTransportP2pSetup
     NCCLCHECKGOTO(ncclTransportRingConnect(comm), ret, fail); 
-    INFO(NCCL_ALL,"initTransportsRank AFTER ncclTransportRingConnect");
     // Connect Trees
     NCCLCHECKGOTO(ncclTransportTreeConnect(comm), ret, fail);
 
@@ -1251,7 +1245,6 @@ static ncclResult_t initTransportsRank(struct ncclComm* comm, struct ncclComm* p
 
       //not executed in our scenario
       NCCLCHECKGOTO(ncclTransportP2pSetup(comm, NULL, 1), ret, fail);
-      INFO(NCCL_ALL,"ncclTransportP2pSetup ----------------DONE (if ncclParamNvbPreconnect)------------------------>");
     }
   }
 
@@ -1694,7 +1687,6 @@ static ncclResult_t ncclCommInitRankDev(ncclComm_t* newcomm, int nranks, ncclUni
   job->commId = commId; // C++ struct assignment
   job->myrank = myrank;
   job->cudaDev = cudaDev;
-  INFO(NCCL_ALL, "ncclCommInitRankDev ->  ncclCommInitRankFunc");
   NCCLCHECKGOTO(ncclAsyncLaunch(&job->base, ncclCommInitRankFunc, NULL, free, comm), res, fail);
 
 exit:
@@ -0,0 +1,200 @@
+/*************************************************************************
+ * Copyright (c) 2024, NVIDIA CORPORATION. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#include "compress.h"
+#include "debug.h"
+#include <string.h>
+#include <algorithm>
+
+// The LZ codec follows the LZ4 block format: sequences of literals followed by a match (2-byte
+// offset, length of at least 4), the last sequence being literals only. Matches are found with a
+// single-entry hash table, skipping ahead faster the longer we go without finding one.
+#define LZ_HASH_LOG 12
+#define LZ_MIN_MATCH 4
+#define LZ_LAST_LITERALS 5   // the last bytes of a block are always literals
+#define LZ_MATCH_LIMIT 12    // and no match starts that close to the end
+#define LZ_MAX_OFFSET 65535
+
+// Keep a chunk compressed only if it saves at least 1/LZ_MIN_SAVING of its size
+#define LZ_MIN_SAVING 8
+
+static inline uint32_t lzRead32(const uint8_t* p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static inline uint32_t lzHash(uint32_t v) {
+  return (v*2654435761U) >> (32-LZ_HASH_LOG);
+}
+
+// Write a length continuing a 4-bit token field. Returns the new end, or NULL past end.
+static uint8_t* lzWriteLength(uint8_t* op, uint8_t* end, int len) {
+  for (; len >= 255; len -= 255) {
+    if (op == end) return NULL;
+    *op++ = 255;
+  }
+  if (op == end) return NULL;
+  *op++ = len;
+  return op;
+}
+
+static uint8_t* lzWriteSequence(uint8_t* op, uint8_t* end, const uint8_t* lit, int litLen, int offset, int matchLen) {
+  if (op == end) return NULL;
+  uint8_t* token = op++;
+  *token = std::min(litLen, 15) << 4;
+  if (litLen >= 15 && (op = lzWriteLength(op, end, litLen-15)) == NULL) return NULL;
+  if (end-op < litLen) return NULL;
+  memcpy(op, lit, litLen);
+  op += litLen;
+  if (matchLen == 0) return op;
+  if (end-op < 2) return NULL;
+  *op++ = offset & 0xff;
+  *op++ = offset >> 8;
+  matchLen -= LZ_MIN_MATCH;
+  *token |= std::min(matchLen, 15);
+  if (matchLen >= 15 && (op = lzWriteLength(op, end, matchLen-15)) == NULL) return NULL;
+  return op;
+}
+
+// Returns the compressed size, or -1 if it would exceed cap
+static int lzCompress(const uint8_t* src, int size, uint8_t* dst, int cap) {
+  uint32_t table[1<<LZ_HASH_LOG];
+  memset(table, 0, sizeof(table));
+  uint8_t* op = dst;
+  uint8_t* end = dst+cap;
+  int ip = 0, anchor = 0;
+  while (ip < size-LZ_MATCH_LIMIT) {
+    uint32_t seq = lzRead32(src+ip);
+    uint32_t h = lzHash(seq);
+    int ref = table[h];
+    table[h] = ip;
+    if (ref >= ip || ip-ref > LZ_MAX_OFFSET || lzRead32(src+ref) != seq) {
+      ip += 1 + ((ip-anchor) >> 6);
+      continue;
+    }
+    int len = LZ_MIN_MATCH;
+    while (ip+len < size-LZ_LAST_LITERALS && src[ref+len] == src[ip+len]) len++;
+    if ((op = lzWriteSequence(op, end, src+anchor, ip-anchor, ip-ref, len)) == NULL) return -1;
+    ip += len;
+    anchor = ip;
+  }
+  if ((op = lzWriteSequence(op, end, src+anchor, size-anchor, 0, 0)) == NULL) return -1;
+  return op-dst;
+}
+
+// Read a length continuing a 4-bit token field, bounded by max
+static int lzReadLength(const uint8_t* src, int size, int* ip, int* len, int max) {
+  uint8_t b;
+  do {
+    if (*ip == size) return -1;
+    b = src[(*ip)++];
+    *len += b;
+    if (*len > max) return -1;
+  } while (b == 255);
+  return 0;
+}
+
+static int lzDecompress(const uint8_t* src, int srcSize, uint8_t* dst, int size) {
+  int ip = 0, op = 0;
+  while (ip < srcSize) {
+    uint8_t token = src[ip++];
+    int litLen = token >> 4;
+    if (litLen == 15 && lzReadLength(src, srcSize, &ip, &litLen, size) != 0) return -1;
+    if (litLen > srcSize-ip || litLen > size-op) return -1;
+    memcpy(dst+op, src+ip, litLen);
+    ip += litLen;
+    op += litLen;
+    if (ip == srcSize) break;
+    if (srcSize-ip < 2) return -1;
+    int offset = src[ip] | (src[ip+1] << 8);
+    ip += 2;
+    int len = token & 15;
+    if (len == 15 && lzReadLength(src, srcSize, &ip, &len, size) != 0) return -1;
+    len += LZ_MIN_MATCH;
+    if (offset == 0 || offset > op || len > size-op) return -1;
+    // The match may overlap the bytes it produces: copy in steps of a multiple of offset, which
+    // grows as the repeated pattern is extended
+    uint8_t* out = dst+op;
+    int period = offset;
+    for (int done=0; done<len; ) {
+      int n = std::min(period, len-done);
+      memcpy(out+done, out+done-period, n);
+      done += n;
+      period = (offset+done)/offset*offset;
+    }
+    op += len;
+  }
+  return op == size ? 0 : -1;
+}
+
+// Group byte b of each element together. Trailing bytes which do not make a full element stay last.
+static void shuffle(const uint8_t* src, int size, int elemSize, uint8_t* dst) {
+  int n = size/elemSize;
+  for (int b=0; b<elemSize; b++) {
+    for (int i=0; i<n; i++) dst[b*n+i] = src[i*elemSize+b];
+  }
+  memcpy(dst+n*elemSize, src+n*elemSize, size-n*elemSize);
+}
+
+static void unshuffle(const uint8_t* src, int size, int elemSize, uint8_t* dst) {
+  int n = size/elemSize;
+  for (int b=0; b<elemSize; b++) {
+    for (int i=0; i<n; i++) dst[i*elemSize+b] = src[b*n+i];
+  }
+  memcpy(dst+n*elemSize, src+n*elemSize, size-n*elemSize);
+}
+
+ncclResult_t ncclCompress(const void* src, int size, int elemSize, void* dst, int* dstSize) {
+  uint8_t shuffled[NCCL_COMPRESS_CHUNK_SIZE];
+  const uint8_t* in = (const uint8_t*)src;
+  uint8_t* out = (uint8_t*)dst;
+  for (int offset=0; offset<size; offset+=NCCL_COMPRESS_CHUNK_SIZE) {
+    struct ncclCompressChunk c;
+    memset(&c, 0, sizeof(c));
+    c.size = std::min(size-offset, NCCL_COMPRESS_CHUNK_SIZE);
+    c.elemSize = elemSize;
+    const uint8_t* chunk = in+offset;
+    if (elemSize > 1) {
+      shuffle(chunk, c.size, elemSize, shuffled);
+      chunk = shuffled;
+    }
+    uint8_t* payload = out+sizeof(c);
+    int wireSize = lzCompress(chunk, c.size, payload, c.size-c.size/LZ_MIN_SAVING);
+    if (wireSize >= 0) {
+      c.codec = NCCL_COMPRESS_CODEC_LZ;
+      c.wireSize = wireSize;
+    } else {
+      c.codec = NCCL_COMPRESS_CODEC_RAW;
+      c.elemSize = 1;
+      c.wireSize = c.size;
+      memcpy(payload, in+offset, c.size);
+    }
+    memcpy(out, &c, sizeof(c));
+    out = payload+c.wireSize;
+  }
+  *dstSize = out-(uint8_t*)dst;
+  return ncclSuccess;
+}
+
+ncclResult_t ncclDecompressChunk(const struct ncclCompressChunk* c, const void* src, void* dst) {
+  uint8_t shuffled[NCCL_COMPRESS_CHUNK_SIZE];
+  if (c->size > NCCL_COMPRESS_CHUNK_SIZE || c->elemSize == 0) goto fail;
+  if (c->codec == NCCL_COMPRESS_CODEC_RAW) {
+    if (c->wireSize != c->size) goto fail;
+    memcpy(dst, src, c->size);
+  } else if (c->codec == NCCL_COMPRESS_CODEC_LZ) {
+    uint8_t* out = c->elemSize > 1 ? shuffled : (uint8_t*)dst;
+    if (lzDecompress((const uint8_t*)src, c->wireSize, out, c->size) != 0) goto fail;
+    if (c->elemSize > 1) unshuffle(shuffled, c->size, c->elemSize, (uint8_t*)dst);
+  } else {
+    goto fail;
+  }
+  return ncclSuccess;
+fail:
+  WARN("Received a malformed compressed chunk (codec %d, size %u, wire size %u)", c->codec, c->size, c->wireSize);
+  return ncclRemoteError;
+}
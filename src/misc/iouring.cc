@@ -0,0 +1,172 @@
+/*************************************************************************
+ * Copyright (c) 2024, NVIDIA CORPORATION. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#include "iouring.h"
+#include "debug.h"
+#include "checks.h"
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+
+static int sysIoUringSetup(unsigned entries, struct io_uring_params* p) {
+  return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sysIoUringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags) {
+  return (int)syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, NULL, 0);
+}
+
+static int sysIoUringRegister(int fd, unsigned opcode, void* arg, unsigned nrArgs) {
+  return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nrArgs);
+}
+
+ncclResult_t ncclIoUringInit(struct ncclIoUring* ring, unsigned entries) {
+  struct io_uring_params p;
+  memset(ring, 0, sizeof(struct ncclIoUring));
+  ring->fd = -1;
+  memset(&p, 0, sizeof(p));
+  // Only the proxy thread submits to a ring, which lets the kernel skip some locking and
+  // defer task work until we enter the kernel. Retry without these hints on older kernels.
+  p.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_COOP_TASKRUN;
+  int fd = sysIoUringSetup(entries, &p);
+  if (fd < 0 && errno == EINVAL) {
+    memset(&p, 0, sizeof(p));
+    fd = sysIoUringSetup(entries, &p);
+  }
+  if (fd < 0) {
+    INFO(NCCL_NET, "io_uring_setup failed : %s", strerror(errno));
+    return ncclSystemError;
+  }
+  ring->fd = fd;
+  ring->features = p.features;
+  ring->sqRingSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  ring->cqRingSize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    if (ring->cqRingSize > ring->sqRingSize) ring->sqRingSize = ring->cqRingSize;
+    ring->cqRingSize = ring->sqRingSize;
+  }
+  ring->sqRing = mmap(NULL, ring->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  if (ring->sqRing == MAP_FAILED) goto fail;
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    ring->cqRing = ring->sqRing;
+  } else {
+    ring->cqRing = mmap(NULL, ring->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    if (ring->cqRing == MAP_FAILED) goto fail;
+  }
+  ring->sqesSize = p.sq_entries * sizeof(struct io_uring_sqe);
+  ring->sqes = (struct io_uring_sqe*)mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+  if (ring->sqes == MAP_FAILED) goto fail;
+
+  ring->sqHead = (unsigned*)((char*)ring->sqRing + p.sq_off.head);
+  ring->sqTail = (unsigned*)((char*)ring->sqRing + p.sq_off.tail);
+  ring->sqMask = (unsigned*)((char*)ring->sqRing + p.sq_off.ring_mask);
+  ring->sqArray = (unsigned*)((char*)ring->sqRing + p.sq_off.array);
+  ring->sqEntries = p.sq_entries;
+  ring->sqLocalTail = *ring->sqTail;
+  ring->cqHead = (unsigned*)((char*)ring->cqRing + p.cq_off.head);
+  ring->cqTail = (unsigned*)((char*)ring->cqRing + p.cq_off.tail);
+  ring->cqMask = (unsigned*)((char*)ring->cqRing + p.cq_off.ring_mask);
+  ring->cqes = (struct io_uring_cqe*)((char*)ring->cqRing + p.cq_off.cqes);
+  return ncclSuccess;
+fail:
+  INFO(NCCL_NET, "io_uring mmap failed : %s", strerror(errno));
+  if (ring->sqRing == MAP_FAILED) ring->sqRing = NULL;
+  if (ring->cqRing == MAP_FAILED) ring->cqRing = NULL;
+  if (ring->sqes == MAP_FAILED) ring->sqes = NULL;
+  ncclIoUringClose(ring);
+  return ncclSystemError;
+}
+
+ncclResult_t ncclIoUringClose(struct ncclIoUring* ring) {
+  if (ring->sqes) munmap(ring->sqes, ring->sqesSize);
+  if (ring->cqRing && ring->cqRing != ring->sqRing) munmap(ring->cqRing, ring->cqRingSize);
+  if (ring->sqRing) munmap(ring->sqRing, ring->sqRingSize);
+  if (ring->fd >= 0) close(ring->fd);
+  memset(ring, 0, sizeof(struct ncclIoUring));
+  ring->fd = -1;
+  return ncclSuccess;
+}
+
+ncclResult_t ncclIoUringRegisterFiles(struct ncclIoUring* ring, int* fds, int nfds) {
+  if (sysIoUringRegister(ring->fd, IORING_REGISTER_FILES, fds, nfds) < 0) {
+    INFO(NCCL_NET, "io_uring_register(FILES) failed : %s", strerror(errno));
+    return ncclSystemError;
+  }
+  return ncclSuccess;
+}
+
+ncclResult_t ncclIoUringRegisterBufferTable(struct ncclIoUring* ring, int nBuffers) {
+  struct io_uring_rsrc_register reg;
+  memset(&reg, 0, sizeof(reg));
+  reg.nr = nBuffers;
+  reg.flags = IORING_RSRC_REGISTER_SPARSE;
+  if (sysIoUringRegister(ring->fd, IORING_REGISTER_BUFFERS2, &reg, sizeof(reg)) < 0) {
+    INFO(NCCL_NET, "io_uring_register(BUFFERS2) failed : %s", strerror(errno));
+    return ncclSystemError;
+  }
+  ring->nBuffers = nBuffers;
+  return ncclSuccess;
+}
+
+// A NULL data pointer removes the buffer at index from the table.
+ncclResult_t ncclIoUringUpdateBuffer(struct ncclIoUring* ring, int index, void* data, size_t size) {
+  struct iovec iov = { data, size };
+  struct io_uring_rsrc_update2 up;
+  memset(&up, 0, sizeof(up));
+  up.offset = index;
+  up.data = (uint64_t)(uintptr_t)&iov;
+  up.nr = 1;
+  if (sysIoUringRegister(ring->fd, IORING_REGISTER_BUFFERS_UPDATE, &up, sizeof(up)) < 0) {
+    INFO(NCCL_NET, "io_uring_register(BUFFERS_UPDATE) failed : %s", strerror(errno));
+    return ncclSystemError;
+  }
+  return ncclSuccess;
+}
+
+struct io_uring_sqe* ncclIoUringGetSqe(struct ncclIoUring* ring) {
+  unsigned head = __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE);
+  if (ring->sqLocalTail - head >= ring->sqEntries) return NULL;
+  unsigned index = ring->sqLocalTail & *ring->sqMask;
+  struct io_uring_sqe* sqe = ring->sqes+index;
+  memset(sqe, 0, sizeof(struct io_uring_sqe));
+  ring->sqArray[index] = index;
+  ring->sqLocalTail++;
+  return sqe;
+}
+
+ncclResult_t ncclIoUringSubmit(struct ncclIoUring* ring) {
+  unsigned tail = *ring->sqTail;
+  if (tail != ring->sqLocalTail) {
+    ring->sqPending += ring->sqLocalTail - tail;
+    __atomic_store_n(ring->sqTail, ring->sqLocalTail, __ATOMIC_RELEASE);
+  }
+  while (ring->sqPending) {
+    int ret = sysIoUringEnter(ring->fd, ring->sqPending, 0, 0);
+    if (ret < 0) {
+      // EAGAIN/EBUSY: the kernel is out of resources or the CQ is full; retry on the next call.
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN || errno == EBUSY) return ncclSuccess;
+      WARN("io_uring_enter failed : %s", strerror(errno));
+      return ncclSystemError;
+    }
+    ring->sqPending -= ret;
+    if (ret == 0) break;
+  }
+  return ncclSuccess;
+}
+
+struct io_uring_cqe* ncclIoUringPeekCqe(struct ncclIoUring* ring) {
+  unsigned head = *ring->cqHead;
+  if (head == __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE)) return NULL;
+  return ring->cqes+(head & *ring->cqMask);
+}
+
+void ncclIoUringCqeSeen(struct ncclIoUring* ring) {
+  __atomic_store_n(ring->cqHead, *ring->cqHead+1, __ATOMIC_RELEASE);
+}
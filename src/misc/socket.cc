@@ -11,28 +11,32 @@
 #include <unistd.h>
 #include <ifaddrs.h>
 #include <net/if.h>
+#include <linux/errqueue.h>
 #include "param.h"
 
 static ncclResult_t socketProgressOpt(int op, struct ncclSocket* sock, void* ptr, int size, int* offset, int block, int* closed) {
-  //INFO(NCCL_ALL,"%%%%%%%%%%%%%%%%%%%%%%%%%%%% socketProgressOpt");
   int bytes = 0;
   *closed = 0;
   char* data = (char*)ptr;
   char line[SOCKET_NAME_MAXLEN+1];
+  sock->wouldBlock = 0;
   do {
-    if (op == NCCL_SOCKET_RECV) {
-      bytes = recv(sock->fd, data+(*offset), size-(*offset), block ? 0 : MSG_DONTWAIT);
-    }
-    if (op == NCCL_SOCKET_SEND) bytes = send(sock->fd, data+(*offset), size-(*offset), block ? MSG_NOSIGNAL : MSG_DONTWAIT | MSG_NOSIGNAL);
+    do {
+      if (op == NCCL_SOCKET_RECV) {
+        bytes = recv(sock->fd, data+(*offset), size-(*offset), block ? 0 : MSG_DONTWAIT);
+      }
+      if (op == NCCL_SOCKET_SEND) bytes = send(sock->fd, data+(*offset), size-(*offset), block ? MSG_NOSIGNAL : MSG_DONTWAIT | MSG_NOSIGNAL);
+    } while (bytes == -1 && errno == EINTR);
     if (op == NCCL_SOCKET_RECV && bytes == 0) {
       *closed = 1;
       return ncclSuccess;
     }
     if (bytes == -1) {
-      if (errno != EINTR && errno != EWOULDBLOCK && errno != EAGAIN) {
+      if (errno != EWOULDBLOCK && errno != EAGAIN) {
         WARN("socketProgressOpt: Call to recv from %s failed : %s", ncclSocketToString(&sock->addr, line), strerror(errno));
         return ncclRemoteError;
       } else {
+        sock->wouldBlock = 1;
         bytes = 0;
       }
     }
@@ -56,9 +60,43 @@ static ncclResult_t socketProgress(int op, struct ncclSocket* sock, void* ptr, i
   return ncclSuccess;
 }
 
+// Blocking loops spin that long without progress before sleeping in poll(), which returns at least
+// that often to let them check abortFlag. Spinning many ranks sharing a few cores would starve the
+// ones which have something to do.
+#define SOCKET_SPIN_NS 20000
+#define SOCKET_POLL_MS 10
+
+#define SOCKET_POLL_STACK_FDS 4
+
+ncclResult_t ncclSocketWaitIdle(int nSocks, struct ncclSocket** socks, const int* ops, uint64_t* idleStart) {
+  ncclResult_t ret = ncclSuccess;
+  struct pollfd stackPfds[SOCKET_POLL_STACK_FDS];
+  struct pollfd* pfds = stackPfds;
+  if (*idleStart == 0) *idleStart = clockNano();
+  if (clockNano() - *idleStart < SOCKET_SPIN_NS) return ncclSuccess;
+  if (nSocks > SOCKET_POLL_STACK_FDS) NCCLCHECK(ncclCalloc(&pfds, nSocks));
+  for (int i=0; i<nSocks; i++) {
+    bool accepting = socks[i]->state == ncclSocketStateAccepting;
+    pfds[i].fd = accepting ? socks[i]->acceptFd : socks[i]->fd;
+    pfds[i].events = (accepting || ops[i] == NCCL_SOCKET_RECV) ? POLLIN : POLLOUT;
+    pfds[i].revents = 0;
+  }
+  if (poll(pfds, nSocks, SOCKET_POLL_MS) < 0 && errno != EINTR) {
+    WARN("ncclSocketWaitIdle: poll failed : %s", strerror(errno));
+    ret = ncclSystemError;
+  }
+  if (pfds != stackPfds) free(pfds);
+  return ret;
+}
+
 static ncclResult_t socketWait(int op, struct ncclSocket* sock, void* ptr, int size, int* offset) {
-  while (*offset < size)
+  uint64_t idleStart = 0;
+  while (*offset < size) {
+    int prev = *offset;
     NCCLCHECK(socketProgress(op, sock, ptr, size, offset));
+    if (*offset != prev) idleStart = 0;
+    else NCCLCHECK(ncclSocketWaitIdle(1, &sock, &op, &idleStart));
+  }
   return ncclSuccess;
 }
 
@@ -428,7 +466,6 @@ static ncclResult_t socketFinalizeAccept(struct ncclSocket* sock) {
   const int one = 1;
   SYSCHECK(setsockopt(sock->fd, IPPROTO_TCP, TCP_NODELAY, (char*)&one, sizeof(int)), "setsockopt");
 
-  //INFO(NCCL_ALL,"XXXXXXXXXXXXXXXXXXXXX socketFinalizeAccept");
   NCCLCHECK(ncclSocketProgress(NCCL_SOCKET_RECV, sock, &magic, sizeof(magic), &received));
   if (received == 0) return ncclSuccess;
   NCCLCHECK(socketWait(NCCL_SOCKET_RECV, sock, &magic, sizeof(magic), &received));
@@ -565,7 +602,6 @@ static ncclResult_t socketProgressState(struct ncclSocket* sock) {
     NCCLCHECK(socketTryAccept(sock));
   }
   if (sock->state == ncclSocketStateAccepted) {
-    //INFO(NCCL_ALL,"XXXXXXXXXXXXXXXXXXXXX socketProgressState ncclSocketStateAccepted");
     NCCLCHECK(socketFinalizeAccept(sock));
   }
   if (sock->state == ncclSocketStateConnecting) {
@@ -648,6 +684,7 @@ ncclResult_t ncclSocketConnect(struct ncclSocket* sock) {
 
 ncclResult_t ncclSocketAccept(struct ncclSocket* sock, struct ncclSocket* listenSock) {
   ncclResult_t ret = ncclSuccess;
+  uint64_t idleStart = 0;
 
   if (listenSock == NULL || sock == NULL) {
     WARN("ncclSocketAccept: pass NULL socket");
@@ -670,7 +707,14 @@ ncclResult_t ncclSocketAccept(struct ncclSocket* sock, struct ncclSocket* listen
   }
 
   do {
+    enum ncclSocketState prev = sock->state;
     NCCLCHECKGOTO(socketProgressState(sock), ret, exit);
+    if (sock->asyncFlag == 0 && sock->state == prev) {
+      int op = NCCL_SOCKET_RECV;
+      NCCLCHECKGOTO(ncclSocketWaitIdle(1, &sock, &op, &idleStart), ret, exit);
+    } else {
+      idleStart = 0;
+    }
   } while (sock->asyncFlag == 0 &&
       (sock->abortFlag == NULL || __atomic_load_n(sock->abortFlag, __ATOMIC_ACQUIRE) == 0) &&
       (sock->state == ncclSocketStateAccepting ||
@@ -754,7 +798,6 @@ fail:
 // only two times in ncclNetSocketConnect
 // hundreds of times in ncclNetSocketTest
 ncclResult_t ncclSocketProgress(int op, struct ncclSocket* sock, void* ptr, int size, int* offset) {
-  //INFO(NCCL_ALL,"XXXXXXXXXXXXXXXXXXXXX ncclSocketProgress");
   if (sock == NULL) {
     WARN("ncclSocketProgress: pass NULL socket");
     return ncclInvalidArgument;
@@ -763,6 +806,57 @@ ncclResult_t ncclSocketProgress(int op, struct ncclSocket* sock, void* ptr, int
   return ncclSuccess;
 }
 
+// Progress a scatter/gather list without blocking. *offset counts bytes over all of iov.
+ncclResult_t ncclSocketProgressIov(int op, struct ncclSocket* sock, const struct iovec* iov, int iovcnt, int* offset, int* closed) {
+  struct iovec vec[NCCL_SOCKET_MAX_IOV];
+  char line[SOCKET_NAME_MAXLEN+1];
+  if (sock == NULL || iovcnt > NCCL_SOCKET_MAX_IOV) {
+    WARN("ncclSocketProgressIov: invalid arguments");
+    return ncclInvalidArgument;
+  }
+  sock->wouldBlock = 0;
+  while (1) {
+    // Skip what has already been transferred
+    int skip = *offset, n = 0;
+    for (int i=0; i<iovcnt; i++) {
+      if (skip >= (int)iov[i].iov_len) { skip -= iov[i].iov_len; continue; }
+      vec[n].iov_base = (char*)iov[i].iov_base+skip;
+      vec[n].iov_len = iov[i].iov_len-skip;
+      skip = 0;
+      n++;
+    }
+    if (n == 0) return ncclSuccess;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = vec;
+    msg.msg_iovlen = n;
+    ssize_t bytes = op == NCCL_SOCKET_SEND ? sendmsg(sock->fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL) : recvmsg(sock->fd, &msg, MSG_DONTWAIT);
+    if (op == NCCL_SOCKET_RECV && bytes == 0) {
+      if (closed) {
+        *closed = 1;
+        return ncclSuccess;
+      }
+      WARN("ncclSocketProgressIov: Connection closed by remote peer %s", ncclSocketToString(&sock->addr, line, 0));
+      return ncclRemoteError;
+    }
+    if (bytes == -1) {
+      if (errno == EINTR) continue;
+      if (errno == EWOULDBLOCK || errno == EAGAIN) {
+        sock->wouldBlock = 1;
+        return ncclSuccess;
+      }
+      WARN("ncclSocketProgressIov: Call to %s %s failed : %s", op == NCCL_SOCKET_SEND ? "sendmsg to" : "recvmsg from",
+          ncclSocketToString(&sock->addr, line), strerror(errno));
+      return ncclRemoteError;
+    }
+    (*offset) += bytes;
+    if (sock->abortFlag && __atomic_load_n(sock->abortFlag, __ATOMIC_ACQUIRE)) {
+      INFO(NCCL_NET, "ncclSocketProgressIov: abort called");
+      return ncclInternalError;
+    }
+  }
+}
+
 ncclResult_t ncclSocketWait(int op, struct ncclSocket* sock, void* ptr, int size, int* offset) {
   if (sock == NULL) {
     WARN("ncclSocketWait: pass NULL socket");
@@ -810,14 +904,107 @@ ncclResult_t ncclSocketSendRecv(struct ncclSocket* sendSock, void* sendPtr, int
     WARN("ncclSocketSendRecv: socket state (%d/%d) is not ready", sendSock->state, recvSock->state);
     return ncclInternalError;
   }
+  uint64_t idleStart = 0;
   while (sendOffset < sendSize || recvOffset < recvSize) {
+    int prev = sendOffset+recvOffset;
     if (sendOffset < sendSize) NCCLCHECK(socketProgress(NCCL_SOCKET_SEND, sendSock, sendPtr, sendSize, &sendOffset));
     if (recvOffset < recvSize) NCCLCHECK(socketProgress(NCCL_SOCKET_RECV, recvSock, recvPtr, recvSize, &recvOffset));
+    if (sendOffset+recvOffset != prev) {
+      idleStart = 0;
+    } else {
+      // Wait on the sides which are not done
+      struct ncclSocket* socks[2];
+      int ops[2], n = 0;
+      if (sendOffset < sendSize) { socks[n] = sendSock; ops[n++] = NCCL_SOCKET_SEND; }
+      if (recvOffset < recvSize) { socks[n] = recvSock; ops[n++] = NCCL_SOCKET_RECV; }
+      NCCLCHECK(ncclSocketWaitIdle(n, socks, ops, &idleStart));
+    }
   }
   return ncclSuccess;
 }
 
 
+ncclResult_t ncclSocketEnableZeroCopy(struct ncclSocket* sock, int* enabled) {
+  *enabled = 0;
+#ifdef SO_ZEROCOPY
+  const int one = 1;
+  if (sock == NULL || sock->fd < 0) return ncclSuccess;
+  // Requires Linux 4.14 or later; treat failure as "not supported".
+  if (setsockopt(sock->fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == 0) *enabled = 1;
+  else INFO(NCCL_NET, "ncclSocketEnableZeroCopy: setsockopt(SO_ZEROCOPY) failed : %s", strerror(errno));
+#endif
+  return ncclSuccess;
+}
+
+// Non-blocking send with MSG_ZEROCOPY. Every successful send() call is assigned a notification
+// id by the kernel; *nCalls is incremented once per call so that callers can wait for
+// ncclSocketZeroCopyPoll to report that many notifications before reusing the buffer.
+ncclResult_t ncclSocketSendZeroCopy(struct ncclSocket* sock, void* ptr, int size, int* offset, uint32_t* nCalls) {
+#ifdef MSG_ZEROCOPY
+  char* data = (char*)ptr;
+  char line[SOCKET_NAME_MAXLEN+1];
+  sock->wouldBlock = 0;
+  while (*offset < size) {
+    int bytes = send(sock->fd, data+(*offset), size-(*offset), MSG_DONTWAIT | MSG_NOSIGNAL | MSG_ZEROCOPY);
+    if (bytes == -1) {
+      if (errno == EINTR) continue;
+      // ENOBUFS means too many notifications are outstanding (optmem limit); retry once some are
+      // reaped, which the error queue signals like EAGAIN would be.
+      if (errno == EWOULDBLOCK || errno == EAGAIN || errno == ENOBUFS) {
+        sock->wouldBlock = 1;
+        break;
+      }
+      WARN("ncclSocketSendZeroCopy: Call to send to %s failed : %s", ncclSocketToString(&sock->addr, line), strerror(errno));
+      return ncclRemoteError;
+    }
+    (*nCalls)++;
+    (*offset) += bytes;
+    if (sock->abortFlag && __atomic_load_n(sock->abortFlag, __ATOMIC_ACQUIRE)) {
+      INFO(NCCL_NET, "ncclSocketSendZeroCopy: abort called");
+      return ncclInternalError;
+    }
+  }
+  return ncclSuccess;
+#else
+  return ncclSocketProgress(NCCL_SOCKET_SEND, sock, ptr, size, offset);
+#endif
+}
+
+// Drain MSG_ZEROCOPY completion notifications from the socket error queue. *completed is
+// incremented by the number of send() calls whose buffers have been released by the kernel.
+// *copied is set if the kernel had to fall back to copying the data (e.g. loopback, or a NIC
+// without scatter-gather), in which case zero-copy only adds overhead.
+ncclResult_t ncclSocketZeroCopyPoll(struct ncclSocket* sock, uint32_t* completed, int* copied) {
+#ifdef MSG_ZEROCOPY
+  char control[CMSG_SPACE(sizeof(struct sock_extended_err)) * 4];
+  while (1) {
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    if (recvmsg(sock->fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) return ncclSuccess;
+      WARN("ncclSocketZeroCopyPoll: recvmsg(MSG_ERRQUEUE) failed : %s", strerror(errno));
+      return ncclSystemError;
+    }
+    for (struct cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm != NULL; cm = CMSG_NXTHDR(&msg, cm)) {
+      if (!((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+            (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR))) continue;
+      struct sock_extended_err* serr = (struct sock_extended_err*)CMSG_DATA(cm);
+      if (serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+        WARN("ncclSocketZeroCopyPoll: unexpected error queue message origin %d errno %d", serr->ee_origin, serr->ee_errno);
+        return ncclRemoteError;
+      }
+      // Notifications cover the inclusive range of send() call ids [ee_info, ee_data]
+      (*completed) += serr->ee_data - serr->ee_info + 1;
+      if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) *copied = 1;
+    }
+  }
+#else
+  return ncclSuccess;
+#endif
+}
+
 // Receive or detect connection closed
 ncclResult_t ncclSocketTryRecv(struct ncclSocket* sock, void* ptr, int size, int* closed, bool blocking) {
   int offset = 0;
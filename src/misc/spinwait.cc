@@ -0,0 +1,60 @@
+/*************************************************************************
+ * Copyright (c) 2024, NVIDIA CORPORATION. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#include "spinwait.h"
+#include "debug.h"
+#include "param.h"
+#include "utils.h"
+#include <string.h>
+
+// Upper bound of the spin window. 0 parks right away, as before the policy was introduced.
+NCCL_PARAM(SpinWaitNs, "SPIN_WAIT_NS", 0);
+
+// The window never shrinks below this fraction of NCCL_SPIN_WAIT_NS, so that it can grow back
+#define SPIN_WAIT_MIN_FRACTION 16
+
+void ncclSpinWaitInit(struct ncclSpinWait* w) {
+  memset(w, 0, sizeof(struct ncclSpinWait));
+  w->maxWindow = std::max(0L, (long)ncclParamSpinWaitNs());
+  w->window = w->maxWindow;
+}
+
+void ncclSpinWaitBusy(struct ncclSpinWait* w) {
+  if (w->idleStart == 0) return;
+  uint64_t now = clockNano();
+  w->idleNs += now-w->idleStart;
+  if (w->stage == ncclSpinWaitSpin) {
+    w->spinNs += now-w->idleStart;
+    w->nSpinWakes++;
+  } else {
+    w->nParks++;
+    // Work came soon after we gave up spinning: a longer window would have saved the wakeup
+    if (now-w->parkStart < w->maxWindow) w->window = std::min(w->maxWindow, 2*w->window);
+  }
+  w->idleStart = 0;
+}
+
+enum ncclSpinWaitStage ncclSpinWaitIdle(struct ncclSpinWait* w) {
+  uint64_t now = clockNano();
+  if (w->idleStart == 0) {
+    w->idleStart = now;
+    w->stage = ncclSpinWaitSpin;
+    w->nIdle++;
+  }
+  if (w->stage == ncclSpinWaitSpin && now-w->idleStart >= w->window) {
+    w->spinNs += now-w->idleStart;
+    w->stage = ncclSpinWaitPark;
+    w->parkStart = now;
+    w->window = std::max(w->maxWindow/SPIN_WAIT_MIN_FRACTION, w->window/2);
+  }
+  return w->stage;
+}
+
+void ncclSpinWaitReport(struct ncclSpinWait* w, uint64_t flags, const char* name) {
+  ncclSpinWaitBusy(w);
+  INFO(flags, "%s : idle %lu times for %lu us, spinning %lu us, woken %lu times while spinning and %lu times parked, window %lu ns",
+      name, w->nIdle, w->idleNs/1000, w->spinNs/1000, w->nSpinWakes, w->nParks, w->window);
+}
@@ -0,0 +1,119 @@
+/*************************************************************************
+ * Copyright (c) 2024, NVIDIA CORPORATION. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#include "trace.h"
+#include "debug.h"
+#include "param.h"
+#include "utils.h"
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+uint64_t ncclTraceMask = 0;
+
+NCCL_PARAM(TracepointsEvents, "TRACEPOINTS_EVENTS", 16384);
+
+static const char* ncclTracePointStr[] = {
+  "SendProxyProgress", "SendPosted", "SendTest", "SendRegComplete", "SendDone",
+  "RecvProxyProgress", "RecvPosted",
+  "SocketGetTask", "SocketTaskDone",
+  "EnqueueCheck", "TaskAppend", "ProxyOpNeeded", "SetKernelFn", "LaunchPrepare", "LaunchKernel",
+  "GroupLaunch", "DoLaunches",
+  "ProxyStart", "ProxyProgressAsync"
+};
+static_assert(sizeof(ncclTracePointStr)/sizeof(ncclTracePointStr[0]) == ncclTraceNumPoints, "missing trace point names");
+
+// Per-thread ring, only written by its thread. Rings are never freed so that the events of
+// threads which have exited are still dumped.
+struct ncclTraceRing {
+  struct ncclTraceRing* next;
+  int tid;
+  uint64_t mask;
+  uint64_t head; // number of events recorded so far
+  struct ncclTraceEvent* events;
+};
+
+static struct ncclTraceRing* ncclTraceRings = NULL; // lock-free list of all rings
+static thread_local struct ncclTraceRing* ncclTraceLocalRing = NULL;
+static thread_local bool ncclTraceRingFailed = false;
+static uint64_t ncclTraceRingSize;
+static char ncclTraceFilename[PATH_MAX+1];
+
+static struct ncclTraceRing* ncclTraceRingCreate() {
+  struct ncclTraceRing* ring = (struct ncclTraceRing*)calloc(1, sizeof(struct ncclTraceRing));
+  if (ring) ring->events = (struct ncclTraceEvent*)calloc(ncclTraceRingSize, sizeof(struct ncclTraceEvent));
+  if (ring == NULL || ring->events == NULL) {
+    free(ring);
+    ncclTraceRingFailed = true;
+    return NULL;
+  }
+  ring->tid = syscall(SYS_gettid);
+  ring->mask = ncclTraceRingSize-1;
+  ring->next = __atomic_load_n(&ncclTraceRings, __ATOMIC_RELAXED);
+  while (!__atomic_compare_exchange_n(&ncclTraceRings, &ring->next, ring, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+  ncclTraceLocalRing = ring;
+  return ring;
+}
+
+void ncclTraceRecord(enum ncclTracePoint point, uint64_t arg0, uint64_t arg1, uint64_t arg2) {
+  struct ncclTraceRing* ring = ncclTraceLocalRing;
+  if (ring == NULL) {
+    if (ncclTraceRingFailed || (ring = ncclTraceRingCreate()) == NULL) return;
+  }
+  struct ncclTraceEvent* event = ring->events+(ring->head & ring->mask);
+  event->time = clockNano();
+  event->point = point;
+  event->args[0] = arg0;
+  event->args[1] = arg1;
+  event->args[2] = arg2;
+  __atomic_store_n(&ring->head, ring->head+1, __ATOMIC_RELEASE);
+}
+
+// Threads may still be recording while we dump; their most recent events may then be torn.
+static void ncclTraceDump() {
+  __atomic_store_n(&ncclTraceMask, 0, __ATOMIC_RELAXED);
+  FILE* file = fopen(ncclTraceFilename, "w");
+  if (file == NULL) {
+    WARN("Could not open trace file %s : %s", ncclTraceFilename, strerror(errno));
+    return;
+  }
+  uint32_t nPoints = ncclTraceNumPoints;
+  fwrite("NCCLTRC1", 1, 8, file);
+  fwrite(&nPoints, sizeof(nPoints), 1, file);
+  for (int p=0; p<ncclTraceNumPoints; p++) fwrite(ncclTracePointStr[p], 1, strlen(ncclTracePointStr[p])+1, file);
+  for (struct ncclTraceRing* ring = __atomic_load_n(&ncclTraceRings, __ATOMIC_ACQUIRE); ring; ring = ring->next) {
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint32_t nEvents = std::min(head, ring->mask+1);
+    fwrite(&ring->tid, sizeof(ring->tid), 1, file);
+    fwrite(&nEvents, sizeof(nEvents), 1, file);
+    for (uint64_t e=head-nEvents; e<head; e++) fwrite(ring->events+(e & ring->mask), sizeof(struct ncclTraceEvent), 1, file);
+  }
+  fclose(file);
+}
+
+void ncclTraceInit() {
+  const char* str = ncclGetEnv("NCCL_TRACEPOINTS");
+  if (str == NULL) return;
+#ifdef ENABLE_TRACEPOINTS
+  uint64_t mask = ncclDebugParseSubsys(str);
+  if (mask == 0) return;
+  int64_t size = ncclParamTracepointsEvents();
+  ncclTraceRingSize = 1;
+  while (ncclTraceRingSize < size) ncclTraceRingSize <<= 1;
+  const char* file = ncclGetEnv("NCCL_TRACEPOINTS_FILE");
+  ncclDebugExpandFilename(file ? file : "nccl-trace.%h.%p.bin", ncclTraceFilename, PATH_MAX+1);
+  if (atexit(ncclTraceDump) != 0) {
+    WARN("Could not register the trace point dump, trace points disabled");
+    return;
+  }
+  INFO(NCCL_INIT, "Trace points enabled for mask 0x%lx, %lu events per thread, dumped to %s", mask, ncclTraceRingSize, ncclTraceFilename);
+  __atomic_store_n(&ncclTraceMask, mask, __ATOMIC_RELAXED);
+#else
+  INFO(NCCL_INIT, "NCCL_TRACEPOINTS set but NCCL was built without TRACEPOINTS=1, ignoring");
+#endif
+}
@@ -0,0 +1,661 @@
+/*************************************************************************
+ * Copyright (c) 2024, NVIDIA CORPORATION. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#include "xdp.h"
+#include "debug.h"
+#include "checks.h"
+#include "param.h"
+#include "utils.h"
+#include <linux/if_xdp.h>
+#include <linux/bpf.h>
+#include <linux/if_link.h>
+#include <linux/if_ether.h>
+#include <net/if.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+
+#ifndef AF_XDP
+#define AF_XDP 44
+#endif
+#ifndef SOL_XDP
+#define SOL_XDP 283
+#endif
+
+NCCL_PARAM(SocketXdpQueue, "SOCKET_XDP_QUEUE", 0);
+NCCL_PARAM(SocketXdpPort, "SOCKET_XDP_PORT", 51000);
+// Retransmit unacknowledged frames after this long without progress
+NCCL_PARAM(SocketXdpRtoUs, "SOCKET_XDP_RTO_US", 1000);
+
+#define XDP_FRAME_SIZE 4096
+#define XDP_NFRAMES 4096
+#define XDP_RING_SIZE 2048 // Fill, completion, RX and TX rings. The first XDP_RING_SIZE frames are for RX.
+#define XDP_RX_HEADROOM 256 // XDP_PACKET_HEADROOM, left by the kernel in front of received packets
+#define XDP_MAX_CONNS 1024
+#define XDP_MAX_INFLIGHT 512 // Unacknowledged frames per connection
+#define XDP_RECV_BUFFER (4*1024*1024)
+#define XDP_HDR_SIZE (sizeof(struct ethhdr)+sizeof(struct iphdr)+sizeof(struct udphdr))
+
+#define XDP_TYPE_DATA 1
+#define XDP_TYPE_ACK 2
+
+// Sent after the UDP header. Both ends are assumed to have the same endianness.
+struct ncclXdpHdr {
+  uint32_t conn;   // Destination connection
+  uint16_t type;
+  uint16_t len;    // Payload bytes
+  uint64_t offset; // DATA: stream offset of the payload. ACK: bytes received in order.
+  uint64_t window; // ACK: stream offset the peer may send up to
+};
+
+struct ncclXdpRing {
+  uint32_t* producer;
+  uint32_t* consumer;
+  uint32_t* flags;
+  void* descs;
+  uint32_t local; // Our producer index for the fill and TX rings, consumer index for the others
+  void* map;
+  size_t mapSize;
+};
+
+struct ncclXdpFrame {
+  int txPending; // In the TX ring, not completed yet
+  int release;   // Return to the free list once completed
+};
+
+struct ncclXdpDev {
+  pthread_mutex_t lock;
+  int fd;
+  int mapFd;
+  int progFd;
+  int linkFd;
+  int ifIndex;
+  uint8_t mac[6];
+  uint32_t ip;
+  uint16_t port;
+  int maxPayload;
+  uint64_t rto;
+  char* umem;
+  struct ncclXdpRing fill, comp, rx, tx;
+  int txPosted; // Descriptors not published to the kernel yet
+  uint64_t freeFrames[XDP_NFRAMES];
+  int nFree;
+  struct ncclXdpFrame frames[XDP_NFRAMES];
+  struct ncclXdpConn* conns[XDP_MAX_CONNS];
+  struct ncclXdpConn* ackList[XDP_MAX_CONNS]; // Connections with an acknowledgement to send
+  int nAcks;
+  uint64_t lastScan;
+};
+
+struct ncclXdpSent {
+  uint64_t addr;
+  uint64_t offset;
+  int len;
+};
+
+struct ncclXdpConn {
+  struct ncclXdpDev* dev;
+  uint32_t id;
+  uint32_t peer;
+  uint8_t hdr[XDP_HDR_SIZE]; // Ethernet, IP and UDP headers of the packets to the peer
+  // Send side
+  uint64_t sndNxt;
+  uint64_t sndUna;
+  uint64_t sndWnd;
+  struct ncclXdpSent sent[XDP_MAX_INFLIGHT];
+  uint32_t sentHead;
+  uint32_t sentTail;
+  uint64_t lastAck; // Last progress of sndUna, or retransmission
+  // Receive side
+  char* rxBuf;
+  uint64_t rcvNxt;
+  uint64_t rcvRead;
+  uint64_t ackedRead; // rcvRead when we last sent an acknowledgement
+  int ackPending;
+};
+
+static int sysBpf(int cmd, union bpf_attr* attr) {
+  return (int)syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
+
+static struct bpf_insn bpfInsn(uint8_t code, uint8_t dst, uint8_t src, int16_t off, int32_t imm) {
+  struct bpf_insn insn;
+  insn.code = code;
+  insn.dst_reg = dst;
+  insn.src_reg = src;
+  insn.off = off;
+  insn.imm = imm;
+  return insn;
+}
+
+// Redirect UDP/IPv4 packets (without IP options) to our port to the socket of their queue
+static ncclResult_t ncclXdpLoadProgram(struct ncclXdpDev* dev, int queue, int genericOnly) {
+  union bpf_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.map_type = BPF_MAP_TYPE_XSKMAP;
+  attr.key_size = sizeof(int);
+  attr.value_size = sizeof(int);
+  attr.max_entries = queue+1;
+  dev->mapFd = sysBpf(BPF_MAP_CREATE, &attr);
+  if (dev->mapFd < 0) {
+    INFO(NCCL_NET, "NET/XDP : could not create XSKMAP : %s", strerror(errno));
+    return ncclSystemError;
+  }
+  memset(&attr, 0, sizeof(attr));
+  attr.map_fd = dev->mapFd;
+  attr.key = (uint64_t)(uintptr_t)&queue;
+  attr.value = (uint64_t)(uintptr_t)&dev->fd;
+  if (sysBpf(BPF_MAP_UPDATE_ELEM, &attr) != 0) {
+    INFO(NCCL_NET, "NET/XDP : could not insert the socket in the XSKMAP : %s", strerror(errno));
+    return ncclSystemError;
+  }
+
+  const int pass = 20;
+  struct bpf_insn prog[] = {
+    bpfInsn(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_6, BPF_REG_1, 0, 0),
+    bpfInsn(BPF_LDX | BPF_W | BPF_MEM, BPF_REG_2, BPF_REG_1, offsetof(struct xdp_md, data), 0),
+    bpfInsn(BPF_LDX | BPF_W | BPF_MEM, BPF_REG_3, BPF_REG_1, offsetof(struct xdp_md, data_end), 0),
+    bpfInsn(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_4, BPF_REG_2, 0, 0),
+    bpfInsn(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_4, 0, 0, XDP_HDR_SIZE),
+    bpfInsn(BPF_JMP | BPF_JGT | BPF_X, BPF_REG_4, BPF_REG_3, pass-6, 0),
+    bpfInsn(BPF_LDX | BPF_H | BPF_MEM, BPF_REG_5, BPF_REG_2, offsetof(struct ethhdr, h_proto), 0),
+    bpfInsn(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_5, 0, pass-8, htons(ETH_P_IP)),
+    bpfInsn(BPF_LDX | BPF_B | BPF_MEM, BPF_REG_5, BPF_REG_2, sizeof(struct ethhdr), 0),
+    bpfInsn(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_5, 0, pass-10, 0x45),
+    bpfInsn(BPF_LDX | BPF_B | BPF_MEM, BPF_REG_5, BPF_REG_2, sizeof(struct ethhdr)+offsetof(struct iphdr, protocol), 0),
+    bpfInsn(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_5, 0, pass-12, IPPROTO_UDP),
+    bpfInsn(BPF_LDX | BPF_H | BPF_MEM, BPF_REG_5, BPF_REG_2, sizeof(struct ethhdr)+sizeof(struct iphdr)+offsetof(struct udphdr, dest), 0),
+    bpfInsn(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_5, 0, pass-14, dev->port),
+    bpfInsn(BPF_LDX | BPF_W | BPF_MEM, BPF_REG_2, BPF_REG_6, offsetof(struct xdp_md, rx_queue_index), 0),
+    bpfInsn(BPF_LD | BPF_DW | BPF_IMM, BPF_REG_1, BPF_PSEUDO_MAP_FD, 0, dev->mapFd),
+    bpfInsn(0, 0, 0, 0, 0),
+    bpfInsn(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_3, 0, 0, XDP_PASS), // Action if the queue has no socket
+    bpfInsn(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map),
+    bpfInsn(BPF_JMP | BPF_EXIT, 0, 0, 0, 0),
+    bpfInsn(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_0, 0, 0, XDP_PASS), // pass
+    bpfInsn(BPF_JMP | BPF_EXIT, 0, 0, 0, 0)
+  };
+  static_assert(sizeof(prog)/sizeof(prog[0]) == pass+2, "XDP program jump offsets are off");
+  memset(&attr, 0, sizeof(attr));
+  attr.prog_type = BPF_PROG_TYPE_XDP;
+  attr.expected_attach_type = BPF_XDP;
+  attr.insns = (uint64_t)(uintptr_t)prog;
+  attr.insn_cnt = sizeof(prog)/sizeof(prog[0]);
+  attr.license = (uint64_t)(uintptr_t)"Dual BSD/GPL";
+  dev->progFd = sysBpf(BPF_PROG_LOAD, &attr);
+  if (dev->progFd < 0) {
+    INFO(NCCL_NET, "NET/XDP : could not load the XDP program : %s", strerror(errno));
+    return ncclSystemError;
+  }
+
+  for (int generic=genericOnly; generic<2; generic++) {
+    memset(&attr, 0, sizeof(attr));
+    attr.link_create.prog_fd = dev->progFd;
+    attr.link_create.target_ifindex = dev->ifIndex;
+    attr.link_create.attach_type = BPF_XDP;
+    attr.link_create.flags = generic ? XDP_FLAGS_SKB_MODE : XDP_FLAGS_DRV_MODE;
+    dev->linkFd = sysBpf(BPF_LINK_CREATE, &attr);
+    if (dev->linkFd >= 0) {
+      INFO(NCCL_NET, "NET/XDP : XDP program attached in %s mode", generic ? "generic" : "native");
+      return ncclSuccess;
+    }
+  }
+  INFO(NCCL_NET, "NET/XDP : could not attach the XDP program : %s", strerror(errno));
+  return ncclSystemError;
+}
+
+static ncclResult_t ncclXdpMapRing(struct ncclXdpDev* dev, struct ncclXdpRing* ring, struct xdp_ring_offset* off, size_t descSize, uint64_t pgoff) {
+  ring->mapSize = off->desc + XDP_RING_SIZE*descSize;
+  ring->map = mmap(NULL, ring->mapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, dev->fd, pgoff);
+  if (ring->map == MAP_FAILED) {
+    ring->map = NULL;
+    INFO(NCCL_NET, "NET/XDP : ring mmap failed : %s", strerror(errno));
+    return ncclSystemError;
+  }
+  ring->producer = (uint32_t*)((char*)ring->map + off->producer);
+  ring->consumer = (uint32_t*)((char*)ring->map + off->consumer);
+  ring->flags = (uint32_t*)((char*)ring->map + off->flags);
+  ring->descs = (char*)ring->map + off->desc;
+  return ncclSuccess;
+}
+
+static ncclResult_t ncclXdpSetup(struct ncclXdpDev* dev, const char* ifName, int queue, int genericOnly) {
+  struct ifreq ifr;
+  memset(&ifr, 0, sizeof(ifr));
+  strncpy(ifr.ifr_name, ifName, IFNAMSIZ-1);
+  dev->ifIndex = if_nametoindex(ifName);
+  // AF_XDP sockets do not support interface ioctls
+  int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  if (dev->ifIndex == 0 || fd < 0 || ioctl(fd, SIOCGIFHWADDR, &ifr) != 0) {
+    INFO(NCCL_NET, "NET/XDP : could not get the address of %s : %s", ifName, strerror(errno));
+    if (fd >= 0) close(fd);
+    return ncclSystemError;
+  }
+  memcpy(dev->mac, ifr.ifr_hwaddr.sa_data, sizeof(dev->mac));
+  int ret = ioctl(fd, SIOCGIFMTU, &ifr);
+  close(fd);
+  if (ret != 0) {
+    INFO(NCCL_NET, "NET/XDP : could not get the MTU of %s : %s", ifName, strerror(errno));
+    return ncclSystemError;
+  }
+  int maxFrame = std::min((int)(ifr.ifr_mtu + sizeof(struct ethhdr)), XDP_FRAME_SIZE-XDP_RX_HEADROOM);
+  dev->maxPayload = maxFrame - XDP_HDR_SIZE - sizeof(struct ncclXdpHdr);
+
+  // UMEM and its rings
+  struct xdp_umem_reg reg;
+  memset(&reg, 0, sizeof(reg));
+  reg.addr = (uint64_t)(uintptr_t)dev->umem;
+  reg.len = (uint64_t)XDP_NFRAMES*XDP_FRAME_SIZE;
+  reg.chunk_size = XDP_FRAME_SIZE;
+  int ringSize = XDP_RING_SIZE;
+  if (setsockopt(dev->fd, SOL_XDP, XDP_UMEM_REG, &reg, sizeof(reg)) != 0 ||
+      setsockopt(dev->fd, SOL_XDP, XDP_UMEM_FILL_RING, &ringSize, sizeof(ringSize)) != 0 ||
+      setsockopt(dev->fd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &ringSize, sizeof(ringSize)) != 0 ||
+      setsockopt(dev->fd, SOL_XDP, XDP_RX_RING, &ringSize, sizeof(ringSize)) != 0 ||
+      setsockopt(dev->fd, SOL_XDP, XDP_TX_RING, &ringSize, sizeof(ringSize)) != 0) {
+    INFO(NCCL_NET, "NET/XDP : could not set up the UMEM : %s", strerror(errno));
+    return ncclSystemError;
+  }
+  struct xdp_mmap_offsets off;
+  socklen_t optlen = sizeof(off);
+  if (getsockopt(dev->fd, SOL_XDP, XDP_MMAP_OFFSETS, &off, &optlen) != 0) {
+    INFO(NCCL_NET, "NET/XDP : could not get the ring offsets : %s", strerror(errno));
+    return ncclSystemError;
+  }
+  NCCLCHECK(ncclXdpMapRing(dev, &dev->fill, &off.fr, sizeof(uint64_t), XDP_UMEM_PGOFF_FILL_RING));
+  NCCLCHECK(ncclXdpMapRing(dev, &dev->comp, &off.cr, sizeof(uint64_t), XDP_UMEM_PGOFF_COMPLETION_RING));
+  NCCLCHECK(ncclXdpMapRing(dev, &dev->rx, &off.rx, sizeof(struct xdp_desc), XDP_PGOFF_RX_RING));
+  NCCLCHECK(ncclXdpMapRing(dev, &dev->tx, &off.tx, sizeof(struct xdp_desc), XDP_PGOFF_TX_RING));
+  for (int f=0; f<XDP_RING_SIZE; f++) ((uint64_t*)dev->fill.descs)[f] = (uint64_t)f*XDP_FRAME_SIZE;
+  dev->fill.local = XDP_RING_SIZE;
+  __atomic_store_n(dev->fill.producer, dev->fill.local, __ATOMIC_RELEASE);
+  for (int f=XDP_RING_SIZE; f<XDP_NFRAMES; f++) dev->freeFrames[dev->nFree++] = (uint64_t)f*XDP_FRAME_SIZE;
+
+  struct sockaddr_xdp sxdp;
+  memset(&sxdp, 0, sizeof(sxdp));
+  sxdp.sxdp_family = AF_XDP;
+  sxdp.sxdp_ifindex = dev->ifIndex;
+  sxdp.sxdp_queue_id = queue;
+  sxdp.sxdp_flags = XDP_USE_NEED_WAKEUP;
+  if (bind(dev->fd, (struct sockaddr*)&sxdp, sizeof(sxdp)) != 0) {
+    INFO(NCCL_NET, "NET/XDP : could not bind to %s queue %d : %s", ifName, queue, strerror(errno));
+    return ncclSystemError;
+  }
+  return ncclXdpLoadProgram(dev, queue, genericOnly);
+}
+
+static void ncclXdpDevFree(struct ncclXdpDev* dev) {
+  struct ncclXdpRing* rings[] = { &dev->fill, &dev->comp, &dev->rx, &dev->tx };
+  for (int r=0; r<4; r++) if (rings[r]->map) munmap(rings[r]->map, rings[r]->mapSize);
+  if (dev->linkFd >= 0) close(dev->linkFd);
+  if (dev->progFd >= 0) close(dev->progFd);
+  if (dev->mapFd >= 0) close(dev->mapFd);
+  if (dev->fd >= 0) close(dev->fd);
+  if (dev->umem) munmap(dev->umem, (size_t)XDP_NFRAMES*XDP_FRAME_SIZE);
+  free(dev);
+}
+
+ncclResult_t ncclXdpOpen(const char* ifName, union ncclSocketAddress* addr, int genericOnly, struct ncclXdpDev** devOut) {
+  *devOut = NULL;
+  if (addr->sa.sa_family != AF_INET) {
+    INFO(NCCL_NET, "NET/XDP : %s has no IPv4 address", ifName);
+    return ncclSystemError;
+  }
+  struct ncclXdpDev* dev;
+  NCCLCHECK(ncclCalloc(&dev, 1));
+  dev->mapFd = dev->progFd = dev->linkFd = -1;
+  dev->ip = addr->sin.sin_addr.s_addr;
+  dev->port = htons(ncclParamSocketXdpPort());
+  dev->rto = ncclParamSocketXdpRtoUs()*1000;
+  pthread_mutex_init(&dev->lock, NULL);
+  int queue = ncclParamSocketXdpQueue();
+  dev->fd = socket(AF_XDP, SOCK_RAW | SOCK_CLOEXEC, 0);
+  dev->umem = (char*)mmap(NULL, (size_t)XDP_NFRAMES*XDP_FRAME_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (dev->umem == MAP_FAILED) dev->umem = NULL;
+  if (dev->fd < 0 || dev->umem == NULL) {
+    INFO(NCCL_NET, "NET/XDP : AF_XDP socket creation failed : %s", strerror(errno));
+    ncclXdpDevFree(dev);
+    return ncclSystemError;
+  }
+  if (ncclXdpSetup(dev, ifName, queue, genericOnly) != ncclSuccess) {
+    ncclXdpDevFree(dev);
+    return ncclSystemError;
+  }
+  INFO(NCCL_NET, "NET/XDP : Using %s queue %d, UDP port %d, %d bytes per packet", ifName, queue, ntohs(dev->port), dev->maxPayload);
+  *devOut = dev;
+  return ncclSuccess;
+}
+
+static uint16_t ncclXdpChecksum(const uint16_t* data, int len) {
+  uint32_t sum = 0;
+  for (int i=0; i<len/2; i++) sum += data[i];
+  while (sum >> 16) sum = (sum & 0xffff) + (sum >> 16);
+  return ~sum;
+}
+
+static int ncclXdpTxRoom(struct ncclXdpDev* dev) {
+  return XDP_RING_SIZE - (dev->tx.local - __atomic_load_n(dev->tx.consumer, __ATOMIC_ACQUIRE));
+}
+
+static void ncclXdpTxPost(struct ncclXdpDev* dev, uint64_t addr, int len) {
+  struct xdp_desc* desc = (struct xdp_desc*)dev->tx.descs + (dev->tx.local++ & (XDP_RING_SIZE-1));
+  desc->addr = addr;
+  desc->len = len;
+  desc->options = 0;
+  dev->frames[addr/XDP_FRAME_SIZE].txPending = 1;
+  dev->txPosted++;
+}
+
+// Publish the TX descriptors to the kernel and wake it up while some are left to transmit: in
+// copy mode, each wakeup only sends a bounded batch. Failures are retried on the next call.
+static void ncclXdpKick(struct ncclXdpDev* dev) {
+  if (dev->txPosted) {
+    __atomic_store_n(dev->tx.producer, dev->tx.local, __ATOMIC_RELEASE);
+    dev->txPosted = 0;
+  }
+  if (__atomic_load_n(dev->tx.consumer, __ATOMIC_ACQUIRE) == dev->tx.local) return;
+  if (__atomic_load_n(dev->tx.flags, __ATOMIC_ACQUIRE) & XDP_RING_NEED_WAKEUP) sendto(dev->fd, NULL, 0, MSG_DONTWAIT, NULL, 0);
+}
+
+static void ncclXdpFrameRelease(struct ncclXdpDev* dev, uint64_t addr) {
+  struct ncclXdpFrame* frame = dev->frames+addr/XDP_FRAME_SIZE;
+  if (frame->txPending) frame->release = 1;
+  else dev->freeFrames[dev->nFree++] = addr;
+}
+
+// Write the headers of a packet to the peer of conn in a new frame. Returns the payload area, or
+// NULL if there is no frame or TX slot left.
+static char* ncclXdpBuild(struct ncclXdpConn* conn, struct ncclXdpHdr* hdr, uint64_t* addr) {
+  struct ncclXdpDev* dev = conn->dev;
+  if (dev->nFree == 0 || ncclXdpTxRoom(dev) == 0) return NULL;
+  *addr = dev->freeFrames[--dev->nFree];
+  char* pkt = dev->umem + *addr;
+  memcpy(pkt, conn->hdr, XDP_HDR_SIZE);
+  struct iphdr* ip = (struct iphdr*)(pkt+sizeof(struct ethhdr));
+  int ipLen = sizeof(struct iphdr)+sizeof(struct udphdr)+sizeof(struct ncclXdpHdr)+hdr->len;
+  ip->tot_len = htons(ipLen);
+  ip->check = 0;
+  ip->check = ncclXdpChecksum((uint16_t*)ip, sizeof(struct iphdr));
+  struct udphdr* udp = (struct udphdr*)(ip+1);
+  udp->len = htons(ipLen-sizeof(struct iphdr));
+  memcpy(pkt+XDP_HDR_SIZE, hdr, sizeof(struct ncclXdpHdr));
+  return pkt+XDP_HDR_SIZE+sizeof(struct ncclXdpHdr);
+}
+
+// Control packets (acknowledgements, window probes) are not retransmitted: free them once sent
+static int ncclXdpSendControl(struct ncclXdpConn* conn, int type, uint64_t offset, uint64_t window) {
+  struct ncclXdpHdr hdr = { conn->peer, (uint16_t)type, 0, offset, window };
+  uint64_t addr;
+  if (ncclXdpBuild(conn, &hdr, &addr) == NULL) return 0;
+  ncclXdpTxPost(conn->dev, addr, XDP_HDR_SIZE+sizeof(struct ncclXdpHdr));
+  conn->dev->frames[addr/XDP_FRAME_SIZE].release = 1;
+  return 1;
+}
+
+static void ncclXdpAckNeeded(struct ncclXdpConn* conn) {
+  if (conn->ackPending) return;
+  conn->ackPending = 1;
+  conn->dev->ackList[conn->dev->nAcks++] = conn;
+}
+
+static void ncclXdpSendAcks(struct ncclXdpDev* dev) {
+  int n = 0;
+  for (int i=0; i<dev->nAcks; i++) {
+    struct ncclXdpConn* conn = dev->ackList[i];
+    if (ncclXdpSendControl(conn, XDP_TYPE_ACK, conn->rcvNxt, conn->rcvRead+XDP_RECV_BUFFER)) {
+      conn->ackPending = 0;
+      conn->ackedRead = conn->rcvRead;
+    } else {
+      dev->ackList[n++] = conn;
+    }
+  }
+  dev->nAcks = n;
+}
+
+// Go-back-N: the receiver drops packets after a missing one, so resend everything unacknowledged
+static void ncclXdpRetransmit(struct ncclXdpConn* conn) {
+  struct ncclXdpDev* dev = conn->dev;
+  for (uint32_t i=conn->sentHead; i!=conn->sentTail; i++) {
+    struct ncclXdpSent* s = conn->sent+i%XDP_MAX_INFLIGHT;
+    if (dev->frames[s->addr/XDP_FRAME_SIZE].txPending) continue;
+    if (ncclXdpTxRoom(dev) == 0) break;
+    ncclXdpTxPost(dev, s->addr, XDP_HDR_SIZE+sizeof(struct ncclXdpHdr)+s->len);
+  }
+}
+
+static void ncclXdpRecvData(struct ncclXdpConn* conn, struct ncclXdpHdr* hdr, char* payload) {
+  // Duplicates and packets following a lost one are dropped; acknowledging them tells the
+  // sender where we are
+  ncclXdpAckNeeded(conn);
+  if (hdr->offset != conn->rcvNxt || hdr->offset+hdr->len > conn->rcvRead+XDP_RECV_BUFFER) return;
+  if (conn->rxBuf == NULL && (conn->rxBuf = (char*)malloc(XDP_RECV_BUFFER)) == NULL) return;
+  int pos = conn->rcvNxt % XDP_RECV_BUFFER;
+  int first = std::min((int)hdr->len, XDP_RECV_BUFFER-pos);
+  memcpy(conn->rxBuf+pos, payload, first);
+  memcpy(conn->rxBuf, payload+first, hdr->len-first);
+  conn->rcvNxt += hdr->len;
+}
+
+static void ncclXdpRecvAck(struct ncclXdpConn* conn, struct ncclXdpHdr* hdr) {
+  if (hdr->window > conn->sndWnd) conn->sndWnd = hdr->window;
+  if (hdr->offset <= conn->sndUna || hdr->offset > conn->sndNxt) return;
+  conn->sndUna = hdr->offset;
+  while (conn->sentHead != conn->sentTail) {
+    struct ncclXdpSent* s = conn->sent+conn->sentHead%XDP_MAX_INFLIGHT;
+    if (s->offset+s->len > conn->sndUna) break;
+    ncclXdpFrameRelease(conn->dev, s->addr);
+    conn->sentHead++;
+  }
+  conn->lastAck = clockNano();
+}
+
+static void ncclXdpRecvPacket(struct ncclXdpDev* dev, char* pkt, int len) {
+  struct ncclXdpHdr hdr;
+  if (len < (int)(XDP_HDR_SIZE+sizeof(hdr))) return;
+  memcpy(&hdr, pkt+XDP_HDR_SIZE, sizeof(hdr));
+  struct ncclXdpConn* conn = dev->conns[hdr.conn % XDP_MAX_CONNS];
+  if (conn == NULL || conn->id != hdr.conn || hdr.len > len-XDP_HDR_SIZE-sizeof(hdr)) return;
+  if (hdr.type == XDP_TYPE_DATA) ncclXdpRecvData(conn, &hdr, pkt+XDP_HDR_SIZE+sizeof(hdr));
+  else if (hdr.type == XDP_TYPE_ACK) ncclXdpRecvAck(conn, &hdr);
+}
+
+// Reap TX completions, process received packets, retransmit on timeouts and send acknowledgements.
+// Called with the lock held.
+static void ncclXdpProgress(struct ncclXdpDev* dev) {
+  uint32_t prod = __atomic_load_n(dev->comp.producer, __ATOMIC_ACQUIRE);
+  while (dev->comp.local != prod) {
+    uint64_t addr = ((uint64_t*)dev->comp.descs)[dev->comp.local++ & (XDP_RING_SIZE-1)];
+    struct ncclXdpFrame* frame = dev->frames+addr/XDP_FRAME_SIZE;
+    frame->txPending = 0;
+    if (frame->release) {
+      frame->release = 0;
+      dev->freeFrames[dev->nFree++] = addr;
+    }
+  }
+  __atomic_store_n(dev->comp.consumer, dev->comp.local, __ATOMIC_RELEASE);
+
+  // RX frames go straight back to the fill ring, which always has room for them
+  prod = __atomic_load_n(dev->rx.producer, __ATOMIC_ACQUIRE);
+  if (dev->rx.local != prod) {
+    while (dev->rx.local != prod) {
+      struct xdp_desc* desc = (struct xdp_desc*)dev->rx.descs + (dev->rx.local++ & (XDP_RING_SIZE-1));
+      ncclXdpRecvPacket(dev, dev->umem+desc->addr, desc->len);
+      ((uint64_t*)dev->fill.descs)[dev->fill.local++ & (XDP_RING_SIZE-1)] = desc->addr & ~(uint64_t)(XDP_FRAME_SIZE-1);
+    }
+    __atomic_store_n(dev->rx.consumer, dev->rx.local, __ATOMIC_RELEASE);
+    __atomic_store_n(dev->fill.producer, dev->fill.local, __ATOMIC_RELEASE);
+    if (__atomic_load_n(dev->fill.flags, __ATOMIC_ACQUIRE) & XDP_RING_NEED_WAKEUP) recvfrom(dev->fd, NULL, 0, MSG_DONTWAIT, NULL, NULL);
+  }
+
+  uint64_t now = clockNano();
+  if (now-dev->lastScan > dev->rto/2) {
+    dev->lastScan = now;
+    for (int c=0; c<XDP_MAX_CONNS; c++) {
+      struct ncclXdpConn* conn = dev->conns[c];
+      if (conn == NULL || conn->sentHead == conn->sentTail || now-conn->lastAck < dev->rto) continue;
+      ncclXdpRetransmit(conn);
+      conn->lastAck = now;
+    }
+  }
+  ncclXdpSendAcks(dev);
+  ncclXdpKick(dev);
+}
+
+ncclResult_t ncclXdpConnCreate(struct ncclXdpDev* dev, struct ncclXdpConn** connOut, struct ncclXdpAddr* local) {
+  struct ncclXdpConn* conn;
+  NCCLCHECK(ncclCalloc(&conn, 1));
+  conn->dev = dev;
+  uint32_t tag;
+  NCCLCHECK(getRandomData(&tag, sizeof(tag)));
+  pthread_mutex_lock(&dev->lock);
+  int c = 0;
+  while (c < XDP_MAX_CONNS && dev->conns[c]) c++;
+  if (c == XDP_MAX_CONNS) {
+    pthread_mutex_unlock(&dev->lock);
+    free(conn);
+    WARN("NET/XDP : too many connections");
+    return ncclInternalError;
+  }
+  // Stale packets of a previous connection in the same slot will not match the tag
+  conn->id = (tag & ~(uint32_t)(XDP_MAX_CONNS-1)) | c;
+  dev->conns[c] = conn;
+  pthread_mutex_unlock(&dev->lock);
+  memcpy(local->mac, dev->mac, sizeof(local->mac));
+  local->port = dev->port;
+  local->ip = dev->ip;
+  local->conn = conn->id;
+  local->valid = 1;
+  *connOut = conn;
+  return ncclSuccess;
+}
+
+ncclResult_t ncclXdpConnConnect(struct ncclXdpConn* conn, struct ncclXdpAddr* remote) {
+  struct ncclXdpDev* dev = conn->dev;
+  struct ethhdr* eth = (struct ethhdr*)conn->hdr;
+  memcpy(eth->h_dest, remote->mac, ETH_ALEN);
+  memcpy(eth->h_source, dev->mac, ETH_ALEN);
+  eth->h_proto = htons(ETH_P_IP);
+  struct iphdr* ip = (struct iphdr*)(eth+1);
+  memset(ip, 0, sizeof(struct iphdr));
+  ip->version = 4;
+  ip->ihl = 5;
+  ip->frag_off = htons(IP_DF);
+  ip->ttl = 64;
+  ip->protocol = IPPROTO_UDP;
+  ip->saddr = dev->ip;
+  ip->daddr = remote->ip;
+  struct udphdr* udp = (struct udphdr*)(ip+1);
+  udp->source = dev->port;
+  udp->dest = remote->port;
+  udp->check = 0; // Optional with IPv4
+  conn->peer = remote->conn;
+  conn->sndWnd = XDP_RECV_BUFFER;
+  return ncclSuccess;
+}
+
+// Copy len bytes between buf and the iovecs, starting offset bytes into them
+static void ncclXdpIovCopy(const struct iovec* iov, int iovcnt, int offset, char* buf, int len, int toIov) {
+  for (int i=0; i<iovcnt && len > 0; i++) {
+    if (offset >= (int)iov[i].iov_len) {
+      offset -= iov[i].iov_len;
+      continue;
+    }
+    int n = std::min(len, (int)iov[i].iov_len-offset);
+    if (toIov) memcpy((char*)iov[i].iov_base+offset, buf, n);
+    else memcpy(buf, (char*)iov[i].iov_base+offset, n);
+    buf += n;
+    len -= n;
+    offset = 0;
+  }
+}
+
+static void ncclXdpConnSend(struct ncclXdpConn* conn, const struct iovec* iov, int iovcnt, int total, int* offset) {
+  struct ncclXdpDev* dev = conn->dev;
+  while (*offset < total && conn->sentTail-conn->sentHead < XDP_MAX_INFLIGHT) {
+    int len = std::min((uint64_t)std::min(dev->maxPayload, total-*offset), conn->sndWnd-conn->sndNxt);
+    if (len == 0) break;
+    struct ncclXdpHdr hdr = { conn->peer, XDP_TYPE_DATA, (uint16_t)len, conn->sndNxt, 0 };
+    uint64_t addr;
+    char* payload = ncclXdpBuild(conn, &hdr, &addr);
+    if (payload == NULL) break;
+    ncclXdpIovCopy(iov, iovcnt, *offset, payload, len, 0);
+    ncclXdpTxPost(dev, addr, XDP_HDR_SIZE+sizeof(hdr)+len);
+    if (conn->sentHead == conn->sentTail) conn->lastAck = clockNano();
+    struct ncclXdpSent* s = conn->sent+conn->sentTail++%XDP_MAX_INFLIGHT;
+    s->addr = addr;
+    s->offset = conn->sndNxt;
+    s->len = len;
+    conn->sndNxt += len;
+    *offset += len;
+  }
+  // The receive buffer of the peer is full and everything was acknowledged: probe the window in
+  // case the acknowledgement opening it was lost
+  if (*offset < total && conn->sentHead == conn->sentTail && conn->sndNxt == conn->sndWnd) {
+    uint64_t now = clockNano();
+    if (now-conn->lastAck > dev->rto && ncclXdpSendControl(conn, XDP_TYPE_DATA, conn->sndNxt, 0)) conn->lastAck = now;
+  }
+}
+
+static void ncclXdpConnRecv(struct ncclXdpConn* conn, const struct iovec* iov, int iovcnt, int total, int* offset) {
+  while (*offset < total && conn->rcvRead < conn->rcvNxt) {
+    int pos = conn->rcvRead % XDP_RECV_BUFFER;
+    int len = std::min((uint64_t)std::min(total-*offset, XDP_RECV_BUFFER-pos), conn->rcvNxt-conn->rcvRead);
+    ncclXdpIovCopy(iov, iovcnt, *offset, conn->rxBuf+pos, len, 1);
+    conn->rcvRead += len;
+    *offset += len;
+  }
+  // Tell the sender about the room we made
+  if (conn->rcvRead-conn->ackedRead >= XDP_RECV_BUFFER/4) ncclXdpAckNeeded(conn);
+}
+
+ncclResult_t ncclXdpConnProgressIov(struct ncclXdpConn* conn, int op, const struct iovec* iov, int iovcnt, int* offset) {
+  struct ncclXdpDev* dev = conn->dev;
+  int total = 0;
+  for (int i=0; i<iovcnt; i++) total += iov[i].iov_len;
+  pthread_mutex_lock(&dev->lock);
+  ncclXdpProgress(dev);
+  if (op == NCCL_SOCKET_SEND) {
+    ncclXdpConnSend(conn, iov, iovcnt, total, offset);
+  } else {
+    ncclXdpConnRecv(conn, iov, iovcnt, total, offset);
+    ncclXdpSendAcks(dev);
+  }
+  ncclXdpKick(dev);
+  pthread_mutex_unlock(&dev->lock);
+  return ncclSuccess;
+}
+
+uint64_t ncclXdpConnSent(struct ncclXdpConn* conn) {
+  return conn->sndNxt;
+}
+
+ncclResult_t ncclXdpConnAcked(struct ncclXdpConn* conn, uint64_t end, int* done) {
+  pthread_mutex_lock(&conn->dev->lock);
+  ncclXdpProgress(conn->dev);
+  *done = conn->sndUna >= end;
+  pthread_mutex_unlock(&conn->dev->lock);
+  return ncclSuccess;
+}
+
+ncclResult_t ncclXdpConnClose(struct ncclXdpConn* conn) {
+  struct ncclXdpDev* dev = conn->dev;
+  pthread_mutex_lock(&dev->lock);
+  dev->conns[conn->id % XDP_MAX_CONNS] = NULL;
+  int n = 0;
+  for (int i=0; i<dev->nAcks; i++) if (dev->ackList[i] != conn) dev->ackList[n++] = dev->ackList[i];
+  dev->nAcks = n;
+  for (uint32_t i=conn->sentHead; i!=conn->sentTail; i++) ncclXdpFrameRelease(dev, conn->sent[i%XDP_MAX_INFLIGHT].addr);
+  pthread_mutex_unlock(&dev->lock);
+  free(conn->rxBuf);
+  free(conn);
+  return ncclSuccess;
+}
@@ -13,6 +13,8 @@
 #define ENABLE_TIMER 0
 #include "timer.h"
 #include "transport.h"
+#include "trace.h"
+#include "spinwait.h"
 
 #include <sys/syscall.h>
 #include <assert.h>
@@ -635,11 +637,9 @@ static ncclResult_t removeOp(struct ncclProxyProgressState* state, struct ncclPr
 static ncclResult_t progressOps(struct ncclProxyState* proxyState, struct ncclProxyProgressState* state, struct ncclProxyArgs* opStart, int* idle) {
   struct ncclProxyArgs* prevOp = NULL;
   struct ncclProxyArgs* op = opStart;
-  //int while_counter = 0;
   while (op) {
     if (op->state == ncclProxyOpNone) return ncclInternalError;
     TIME_START(0); TIME_START(1);
-    //INFO(NCCL_ALL, "XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX proxy.cc progressOps iteration : %d",while_counter++);
     //call recvProxyProgress sendProxyProgress (in transport/net.cc)
     NCCLCHECK(op->progress(proxyState, op));    //args->progress = op->connection->tcomm->proxyProgress
     if (op->idle) { TIME_STOP(1); TIME_CANCEL(0); } else { TIME_CANCEL(1); TIME_STOP(0); }
@@ -789,11 +789,30 @@ static int setProxyThreadContext(struct ncclProxyState* proxyState) {
 // Set to SIGUSR1 or SIGUSR2 to help debug proxy state during hangs
 NCCL_PARAM(ProxyDumpSignal, "PROXY_DUMP_SIGNAL", -1);
 NCCL_PARAM(ProgressAppendOpFreq, "PROGRESS_APPENDOP_FREQ", 8);
+// Once done spinning, an idle progress thread with operations in flight sleeps for up to this
+// long, or until new operations are posted. 0 only yields the CPU.
+NCCL_PARAM(ProxyParkNs, "PROXY_PARK_NS", 0);
+
+static void ncclProxyPark(struct ncclProxyProgressState* state) {
+  int64_t parkNs = ncclParamProxyParkNs();
+  struct ncclProxyOpsPool* pool = state->opsPool;
+  if (parkNs <= 0) {
+    sched_yield();
+    return;
+  }
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  uint64_t ns = ts.tv_nsec + parkNs;
+  ts.tv_sec += ns / 1000000000;
+  ts.tv_nsec = ns % 1000000000;
+  pthread_mutex_lock(&pool->mutex);
+  if (pool->nextOps == -1 && !state->stop) pthread_cond_timedwait(&pool->cond, &pool->mutex, &ts);
+  pthread_mutex_unlock(&pool->mutex);
+}
 
 
 void* ncclProxyProgress(void *proxyState_) {
   // in our scenario it is called once (then there is a while loop!!)
-  INFO(NCCL_ALL,"OOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOO ncclProxyProgress");
   struct ncclProxyState* proxyState = (struct ncclProxyState*)proxyState_;
   if (setProxyThreadContext(proxyState)) {
     INFO(NCCL_INIT, "[Proxy Progress] Created CUDA context on device %d", proxyState->cudaDev);
@@ -819,10 +838,11 @@ void* ncclProxyProgress(void *proxyState_) {
    * frequency of calling ncclProxyGetPostedOps() and reduce the perf impact. */
   int proxyOpAppendCounter = 0;
   struct ncclProxyArgs profArgs; // Only used for profiling purposes
+  struct ncclSpinWait spin;
+  ncclSpinWaitInit(&spin);
   while ((state->stop == 0 || (state->stop == 1 && state->active)) &&
          __atomic_load_n(proxyState->abortFlag, __ATOMIC_ACQUIRE) == 0) {
     int idle = 1;
-    //INFO(NCCL_ALL,"QQQQQQQQQQQQQQQQQQQQQQQQQQQQQQQQQQQQQQ ncclProxyProgress while");
     ncclResult_t ret = progressOps(proxyState, state, state->active, &idle);
     if (ret != ncclSuccess) {
       __atomic_store_n(&proxyState->asyncResult, ret, __ATOMIC_RELEASE);
@@ -831,30 +851,35 @@ void* ncclProxyProgress(void *proxyState_) {
     }
     if (lastIdle == 0 && idle == 1) ncclProfilingRecord(&profArgs, 0, 0, ncclProxyProfileIdle);
     if (lastIdle == 1 && idle == 0) ncclProfilingRecord(&profArgs, 0, 0, ncclProxyProfileActive);
+    int added = 0;
     if (idle || (++proxyOpAppendCounter == ncclParamProgressAppendOpFreq())) {
-      int added = 0;
       proxyOpAppendCounter = 0;
+      enum ncclSpinWaitStage stage = idle ? ncclSpinWaitIdle(&spin) : ncclSpinWaitSpin;
+      // With nothing in flight, ncclProxyGetPostedOps sleeps until operations are posted; keep
+      // polling the pool instead while spinning.
+      int spinning = stage == ncclSpinWaitSpin && state->active == NULL && state->nextOps == -1 && state->opsPool->nextOps == -1;
       TIME_START(3);
-      if (state->stop == 0)
+      if (state->stop == 0 && !spinning)
         ret = ncclProxyGetPostedOps(proxyState, &added);
       if (added) { TIME_STOP(3); } else { TIME_CANCEL(3); }
       if (ret != ncclSuccess) {
         __atomic_store_n(&proxyState->asyncResult, ret, __ATOMIC_RELEASE);
         INFO(NCCL_ALL,"%s:%d -> %d [Progress Thread]", __FILE__, __LINE__, ret);
       }
-      if (added == 0) {
-        sched_yield(); // No request progressed. Let others run.
+      if (added == 0 && stage == ncclSpinWaitPark) {
+        ncclProxyPark(state); // No request progressed. Let others run.
       }
     }
+    if (idle == 0 || added) ncclSpinWaitBusy(&spin);
     lastIdle = idle;
   }
-  INFO(NCCL_ALL,"OOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOO ncclProxyProgress return");
+  ncclSpinWaitReport(&spin, NCCL_PROXY, "[Proxy Progress]");
   return NULL;
 }
 
 ncclResult_t ncclProxyStart(struct ncclComm* comm) {
   struct ncclProxyOps* proxyOps = comm->proxyState->proxyOps;
-  INFO(NCCL_ALL, "---- ncclProxyStart");
+  NCCL_TRACEPOINT(NCCL_PROXY, ncclTraceProxyStart, comm->rank, proxyOps != NULL, 0);
   if (proxyOps == NULL) return ncclSuccess;
   TIME_START(1);
   for (int r = 0; r < comm->sharedRes->tpNLocalRanks; r++) {
@@ -872,7 +897,6 @@ ncclResult_t ncclProxyStart(struct ncclComm* comm) {
 static ncclResult_t ncclProxyProgressCreate(struct ncclProxyState* proxyState) {
   struct ncclProxyProgressState* state = &proxyState->progressState;
   if (!state->thread) {
-    INFO(NCCL_ALL,"OOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOO ncclProxyProgressCreate");
     // creates the thread for proxy communication (used in our scenario)
     pthread_create(&state->thread, NULL, ncclProxyProgress, proxyState);
     ncclSetThreadName(state->thread, "NCCL Progress%2d", proxyState->tpLocalnRanks);
@@ -914,7 +938,6 @@ struct ncclProxyConnectionPool {
 };
 
 static ncclResult_t ncclProxyNewConnection(struct ncclProxyConnectionPool* pool, int* id) {
-  INFO(NCCL_ALL, "---- ncclProxyNewConnection");
   if (pool->offset == NCCL_PROXY_CONN_POOL_SIZE) {
     NCCLCHECK(ncclRealloc(&pool->pools, pool->banks, pool->banks+1));
     NCCLCHECK(ncclCalloc(pool->pools+pool->banks, NCCL_PROXY_CONN_POOL_SIZE));
@@ -929,7 +952,6 @@ static ncclResult_t ncclProxyNewConnection(struct ncclProxyConnectionPool* pool,
 static ncclResult_t ncclProxyGetConnection(struct ncclProxyConnectionPool* pool, int id, struct ncclProxyConnection** conn) {
   int bank = id>>NCCL_PROXY_CONN_POOL_SIZE_POW2;
   int offset = id&NCCL_PROXY_CONN_POOL_MASK;
-  INFO(NCCL_ALL, "---- ncclProxyGetConnection");
   if ((pool->pools == NULL) || (bank > pool->banks) || (pool->pools[bank] == NULL)) return ncclInternalError;
   *conn = pool->pools[bank]+offset;
   return ncclSuccess;
@@ -1034,14 +1056,13 @@ ncclResult_t ncclProxyConnect(struct ncclComm* comm, int transport, int send, in
     strncpy(poolPath+sizeof("/dev/shm/nccl-")-1, resp.devShmPath, sizeof("XXXXXX")-1);
     struct ncclProxyOps* proxyOps = sharedProxyState->proxyOps + proxyConn->tpLocalRank;
 
-    //we pass here (5 times)
-    INFO(NCCL_ALL,"XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX ncclProxyConnect");
+    TRACE(NCCL_PROXY, "ncclProxyConnect localRank %d: setting up proxy ops pool", proxyConn->tpLocalRank);
     if (proxyOps->pool == NULL) {
       NCCLCHECK(ncclShmOpen(poolPath, sizeof(struct ncclProxyOpsPool), (void**)(&proxyOps->pool), NULL, -1, &proxyOps->handle));
       proxyOps->nextOps = proxyOps->nextOpsEnd = proxyOps->freeOp = -1;
     }
   }
-  INFO(NCCL_ALL|NCCL_PROXY, "Connected to proxy localRank %d -> connection %p", proxyConn->tpLocalRank, proxyConn->connection);
+  INFO(NCCL_PROXY, "Connected to proxy localRank %d -> connection %p", proxyConn->tpLocalRank, proxyConn->connection);
   return ncclSuccess;
 }
 
@@ -1105,9 +1126,7 @@ error:
 
 const char* ncclProxyMsgTypeStr[] = { "Unknown", "Init", "SharedInit", "Setup", "Connect", "Start", "Close", "Abort", "Stop", "GetFd" };
 ncclResult_t ncclProxyCallAsync(struct ncclComm* comm, struct ncclProxyConnector* proxyConn, int type, void* reqBuff, int reqSize, int respSize, void* opId) {
-  
-  INFO(NCCL_ALL,"XXXXXXXXXXXXXXXXXXXXXXXX ncclProxyCallAsync");
-  
+  TRACE(NCCL_PROXY, "ncclProxyCallAsync type=%d opId=%p reqSize=%d respSize=%d", type, opId, reqSize, respSize);
   struct ncclSocket* sock;
   ncclResult_t ret = ncclSuccess;
   struct ncclProxyState* sharedProxyState = comm->proxyState;
@@ -1137,7 +1156,6 @@ error:
 // called multiple times (~10000) during the setup phase
 ncclResult_t ncclPollProxyResponse(struct ncclComm* comm, struct ncclProxyConnector* proxyConn, void* respBuff, void* opId) {
   
-  //INFO(NCCL_ALL,"XXXXXXXXXXXX ncclPollProxyResponse");
   struct ncclProxyState* sharedProxyState = comm->proxyState;
   // Receive the connection pointer from the Proxy
   if (__atomic_load_n(comm->abortFlag, __ATOMIC_ACQUIRE)) {
@@ -1154,7 +1172,6 @@ ncclResult_t ncclPollProxyResponse(struct ncclComm* comm, struct ncclProxyConnec
     struct ncclSocket* sock = sharedProxyState->peerSocks + proxyConn->tpLocalRank;
     ncclProxyRpcResponseHeader resp = {0};
     int offset = 0;
-    //INFO(NCCL_ALL,"XXXXXXXXXXXXXXXXXXXXXXXXX ncclPollProxyResponse Attempt to read in a new response");
     if (ncclSuccess != ncclSocketProgress(NCCL_SOCKET_RECV, sock, &resp, sizeof(resp), &offset)) {
       WARN("Socket recv failed while polling for opId=%p", opId);
       return ncclInternalError;
@@ -1165,7 +1182,6 @@ ncclResult_t ncclPollProxyResponse(struct ncclComm* comm, struct ncclProxyConnec
     // If we've returned a partial response, block to receive the rest of it
     } else if (offset < sizeof(resp)) {
       while (offset < sizeof(resp)) {
-        //INFO(NCCL_ALL,"XXXXXXXXXXXXXXXXXXXXXXXXX ncclPollProxyResponse returned a partial response");
         NCCLCHECK(ncclSocketProgress(NCCL_SOCKET_RECV, sock, &resp, sizeof(resp), &offset));
       }
         
@@ -1201,8 +1217,7 @@ ncclResult_t ncclPollProxyResponse(struct ncclComm* comm, struct ncclProxyConnec
 }
 
 ncclResult_t ncclProxyCallBlocking(struct ncclComm* comm, struct ncclProxyConnector* proxyConn, int type, void* reqBuff, int reqSize, void* respBuff, int respSize) {
-  
-  INFO(NCCL_ALL,"XXXXXXXXXXXXXXXXXXXXXXXX ncclProxyCallBlocking");
+  TRACE(NCCL_PROXY, "ncclProxyCallBlocking type=%d reqSize=%d respSize=%d", type, reqSize, respSize);
   // Alloc some memory to act as a handle
   ncclResult_t res = ncclSuccess;
   void* opId = malloc(1);
@@ -1221,9 +1236,6 @@ fail:
 }
 
 static ncclResult_t proxyProgressInit(struct ncclProxyState* proxyState) {
-
-  INFO(NCCL_ALL,"XXXXXXXXXXXXXXXXXXXXXXXX proxyProgressInit");
-  
   struct ncclProxyProgressState* state = &proxyState->progressState;
   if (state->opsPool == NULL) {
     int size = sizeof(struct ncclProxyOpsPool);
@@ -1247,7 +1259,10 @@ static ncclResult_t proxyProgressInit(struct ncclProxyState* proxyState) {
     pthread_mutexattr_setpshared(&mutexAttr, PTHREAD_PROCESS_SHARED);
     pthread_mutex_init(&pool->mutex, &mutexAttr);
     pthread_condattr_t condAttr;
+    pthread_condattr_init(&condAttr);
     pthread_condattr_setpshared(&condAttr, PTHREAD_PROCESS_SHARED);
+    // Parking the progress thread waits on the cond with a CLOCK_MONOTONIC deadline
+    pthread_condattr_setclock(&condAttr, CLOCK_MONOTONIC);
     pthread_cond_init(&pool->cond, &condAttr);
     state->opsPool = pool;
 
@@ -1329,13 +1344,10 @@ error:
 #endif
 }
 
-int mycounter_proxyProgressAsync=0;
 
 static ncclResult_t proxyProgressAsync(struct ncclProxyAsyncOp* op, struct ncclProxyState* proxyState, int* asyncOpCount, struct ncclProxyLocalPeer* peer, struct ncclProxyConnectionPool* connectionPool) {
 
-  if ((mycounter_proxyProgressAsync++ % 200) == 0) {
-    INFO(NCCL_ALL,"proxyProgressAsync counter : %d",mycounter_proxyProgressAsync);  
-  }
+  NCCL_TRACEPOINT(NCCL_PROXY, ncclTraceProxyProgressAsync, op->type, *asyncOpCount, 0);
 
   int done = 1;
   ncclResult_t res = ncclInternalError;
@@ -1352,7 +1364,6 @@ static ncclResult_t proxyProgressAsync(struct ncclProxyAsyncOp* op, struct ncclP
     __atomic_store_n(&op->connection->state, connSharedInitialized, __ATOMIC_RELEASE);
   }
   else if (op->type == ncclProxyMsgInit) {
-    INFO(NCCL_ALL, "proxyProgressAsync::ncclProxyMsgInit opId=%p op.reqBuff=%p", op->opId, op->reqBuff);
     TRACE(NCCL_PROXY, "proxyProgressAsync::ncclProxyMsgInit opId=%p op.reqBuff=%p", op->opId, op->reqBuff);
     res = proxyConnInit(peer, connectionPool, proxyState, (ncclProxyInitReq*) op->reqBuff, (ncclProxyInitResp*) op->respBuff, &op->connection);
   } else if (op->type == ncclProxyMsgRegister) {
@@ -1418,7 +1429,6 @@ static ncclResult_t proxyServiceInitOp(int type, struct ncclProxyLocalPeer* peer
   asyncProxyOpEnqueue(peer, asyncOp);
 
   (*asyncOpCount)++;
-  INFO(NCCL_ALL,"proxyServiceInitOp -> proxyProgressAsync");
   NCCLCHECK(proxyProgressAsync(asyncOp, proxyState, asyncOpCount, peer, connectionPool));
   return ncclSuccess;
 }
@@ -1443,10 +1453,9 @@ static bool proxyMatchOpType(int type) {
 // proxy service, it is created during the initialization phase by ncclProxyCreate
 void* ncclProxyService(void* _args) {
   struct ncclProxyState* proxyState =  (struct ncclProxyState*) _args;
-  INFO(NCCL_ALL, "ncclProxyService first line");
   // if (CPU_COUNT(&comm->cpuAffinity)) sched_setaffinity(0, sizeof(cpu_set_t), &comm->cpuAffinity);
   if (setProxyThreadContext(proxyState)) {
-    INFO(NCCL_ALL, "ncclProxyService [Proxy Service] Created CUDA context on device %d", proxyState->cudaDev);
+    INFO(NCCL_INIT, "[Proxy Service] Created CUDA context on device %d", proxyState->cudaDev);
   } else if (cudaSetDevice(proxyState->cudaDev) != cudaSuccess) {
     WARN("[Proxy Service] Failed to set CUDA device %d", proxyState->cudaDev);
   }
@@ -1555,14 +1564,13 @@ void* ncclProxyService(void* _args) {
           } else if (type == ncclProxyMsgClose) {
             closeConn = 1;
           } else if (proxyMatchOpType(type)) {
-            INFO(NCCL_ALL, "ncclProxyService -> proxyServiceInitOp");
             res = proxyServiceInitOp(type, peers+s, &connectionPool, proxyState, &asyncOpCount);
           } else {
             WARN("[Service thread] Unknown command %d from localRank %d", type, peer->tpLocalRank);
             closeConn = 1;
           }
 
-          INFO(NCCL_ALL, "Received and initiated operation=%s res=%d", ncclProxyMsgTypeStr[type], res);
+          TRACE(NCCL_PROXY, "Received and initiated operation=%s res=%d", ncclProxyMsgTypeStr[type], res);
         }
       } else if (pollfds[s].revents & POLLHUP) {
         closeConn = 1;
@@ -1692,7 +1700,6 @@ ncclResult_t ncclProxyCreate(struct ncclComm* comm) {
 
     pthread_create(&comm->proxyState->thread, NULL, ncclProxyService, comm->proxyState);
     ncclSetThreadName(comm->proxyState->thread, "NCCL Service %2d", comm->cudaDev);
-    INFO(NCCL_ALL, "ncclProxyCreate -> thread: ncclProxyService, name : NCCL Service %2d", comm->cudaDev);
 
     // UDS support
     // User Defined Service
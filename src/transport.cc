@@ -45,8 +45,6 @@ static ncclResult_t selectTransport(struct ncclComm* comm, struct ncclTopoGraph*
 // only sets the intent to connect, then the connections are created in ncclTransportP2pSetup
 ncclResult_t ncclTransportP2pConnect(struct ncclComm* comm, int channelId, int nrecv, int* peerRecv, int nsend, int* peerSend, int connIndex) {
   TRACE(NCCL_INIT, "nsend %d nrecv %d", nsend, nrecv);
-  INFO(NCCL_ALL,"ncclTransportP2pConnect : nsend %d nrecv %d channelId %d peerRecv[0] %d peerSend[0] %d", 
-                                            nsend, nrecv, channelId, peerRecv[0], peerSend[0]);
   struct ncclChannel* channel = &comm->channels[channelId];
   uint64_t mask = 1UL << channel->id;
   for (int i=0; i<nrecv; i++) {
@@ -78,8 +76,6 @@ NCCL_PARAM(ReportConnectProgress, "REPORT_CONNECT_PROGRESS", 1);
 
 // opens the connections, waits and connects
 ncclResult_t ncclTransportP2pSetup(struct ncclComm* comm, struct ncclTopoGraph* graph, int connIndex, int* highestTransportType/*=NULL*/) {
-  INFO(NCCL_ALL,"ncclTransportP2pSetup ----------------START------------------------>");
-  
   // Stream used during transport setup; need for P2P pre-connect + CUDA Graph
   ncclResult_t ret = ncclSuccess;
   int highestType = TRANSPORT_UNDEFINED;  // track highest transport type
@@ -120,9 +116,7 @@ ncclResult_t ncclTransportP2pSetup(struct ncclComm* comm, struct ncclTopoGraph*
     TIME_START(0);
     for (int c=0; c<MAXCHANNELS; c++) {
       if (recvMask & (1UL<<c)) {
-        INFO(NCCL_ALL,"ncclTransportP2pSetup BEFORE selectTransport (recv) channel : %d",c);
         NCCLCHECKGOTO(selectTransport<0>(comm, graph, recvData[p]+recvChannels++, c, recvPeer, connIndex, &type), ret, fail);
-        INFO(NCCL_ALL,"ncclTransportP2pSetup AFTER selectTransport (recv) channel : %d",c);
         if (type > highestType) highestType = type;
       }
     }
@@ -131,9 +125,7 @@ ncclResult_t ncclTransportP2pSetup(struct ncclComm* comm, struct ncclTopoGraph*
     sendData[p] = recvData[p]+recvChannels;
     for (int c=0; c<MAXCHANNELS; c++) {
       if (sendMask & (1UL<<c)) {
-        INFO(NCCL_ALL,"ncclTransportP2pSetup BEFORE selectTransport (send) channel : %d",c);
         NCCLCHECKGOTO(selectTransport<1>(comm, graph, sendData[p]+sendChannels++, c, sendPeer, connIndex, &type), ret, fail);
-        INFO(NCCL_ALL,"ncclTransportP2pSetup AFTER selectTransport (send) channel : %d",c);
         if (type > highestType) highestType = type;
       }
     }
@@ -142,14 +134,12 @@ ncclResult_t ncclTransportP2pSetup(struct ncclComm* comm, struct ncclTopoGraph*
     TIME_START(2);
     if (sendPeer == recvPeer) {
       if (recvChannels+sendChannels) {
-        INFO(NCCL_ALL,"ncclTransportP2pSetup :::::: sendPeer == recvPeer : %d",sendPeer);
         NCCLCHECKGOTO(bootstrapSend(comm->bootstrap, recvPeer, bootstrapTag, data[p], sizeof(struct ncclConnect)*(recvChannels+sendChannels)), ret, fail);
         NCCLCHECKGOTO(bootstrapRecv(comm->bootstrap, recvPeer, bootstrapTag, data[p], sizeof(struct ncclConnect)*(recvChannels+sendChannels)), ret, fail);
         sendData[p] = data[p];
         recvData[p] = data[p]+sendChannels;
       }
     } else {
-      INFO(NCCL_ALL,"ncclTransportP2pSetup :::::: sendPeer : % d recvPeer : %d",sendPeer, recvPeer);
       if (recvChannels) NCCLCHECKGOTO(bootstrapSend(comm->bootstrap, recvPeer, bootstrapTag, recvData[p], sizeof(struct ncclConnect)*recvChannels), ret, fail);
       if (sendChannels) NCCLCHECKGOTO(bootstrapSend(comm->bootstrap, sendPeer, bootstrapTag, sendData[p], sizeof(struct ncclConnect)*sendChannels), ret, fail);
       if (sendChannels) NCCLCHECKGOTO(bootstrapRecv(comm->bootstrap, sendPeer, bootstrapTag, sendData[p], sizeof(struct ncclConnect)*sendChannels), ret, fail);
@@ -182,8 +172,7 @@ ncclResult_t ncclTransportP2pSetup(struct ncclComm* comm, struct ncclTopoGraph*
                 if (ret == ncclSuccess) {
                   conn->connected = 1;
                   strcpy(conn->conn.hostname,getAddressOfStaticHostname()); //STEFANO
-                  INFO(NCCL_ALL,"conn->conn.hostname %s",conn->conn.hostname);
-                  //INFO(NCCL_ALL,"comm->channels[c].devPeers[sendPeer]->send[connIndex] %p",&comm->channels[c].devPeers[sendPeer]->send[connIndex]);
+                  TRACE(NCCL_INIT, "Channel %02d : send to rank %d connected from %s", c, sendPeer, conn->conn.hostname);
                   /* comm->channels[c].devPeers[sendPeer]->send[connIndex] is a device memory access. */
                   CUDACHECKGOTO(cudaMemcpyAsync(&comm->channels[c].devPeersHostPtr[sendPeer]->send[connIndex], &conn->conn, 
                                    sizeof(struct ncclConnInfo), cudaMemcpyHostToDevice, comm->sharedRes->hostStream.cudaStream), ret, fail);
@@ -204,7 +193,7 @@ ncclResult_t ncclTransportP2pSetup(struct ncclComm* comm, struct ncclTopoGraph*
                 if (ret == ncclSuccess) {
                   conn->connected = 1;
                   strcpy(conn->conn.hostname,getAddressOfStaticHostname()); //STEFANO
-                  INFO(NCCL_ALL,"conn->conn.hostname %s",conn->conn.hostname);
+                  TRACE(NCCL_INIT, "Channel %02d : receive from rank %d connected from %s", c, recvPeer, conn->conn.hostname);
                   /* comm->channels[c].devPeers[recvPeer]->recv[connIndex] is a device memory access. */
                   CUDACHECKGOTO(cudaMemcpyAsync(&comm->channels[c].devPeersHostPtr[recvPeer]->recv[connIndex], &conn->conn, 
                                         sizeof(struct ncclConnInfo), cudaMemcpyHostToDevice, comm->sharedRes->hostStream.cudaStream),
@@ -310,7 +299,6 @@ int ncclTransportCollNetSetup(struct ncclComm* comm, struct ncclTopoGraph* collN
   peerInfo->rank = nranks;
 
   if (isMaster && type == collNetSend) {
-    INFO(NCCL_ALL, "ncclTransportCollNetSetup CollNet [send] : rank %d collNetRank %d collNetNranks %d received connect from rank %d", rank, comm->node, nMasters, masterPeer);
     TRACE(NCCL_INIT, "CollNet [send] : rank %d collNetRank %d collNetNranks %d received connect from rank %d", rank, comm->node, nMasters, masterPeer);
   }
 
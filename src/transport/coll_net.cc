@@ -336,7 +336,6 @@ static ncclResult_t sharedListen(struct ncclProxyState* proxyState, int netDev,
     collNet->resources = resources;
   }
   if (resources->collNetComms[netDev] == NULL){
-    INFO(NCCL_ALL, "---- sendProxySetup -> listen");
     NCCLCHECK(proxyState->ncclCollNet->listen(netDev, collNetHandle, resources->collNetListenComms + netDev));
   }
     
@@ -440,7 +439,6 @@ static ncclResult_t recvProxySetup(struct ncclProxyConnection* connection, struc
   collNetHandle_t* netHandle = (collNetHandle_t*) respBuff;
   if (respSize != sizeof(collNetHandle_t)) return ncclInternalError;
 
-  INFO(NCCL_ALL, "---- (coll_net.cc) recvProxySetup -> sharedListen");
   //apparently not used in our scenario
   NCCLCHECK(sharedListen(proxyState, req->netDev, req->collNet, netHandle));
   return ncclSuccess;
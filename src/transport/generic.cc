@@ -9,7 +9,6 @@ ncclResult_t ncclTransportRingConnect(struct ncclComm* comm) {
       NCCLCHECKGOTO(ncclTransportP2pConnect(comm, c, 1, &channel->ring.prev, 1, &channel->ring.next, 0), ret, fail);
     }
     NCCLCHECKGOTO(ncclTransportP2pSetup(comm, &comm->graphs[NCCL_ALGO_RING], 0), ret, fail);
-    INFO(NCCL_ALL,"ncclTransportP2pSetup ----------------DONE ncclTransportRingConnect------------------------>");
     INFO(NCCL_INIT, "Connected all rings");
   }
 exit:
@@ -19,7 +18,6 @@ fail:
 }
 
 ncclResult_t ncclTransportTreeConnect(struct ncclComm* comm) {
-  INFO(NCCL_ALL,"ncclTransportTreeConnect");
   ncclResult_t ret = ncclSuccess;
   if (comm && comm->nRanks > 1) {
     // Connect Trees
@@ -29,7 +27,6 @@ ncclResult_t ncclTransportTreeConnect(struct ncclComm* comm) {
       NCCLCHECKGOTO(ncclTransportP2pConnect(comm, c, 1, &channel->tree.up, NCCL_MAX_TREE_ARITY, channel->tree.down, 0), ret, fail);
     }
     NCCLCHECKGOTO(ncclTransportP2pSetup(comm, &comm->graphs[NCCL_ALGO_TREE], 0), ret, fail);
-    INFO(NCCL_ALL,"ncclTransportP2pSetup ----------------DONE ncclTransportTreeConnect------------------------>");
     INFO(NCCL_INIT, "Connected all trees");
   }
 exit:
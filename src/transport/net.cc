@@ -14,6 +14,7 @@
 #include "p2p.h"
 #include "profiler.h"
 #include "transport.h"
+#include "trace.h"
 
 static_assert(sizeof(ncclNetHandle_t) <= CONNECT_SIZE, "NET Connect info is too large");
 
@@ -175,7 +176,7 @@ static ncclResult_t sendSetup(struct ncclComm* comm, struct ncclTopoGraph* graph
                               struct ncclPeerInfo* peerInfo, struct ncclConnect* connectInfo, 
                               struct ncclConnector* send, int channelId, int connIndex) {
 
-  INFO(NCCL_ALL, "sendSetup channelId %d connIndex %d", channelId, connIndex);
+  TRACE(NCCL_NET, "sendSetup channelId %d connIndex %d", channelId, connIndex);
   struct setupReq req = { 0 };
   int tpProxyRank;
 
@@ -217,7 +218,7 @@ static ncclResult_t recvSetup(struct ncclComm* comm, struct ncclTopoGraph* graph
                               struct ncclPeerInfo* peerInfo, struct ncclConnect* connectInfo,
                               struct ncclConnector* recv, int channelId, int connIndex) {
   
-  INFO(NCCL_ALL, "sendSetup channelId %d connIndex %d", channelId, connIndex);
+  TRACE(NCCL_NET, "recvSetup channelId %d connIndex %d", channelId, connIndex);
   struct setupReq req = { 0 };
 
   recv->conn.shared = req.shared = graph ? 0 : ncclParamNetSharedBuffers() != -2 ? ncclParamNetSharedBuffers() : 1;
@@ -586,7 +587,6 @@ static ncclResult_t sendProxySetup(struct ncclProxyConnection* connection, struc
   struct setupReq* req = (struct setupReq*) reqBuff;
   if (reqSize != sizeof(struct setupReq)) return ncclInternalError;
 
-  INFO(NCCL_ALL, "---- (net.cc) sendProxySetup");
   struct sendNetResources* resources;
   NCCLCHECK(ncclCalloc(&resources, 1));
   connection->transportResources = resources;
@@ -643,7 +643,6 @@ static ncclResult_t recvProxySetup(struct ncclProxyConnection* connection, struc
   resources->netDeviceType = props.netDeviceType;
 
   if (respSize != sizeof(ncclNetHandle_t)) return ncclInternalError;
-  INFO(NCCL_ALL, "---- (net.cc) recvProxySetup -> listen");
   NCCLCHECK(proxyState->ncclNet->listen(req->netDev, respBuff, &resources->netListenComm));
   *done = 1;
 
@@ -681,7 +680,6 @@ static ncclResult_t sendProxyConnect(struct ncclProxyConnection* connection, str
   if (resources->shared) {
     // Shared buffers
     
-    INFO(NCCL_ALL, "---- sendProxyConnect (shared buffers)");
     struct ncclProxyProgressState* progressState = &proxyState->progressState;
     if (progressState->localPeers == NULL) {
       NCCLCHECK(ncclCalloc(&progressState->localPeers, proxyState->tpLocalnRanks));
@@ -694,7 +692,6 @@ static ncclResult_t sendProxyConnect(struct ncclProxyConnection* connection, str
 
     if (resources->maxRecvs > 1 && ncclParamNetSharedComms()) {
       // Connect or reuse connection for a netdev/remote rank.
-      INFO(NCCL_ALL, "---- sendProxyConnect (connect or reuse connection for a netdev/remote rank)");
       if (progressState->netComms[resources->netDev] == NULL) {
         NCCLCHECK(ncclCalloc(progressState->netComms + resources->netDev, proxyState->tpnRanks));
       }
@@ -703,12 +700,10 @@ static ncclResult_t sendProxyConnect(struct ncclProxyConnection* connection, str
       resources->netSendComm = comms->sendComm[resources->channelId];
       if (comms->sendComm[resources->channelId]) comms->sendRefCount[resources->channelId]++;
     } else {
-      INFO(NCCL_ALL, "---- sendProxyConnect (ELSE wrt connect or reuse connection for a netdev/remote rank)");
       ret = proxyState->ncclNet->connect(resources->netDev, req->handle, &resources->netSendComm, &resources->netDeviceHandle);
     }
   } else {
     // Connect to remote peer
-    INFO(NCCL_ALL, "---- sendProxyConnect (connect to remote peer)");
     ret = proxyState->ncclNet->connect(resources->netDev, req->handle, &resources->netSendComm, &resources->netDeviceHandle);
     connection->proxyAppendPtr = &connection->proxyAppend;
   }
@@ -1060,16 +1055,11 @@ static_assert(NCCL_STEPS <= NCCL_NET_MAX_REQUESTS, "Not enough net requests to c
 
 
 
-int mycounter_send =0;
 // in this function we are receiving data from the GPU and we are sending the data in a channel/socket
 
 static ncclResult_t sendProxyProgress(struct ncclProxyState* proxyState, struct ncclProxyArgs* args) {
   
-  //INFO(NCCL_ALL,"########################################## sendProxyProgress");
-  //INFO(NCCL_ALL,"OOOOOOOOOOOOOO sendProxyProgress counter : %d",mycounter_send++);
-  if ((mycounter_send++ % 100) == 0) {
-    INFO(NCCL_ALL,"sendProxyProgress counter : %d",mycounter_send);  
-  }
+  NCCL_TRACEPOINT(NCCL_PROXY, ncclTraceSendProxyProgress, args->state, args->nsubs, args->idle);
   if (args->state == ncclProxyOpReady) {
     for (int s=0; s<args->nsubs; s++) {
       struct ncclProxySubArgs* sub = args->subs+s;
@@ -1129,7 +1119,6 @@ static ncclResult_t sendProxyProgress(struct ncclProxyState* proxyState, struct
         uint64_t tail = sub->base + (sub->reg ? 0 : sub->transmitted);
         if ((sub->reg || connFifo[buffSlot].size != -1) && ((*recvTail > tail) || p == NCCL_PROTO_LL)) {
           // We have something to receive, let's check if it's completely ready.
-          //INFO(NCCL_ALL,"OOOOOOOOOOOOOO sendProxyProgress something to receive");
           int size = sub->reg ? std::min(MAX_NET_SIZE, sub->nbytes) : connFifo[buffSlot].size;
           bool shared = (p == NCCL_PROTO_SIMPLE) && resources->shared;
           char* buff = shared ? localBuff+connFifo[buffSlot].offset : localBuff+buffSlot*stepSize;
@@ -1148,9 +1137,6 @@ static ncclResult_t sendProxyProgress(struct ncclProxyState* proxyState, struct
               }
             }
           } else if (p == NCCL_PROTO_LL) {
-            if ((mycounter_send % 100) == 0) {
-              //INFO(NCCL_ALL,"OOOOOOOOOOOOOO sendProxyProgress something to receive NCCL_PROTO_LL");
-            }
             uint32_t flag = NCCL_LL_FLAG(sub->base+sub->transmitted+1);
             int nFifoLines = DIVUP(size, sizeof(union ncclLLFifoLine));
             union ncclLLFifoLine* lines = (union ncclLLFifoLine*)buff;
@@ -1163,15 +1149,12 @@ static ncclResult_t sendProxyProgress(struct ncclProxyState* proxyState, struct
             buff = sub->reg ? (char*)sub->recvbuff : localBuff+resources->recvMem->connFifo[buffSlot].offset;
           }
           if (ready) {
-            //INFO(NCCL_ALL,"OOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOOO ");
             // Data is ready, try to send.
 
             //proxyState->ncclNet->isend is implemented by ncclNetSocketIsend in net_socket.cc
-            INFO(NCCL_ALL,"##################### sendProxyProgress isend operation");
             NCCLCHECK(proxyState->ncclNet->isend(resources->netSendComm, buff, size, resources->tpRank, sub->mhandle, sub->requests+buffSlot));
             if (sub->requests[buffSlot] != NULL) {
-              INFO(NCCL_ALL, "sendProxyProgress ready sendProxy [%ld/%d] Isend posted, req %p, size %d, proto %d, myRank %d, channelId %d",
-                      sub->transmitted, buffSlot, sub->requests[buffSlot], size, p, proxyState->tpRank, sub->channelId);
+              NCCL_TRACEPOINT(NCCL_NET, ncclTraceSendPosted, sub->transmitted, buffSlot, size);
               TRACE(NCCL_NET, "sendProxy [%ld/%d] Isend posted, req %p, size %d, proto %d, myRank %d, channelId %d",
                       sub->transmitted, buffSlot, sub->requests[buffSlot], size, p, proxyState->tpRank, sub->channelId);
               sub->transmitted += args->sliceSteps;
@@ -1184,7 +1167,7 @@ static ncclResult_t sendProxyProgress(struct ncclProxyState* proxyState, struct
       }
       // Check whether the network has completed some send operations.
       if (sub->done < sub->transmitted) {
-        INFO(NCCL_ALL,"OOOOOOOOOO sendProxyProgress the network has completed some send operations");
+        NCCL_TRACEPOINT(NCCL_NET, ncclTraceSendTest, sub->done, sub->transmitted, sub->channelId);
         int done;
         int size;
         int buffSlot = (sub->base+sub->done)%NCCL_STEPS;
@@ -1198,14 +1181,14 @@ static ncclResult_t sendProxyProgress(struct ncclProxyState* proxyState, struct
               sub->nsteps++;
             } else {
               // Signal the GPU the send is complete and it can return.
-              INFO(NCCL_ALL,"OOOOOOOOOO sendProxyProgress Signal the GPU the send is complete and it can return");
+              NCCL_TRACEPOINT(NCCL_NET, ncclTraceSendRegComplete, sub->base, sub->nbytes, sub->channelId);
               connFifo[sub->base%NCCL_STEPS].size = -1;
             }
           }
           // Make sure size is reset to -1 before we update the head.
           if (sub->reg == 0) connFifo[buffSlot].size = -1;
           __sync_synchronize();
-          INFO(NCCL_ALL, "sendProxy [%ld/%d] request %p done", sub->done, buffSlot, sub->requests[buffSlot]);
+          NCCL_TRACEPOINT(NCCL_NET, ncclTraceSendDone, sub->done, buffSlot, size);
           TRACE(NCCL_NET, "sendProxy [%ld/%d] request %p done", sub->done, buffSlot, sub->requests[buffSlot]);
           sub->done += args->sliceSteps;
           for (uint64_t step=sub->done-args->sliceSteps; step<sub->done; step++) ncclProfilingRecord(args, s, step, ncclProxyProfileEnd);
@@ -1237,15 +1220,11 @@ static ncclResult_t sendProxyProgress(struct ncclProxyState* proxyState, struct
   return ncclSuccess;
 }
 
-int mycounter_recv =0;
 
 // in this function we are receiving data from a channel/socket and we are writing the to the GPU
 static ncclResult_t recvProxyProgress(struct ncclProxyState* proxyState, struct ncclProxyArgs* args) {
 
-  //INFO(NCCL_ALL,"########################################## recvProxyProgress");
-  if ((mycounter_recv++ % 100) == 0) {
-    INFO(NCCL_ALL,"recvProxyProgress counter : %d",mycounter_recv);  
-  }
+  NCCL_TRACEPOINT(NCCL_PROXY, ncclTraceRecvProxyProgress, args->state, args->nsubs, args->idle);
 
   if (args->state == ncclProxyOpReady) {
     // Initialize subs and group them by same recvComm.
@@ -1340,8 +1319,8 @@ static ncclResult_t recvProxyProgress(struct ncclProxyState* proxyState, struct
         struct recvNetResources* resources = (struct recvNetResources*) (subGroup->connection->transportResources);
         void** requestPtr = subGroup->requests+(step%NCCL_STEPS);
         // receive operation
-        INFO(NCCL_ALL,"##################### recvProxyProgress irecv operation");
         NCCLCHECK(proxyState->ncclNet->irecv(resources->netRecvComm, subCount, ptrs, sizes, tags, mhandles, requestPtr));
+        NCCL_TRACEPOINT(NCCL_NET, ncclTraceRecvPosted, step, subCount, *requestPtr != NULL);
         if (*requestPtr) {
           subGroup->recvRequestsCache[step%NCCL_STEPS] = *requestPtr;
           subGroup->recvRequestsSubCount = subCount;
@@ -1365,9 +1344,6 @@ static ncclResult_t recvProxyProgress(struct ncclProxyState* proxyState, struct
         int sizes[NCCL_PROXY_MAX_SUBS];
         void* mhandles[NCCL_PROXY_MAX_SUBS];
         for (int i=0; i<NCCL_PROXY_MAX_SUBS; i++) sizes[i] = 0;
-        //INFO(NCCL_ALL,"##################### recvProxyProgress proxyState->ncclNet->test");
-        //INFO(NCCL_ALL,"##################### recvProxyProgress proxyState->ncclNet->test - operation %d",
-        //          subGroup->requests[step%NCCL_STEPS]->op);
         NCCLCHECK(proxyState->ncclNet->test(subGroup->requests[step%NCCL_STEPS], &done, sizes));
         if (done) {
           int needFlush = 0;
@@ -1445,7 +1421,6 @@ static ncclResult_t recvProxyProgress(struct ncclProxyState* proxyState, struct
         int done = 1;
         void* request = subGroup->requests[step%NCCL_STEPS];
         if (request) {
-          //INFO(NCCL_ALL,"##################### recvProxyProgress if request");
           NCCLCHECK(proxyState->ncclNet->test(request, &done, NULL));
         }
         if (done) {
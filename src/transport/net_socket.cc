@@ -9,12 +9,24 @@
 #include "socket.h"
 #include "net.h"
 #include "param.h"
+#include "iouring.h"
+#include "trace.h"
+#include "spinwait.h"
+#include "xdp.h"
+#include "compress.h"
+#include "net_socket.h"
 
 #include <pthread.h>
 #include <stdlib.h>
+#include <assert.h>
 #include <poll.h>
 #include <limits.h>
 #include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <netinet/ip.h>
+#include <sys/ioctl.h>
 
 /* Init functions */
 static int ncclNetIfs = -1;
@@ -22,6 +34,8 @@ struct ncclNetSocketDev {
   union ncclSocketAddress addr;
   char devName[MAX_IF_NAME_SIZE];
   char* pciPath;
+  struct ncclXdpDev* xdp; // AF_XDP socket, opened on first use
+  int xdpTried;
 };
 static struct ncclNetSocketDev ncclNetSocketDevs[MAX_IFS];
 
@@ -91,6 +105,11 @@ static ncclResult_t ncclNetSocketGetSpeed(char* devName, int* speed) {
   return ncclSuccess;
 }
 
+// Use the framed protocol when the peer supports it (0 forces the legacy protocol)
+NCCL_PARAM(SocketFraming, "SOCKET_FRAMING", 1);
+// Maximum number of buffers in a grouped receive
+#define MAX_RECVS 8
+
 ncclResult_t ncclNetSocketGetProperties(int dev, ncclNetProperties_t* props) {
   props->name = ncclNetSocketDevs[dev].devName;
   props->pciPath = ncclNetSocketDevs[dev].pciPath;
@@ -101,7 +120,9 @@ ncclResult_t ncclNetSocketGetProperties(int dev, ncclNetProperties_t* props) {
   props->latency = 0; // Not set
   props->port = 0;
   props->maxComms = 65536;
-  props->maxRecvs = 1;
+  // Without framing our comms use the legacy protocol, which needs each comm to have a single
+  // sender: keep NCCL from sharing them (see ncclNetSocketIrecv)
+  props->maxRecvs = ncclParamSocketFraming() ? MAX_RECVS : 1;
   props->netDeviceType    = NCCL_NET_DEVICE_HOST;
   props->netDeviceVersion = NCCL_NET_DEVICE_INVALID_VERSION;
   return ncclSuccess;
@@ -109,35 +130,120 @@ ncclResult_t ncclNetSocketGetProperties(int dev, ncclNetProperties_t* props) {
 
 /* Communication functions */
 
-#define MAX_SOCKETS 64
-#define MAX_THREADS 16
+#define MAX_SOCKETS NCCL_NET_SOCKET_MAX_SOCKETS
+#define MAX_THREADS NCCL_NET_SOCKET_MAX_THREADS
 #define MAX_REQUESTS NCCL_NET_MAX_REQUESTS
 #define MIN_CHUNKSIZE (64*1024)
+// The handle only has room for the address of one more interface
+#define MAX_RAILS 2
 
 NCCL_PARAM(SocketNsocksPerThread, "NSOCKS_PERTHREAD", -2);
 NCCL_PARAM(SocketNthreads, "SOCKET_NTHREADS", -2);
+NCCL_PARAM(SocketIoUring, "SOCKET_IOURING", 0);
+// Spread the data sockets of a comm over several interfaces
+NCCL_PARAM(SocketMultiRail, "SOCKET_MULTI_RAIL", 0);
+// Send chunks of at least this many bytes with MSG_ZEROCOPY (-1 disables zero-copy sends)
+NCCL_PARAM(SocketZeroCopyThreshold, "SOCKET_ZEROCOPY_THRESHOLD", -1);
+// Framed sends over the control socket: messages of up to this many bytes are sent with the ones
+// posted before them in a single sendmsg (0 disables coalescing)
+NCCL_PARAM(SocketCoalesceBytes, "SOCKET_COALESCE_BYTES", 65536);
+// Framed protocol: send messages of at most this many bytes over a separate socket so that they
+// do not wait behind large transfers (-1 disables the latency lane)
+NCCL_PARAM(SocketLatencyLane, "SOCKET_LATENCY_LANE", -1);
+// Helper threads: let epoll_wait busy-poll the device queues of the data sockets for this many
+// microseconds before sleeping (0 disables busy polling)
+NCCL_PARAM(SocketBusyPoll, "SOCKET_BUSY_POLL", 0);
+// Carry the framed protocol over AF_XDP instead of TCP when there are no data sockets: 0 disables
+// it, 1 attaches the XDP program in native mode if possible, 2 only in generic mode
+NCCL_PARAM(SocketXdp, "SOCKET_XDP", 0);
+// Compress messages sent over the control socket (framed protocol without data sockets). The
+// value is the element size used to byte-shuffle the data before compressing it, e.g. 2 for
+// fp16/bf16 or 4 for fp32, 1 not to shuffle; 0 disables compression.
+NCCL_PARAM(SocketCompress, "SOCKET_COMPRESS", 0);
+// Smaller messages are not worth compressing
+#define COMPRESS_MIN_SIZE 4096
+// Collect per-comm statistics (see net_socket.h), printed when the comm is closed and, if
+// NCCL_SOCKET_STATS_INTERVAL is set, every that many seconds while it is in use
+NCCL_PARAM(SocketStats, "SOCKET_STATS", 0);
+NCCL_PARAM(SocketStatsInterval, "SOCKET_STATS_INTERVAL", 0);
+
+#ifndef EPIOCSPARAMS
+// Per-epoll busy poll parameters, from linux/eventpoll.h (Linux 6.9+)
+struct epoll_params {
+  uint32_t busy_poll_usecs;
+  uint16_t busy_poll_budget;
+  uint8_t prefer_busy_poll;
+  uint8_t __pad;
+};
+#define EPIOCSPARAMS _IOW(0x8A, 0x01, struct epoll_params)
+#endif
+
+// Maximum number of memory regions registered with the io_uring of a comm
+#define MAX_RING_MRS 64
 
 enum ncclNetSocketCommState {
   ncclNetSocketCommStateStart = 0,
   ncclNetSocketCommStateConnect = 1,
   ncclNetSocketCommStateAccept = 3,
-  ncclNetSocketCommStateSend = 4,
-  ncclNetSocketCommStateRecv = 5,
+  ncclNetSocketCommStateCalibrate = 6,
+  ncclNetSocketCommStateXdp = 7,
 };
 
 struct ncclNetSocketCommStage {
   enum ncclNetSocketCommState state;
+  // Not used since sockets are established all at once; kept for the layout of the handle
   uint8_t iteration;
   struct ncclSocket* sock;
   struct ncclNetSocketComm* comm;
 };
 
+// Protocol versions. Version 0 (legacy) exchanges the size of each message over the control
+// socket before sending data. Version 1 (framed) prefixes each message with a header.
+#define NCCL_NET_SOCKET_PROTO_LEGACY 0
+#define NCCL_NET_SOCKET_PROTO_FRAMED 1
+// Version 2 (framed, compression) also accepts compressed messages
+#define NCCL_NET_SOCKET_PROTO_COMPRESS 2
+// Set in the socket index byte sent at connection time to acknowledge the framed protocol
+#define NCCL_NET_SOCKET_IDX_FRAMED 0x80
+// Set in the index byte by connectors which run the bandwidth probe the listener asked for. Older
+// connectors ignore handle->calibrate and never set it, so the listener skips the probe for them.
+// Calibrating listeners ask for at most CALIB_MAX_SOCKETS sockets, which keeps indexes below it.
+#define NCCL_NET_SOCKET_IDX_CALIBRATE 0x40
+
 struct ncclNetSocketHandle {
   union ncclSocketAddress connectAddr;
   uint64_t magic; // random number to help debugging
   int nSocks;
   int nThreads;
   struct ncclNetSocketCommStage stage;
+  // New fields go after stage so that older peers keep parsing the fields above; the handle is
+  // zero-filled by older listeners, which therefore advertise the legacy protocol.
+  int version;
+  int calibrate; // the connector must run the bandwidth probe before using the data sockets
+  // Multi-rail: data sockets connect to railAddr[rail-1] for rails other than the first
+  int nRails;
+  int railSpeed[MAX_RAILS];
+  union ncclSocketAddress railAddr[MAX_RAILS-1];
+  int lane; // the listener accepts a latency lane
+  int xdp;  // the listener can receive over AF_XDP
+};
+
+// Framed protocol header, sent in front of the first chunk of each message
+struct ncclNetSocketHeader {
+  uint32_t seq;
+  int size;
+  int tag;
+  uint32_t flags;
+};
+// The payload is a sequence of compressed chunks; size is the size once decompressed
+#define NCCL_NET_SOCKET_HDR_COMPRESSED 0x1
+
+// Memory region registered with the io_uring of a comm
+struct ncclNetSocketMr {
+  struct ncclNetSocketComm* comm;
+  char* data;
+  size_t size;
+  int index;
 };
 
 struct ncclNetSocketTask {
@@ -148,6 +254,23 @@ struct ncclNetSocketTask {
   int offset;
   int used;
   ncclResult_t result;
+  struct ncclNetSocketMr* mr;
+  // MSG_ZEROCOPY: the task is only complete once the kernel has released the pages of data
+  int zc;
+  uint32_t zcSeq;   // number of zero-copy send calls on the socket, up to and including this task
+  int zcNotifs;     // io_uring: notifications still to be received
+  int zcDone;
+  // Framed protocol: header sent or received before the payload of the first chunk of a message
+  struct ncclNetSocketHeader hdr;
+  int hdrSize;
+  int hdrOffset;
+  int tag; // Tag a received header must carry for the payload to be received into data
+  uint32_t seq; // and its sequence number
+  // With the latency lane, the next message may never come on the socket of a header receive:
+  // the peer closing the connection there is not an error until a header is expected there
+  int closed;
+  int done; // set with release semantics by the thread progressing the task
+  struct ncclNetSocketTask* nextFree;
 };
 
 struct ncclNetSocketRequest {
@@ -160,20 +283,62 @@ struct ncclNetSocketRequest {
   struct ncclNetSocketComm* comm;
   struct ncclNetSocketTask* tasks[MAX_SOCKETS];
   int nSubs;
+  struct ncclNetSocketMr* mr;
+  int zc;
+  uint32_t zcSeq;
+  struct ncclNetSocketHeader hdr;
+  int hdrSize;
+  int hdrOffset;
+  // Framed receives
+  int tag;
+  struct ncclNetSocketRequest* next;  // link in the posted, unexpected or free list of the comm
+  struct ncclNetSocketRequest* unex;  // unexpected message matched to this receive
+  uint64_t xdpEnd;                    // AF_XDP sends: stream offset at which the message ends
+  // Compressed message. Sends keep the buffer holding the compressed data across uses of the request.
+  int compressed;
+  char* zbuf;
+  size_t zbufSize;
+  uint64_t start; // posting time, with statistics enabled
+  int unexpected;                     // data is a bounce buffer holding an unexpected message
+  // Grouped receive: the request only tracks the receives of its nRecvs buffers
+  int nRecvs;
+  struct ncclNetSocketRequest* recvs[MAX_RECVS];
+};
+
+// MSG_ZEROCOPY state of a socket, owned by the thread which sends on it
+struct ncclNetSocketZeroCopy {
+  int enabled;
+  uint32_t sent;      // send() calls issued with MSG_ZEROCOPY
+  uint32_t completed; // send() calls for which the kernel reported completion
 };
 
 struct ncclNetSocketTaskQueue {
-  int next;
   int len;
   struct ncclNetSocketTask* tasks;
+  struct ncclNetSocketTask* freeTasks; // only accessed by the proxy thread
+  // Tasks handed to the helper thread in posting order: a single-producer (proxy thread),
+  // single-consumer (helper thread) ring of task pointers. A slot is only reused once its task
+  // is done, hence consumed, so the ring cannot overflow and the producer never reads head.
+  struct ncclNetSocketTask** ring;
+  uint32_t ringMask;
+  char pad1[CACHE_LINE_SIZE];
+  uint32_t tail; // written by the proxy thread
+  char pad2[CACHE_LINE_SIZE-sizeof(uint32_t)];
+  uint32_t head; // only accessed by the helper thread
+  char pad3[CACHE_LINE_SIZE-sizeof(uint32_t)];
 };
 
 struct ncclNetSocketThreadResources {
   struct ncclNetSocketTaskQueue threadTaskQueue;
   int stop;
   struct ncclNetSocketComm* comm;
-  pthread_mutex_t threadLock;
-  pthread_cond_t  threadCond;
+  // Each helper thread owns an epoll instance watching its data sockets (edge-triggered)
+  // and an eventfd used by the proxy thread to signal new tasks while the helper is parked.
+  int epollFd;
+  int eventFd;
+  int parked;
+  struct ncclNetSocketTask** active; // tasks taken from the ring and not done yet, in order
+  int nActive;
 };
 
 struct ncclNetSocketListenComm {
@@ -182,6 +347,43 @@ struct ncclNetSocketListenComm {
   int nSocks;
   int nThreads;
   int dev;
+  int calibrate;
+  int nRails;
+  int railSpeed[MAX_RAILS];
+  struct ncclSocket railSocks[MAX_RAILS-1]; // listening sockets of the rails after the first
+  int lane;
+  int xdp;
+};
+
+// Framed sends progressed in posting order over a single socket
+struct ncclNetSocketSendFifo {
+  struct ncclNetSocketRequest* reqs[MAX_REQUESTS];
+  uint32_t head;
+  uint32_t tail;
+};
+
+// Framed receives over a single socket: the payload of a message is received before the next header
+struct ncclNetSocketRecvStream {
+  struct ncclSocket* sock;
+  struct ncclNetSocketHeader hdr;
+  int hdrOffset;
+  struct ncclNetSocketRequest* req; // receive in progress
+  // Compressed messages: header and payload of the chunk being received
+  struct ncclCompressChunk chunk;
+  int chunkOffset;
+  char* zbuf;
+};
+
+// Connections of a comm being established. They are all started at once and complete in any
+// order; each one then carries its socket index, sent as a single byte.
+struct ncclNetSocketEstablish {
+  int n;      // connections expected
+  int nDone;  // connections whose index has been sent or received
+  int offset[MAX_SOCKETS+2];
+  uint8_t idx[MAX_SOCKETS+2];
+  // Accept side: connections are identified by their index once accepted
+  struct ncclSocket socks[MAX_SOCKETS+2];
+  int started[MAX_SOCKETS+2];
 };
 
 struct ncclNetSocketComm {
@@ -192,57 +394,528 @@ struct ncclNetSocketComm {
   int nSocks;
   int nThreads;
   int nextSock;
-  struct ncclNetSocketRequest requests[MAX_REQUESTS];
+  int nRequests;
+  struct ncclNetSocketRequest* requests;
+  struct ncclNetSocketRequest* freeRequests;
+  int nFreeRequests;
   pthread_t helperThread[MAX_THREADS];
   struct ncclNetSocketThreadResources threadResources[MAX_THREADS];
+  // io_uring backend: when set, data sockets are progressed by the proxy thread through
+  // the ring instead of by helper threads.
+  int useRing;
+  struct ncclIoUring ring;
+  struct ncclNetSocketTask* ringInflight[MAX_SOCKETS];
+  struct ncclNetSocketMr* ringMrs[MAX_RING_MRS];
+  // Zero-copy send state of data sockets; index nSocks is the control socket
+  struct ncclNetSocketZeroCopy zc[MAX_SOCKETS+1];
+  // Framed protocol
+  int framed;
+  int compress; // byte-shuffle width of compressed sends, 0 if we do not compress
+  uint32_t seq; // sequence number of the next message
+  // Sends over the control socket (nSocks == 0) and over the latency lane
+  struct ncclNetSocketSendFifo ctrlFifo;
+  struct ncclNetSocketSendFifo laneFifo;
+  // Latency lane: small messages have their own socket. Messages are matched in sequence order,
+  // so a message arriving on one socket may have to wait for the header of an earlier one on
+  // the other socket, but never for its payload.
+  int lane;
+  struct ncclSocket laneSock;
+  // Receives are matched to incoming messages by tag. Messages arriving before a matching
+  // receive is posted are received into a bounce buffer and kept in the unexpected list.
+  struct ncclNetSocketRequest* postedHead;
+  struct ncclNetSocketRequest* postedTail;
+  struct ncclNetSocketRequest* unexHead;
+  struct ncclNetSocketRequest* unexTail;
+  // Header of the next incoming message: read directly from the control socket and the latency
+  // lane, or by a task on a data socket, which may also receive the first chunk into the oldest
+  // posted receive.
+  struct ncclNetSocketRecvStream ctrlIn;
+  struct ncclNetSocketRecvStream laneIn;
+  struct ncclNetSocketTask* inTask;
+  struct ncclNetSocketRequest* inTaskReq;
+  struct ncclNetSocketCalib* calib;   // bandwidth probe state, only set during connection
+  int calibrate;                      // both sides agreed to run the probe
+  struct ncclNetSocketEstablish* establish; // sockets being connected, only set during connection
+  struct ncclNetSocketStats* stats;   // NULL unless NCCL_SOCKET_STATS is set
+  uint64_t statsDumpTime;
+  // AF_XDP: the framed protocol runs over xdp instead of the control socket, which is only used
+  // to exchange the addresses of both ends when connecting. Sends complete once acknowledged,
+  // since the peer cannot ask for retransmissions after we close.
+  struct ncclXdpConn* xdp;
+  struct ncclXdpAddr xdpLocal;
+  struct ncclXdpAddr xdpRemote;
+  int xdpSendOffset;
+  int xdpRecvOffset;
 };
 
+// Account for an attempt to move wanted bytes on socket s (nSocks for the control socket, nSocks+1
+// for the latency lane), which moved some of them. Only called by the thread progressing s.
+static void ncclNetSocketStatsCount(struct ncclNetSocketComm* comm, int s, int moved, int wanted) {
+  if (comm->stats == NULL || wanted <= 0) return;
+  struct ncclNetSocketSockStats* st = comm->stats->socks+s;
+  st->calls++;
+  st->bytes += moved;
+  if (moved == 0) st->eagain++;
+  else if (moved < wanted) st->partial++;
+}
+
+// Size of the chunks a message of the given size is divided into over the data sockets
+static int ncclNetSocketTaskSize(struct ncclNetSocketComm* comm, int size) {
+  return std::max(MIN_CHUNKSIZE, DIVUP(size, comm->nSocks));
+}
+
+// Sentinel epoll data value identifying the eventfd doorbell
+#define NCCL_NET_SOCKET_EVENTFD_ID MAX_SOCKETS
+
+// Collect socket events, sleeping until there are some or new tasks unless park is 0
+static ncclResult_t ncclNetSocketThreadWait(struct ncclNetSocketThreadResources* resource, uint32_t head, int* sockReady, int* errReady, int park) {
+  struct epoll_event events[MAX_SOCKETS+1];
+  int nEvents = 0;
+  if (park == 0) {
+    nEvents = epoll_wait(resource->epollFd, events, MAX_SOCKETS+1, 0);
+  } else {
+    // Advertise that we are about to sleep, then re-check for new tasks. The proxy thread publishes
+    // the ring tail before reading parked, so either we see the new task or it rings the doorbell.
+    __atomic_store_n(&resource->parked, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&resource->threadTaskQueue.tail, __ATOMIC_SEQ_CST) == head &&
+        __atomic_load_n(&resource->stop, __ATOMIC_ACQUIRE) == 0) {
+      nEvents = epoll_wait(resource->epollFd, events, MAX_SOCKETS+1, -1);
+    }
+    __atomic_store_n(&resource->parked, 0, __ATOMIC_RELAXED);
+  }
+  if (nEvents == -1) {
+    if (errno == EINTR) return ncclSuccess;
+    WARN("NET/Socket : epoll_wait failed : %s", strerror(errno));
+    return ncclSystemError;
+  }
+  for (int e=0; e<nEvents; e++) {
+    uint32_t id = events[e].data.u32;
+    if (id == NCCL_NET_SOCKET_EVENTFD_ID) {
+      uint64_t count;
+      if (read(resource->eventFd, &count, sizeof(count)) == -1 && errno != EAGAIN) {
+        WARN("NET/Socket : eventfd read failed : %s", strerror(errno));
+        return ncclSystemError;
+      }
+    } else {
+      // Errors and hang-ups are reported by the next send/recv call
+      sockReady[id] = 1;
+      // EPOLLERR is also raised when zero-copy completions are queued on the error queue
+      if (events[e].events & EPOLLERR) errReady[id] = 1;
+    }
+  }
+  return ncclSuccess;
+}
+
+static int ncclNetSocketZeroCopyDone(struct ncclNetSocketZeroCopy* zc, uint32_t seq) {
+  return (int32_t)(__atomic_load_n(&zc->completed, __ATOMIC_RELAXED) - seq) >= 0;
+}
+
+// Drain completion notifications of zero-copy sends on sock. If the kernel had to copy the data
+// anyway, stop using zero-copy on that socket as it only adds overhead.
+static ncclResult_t ncclNetSocketZeroCopyReap(struct ncclSocket* sock, struct ncclNetSocketZeroCopy* zc) {
+  int copied = 0;
+  NCCLCHECK(ncclSocketZeroCopyPoll(sock, &zc->completed, &copied));
+  if (copied && __atomic_load_n(&zc->enabled, __ATOMIC_RELAXED)) {
+    char line[SOCKET_NAME_MAXLEN+1];
+    INFO(NCCL_NET, "NET/Socket : zero-copy send to %s fell back to copy, disabling", ncclSocketToString(&sock->addr, line));
+    __atomic_store_n(&zc->enabled, 0, __ATOMIC_RELAXED);
+  }
+  return ncclSuccess;
+}
+
+// Publish the progress of a task header. Once a received header is complete, we know how much
+// of the message this chunk holds. The payload is only received along with the header if the
+// message is for the receive the task was posted for; otherwise the proxy thread routes it.
+static void ncclNetSocketSetHdrOffset(struct ncclNetSocketComm* comm, struct ncclNetSocketTask* r, int offset) {
+  if (offset == r->hdrSize && r->op == NCCL_SOCKET_RECV) {
+    if (r->hdr.tag != r->tag || r->hdr.seq != r->seq || r->hdr.size < 0 || r->hdr.size > r->size) r->size = 0;
+    else r->size = std::min(r->hdr.size, ncclNetSocketTaskSize(comm, r->hdr.size));
+  }
+  __atomic_store_n(&r->hdrOffset, offset, __ATOMIC_RELEASE);
+}
+
+// Progress the header, if any, then the payload of a task. *again is set when the task stopped
+// because the kernel returned EAGAIN, so that the socket needs a new edge before progressing.
+static ncclResult_t ncclNetSocketTaskProgress(struct ncclNetSocketComm* comm, struct ncclNetSocketTask* r, int* again) {
+  int s = r->sock - comm->socks;
+  *again = 0;
+  if (r->hdrOffset < r->hdrSize) {
+    int offset = r->hdrOffset;
+    if (r->op == NCCL_SOCKET_SEND && r->zc == 0) {
+      // Send the header and the payload with a single system call
+      struct iovec iov[2] = { { &r->hdr, (size_t)r->hdrSize }, { r->data, (size_t)r->size } };
+      offset += r->offset;
+      NCCLCHECK(ncclSocketProgressIov(NCCL_SOCKET_SEND, r->sock, iov, 2, &offset));
+      r->offset = std::max(0, offset-r->hdrSize);
+      __atomic_store_n(&r->hdrOffset, std::min(offset, r->hdrSize), __ATOMIC_RELEASE);
+      *again = r->sock->wouldBlock;
+      return ncclSuccess;
+    }
+    if (r->op == NCCL_SOCKET_RECV && comm->lane && offset == 0) {
+      struct iovec iov = { &r->hdr, (size_t)r->hdrSize };
+      NCCLCHECK(ncclSocketProgressIov(NCCL_SOCKET_RECV, r->sock, &iov, 1, &offset, &r->closed));
+    } else {
+      NCCLCHECK(ncclSocketProgress(r->op, r->sock, &r->hdr, r->hdrSize, &offset));
+    }
+    ncclNetSocketSetHdrOffset(comm, r, offset);
+    if (offset < r->hdrSize) {
+      *again = r->sock->wouldBlock;
+      return ncclSuccess;
+    }
+  }
+  if (r->offset < r->size) {
+    if (r->zc) {
+      NCCLCHECK(ncclSocketSendZeroCopy(r->sock, r->data, r->size, &r->offset, &comm->zc[s].sent));
+      r->zcSeq = comm->zc[s].sent;
+    } else {
+      NCCLCHECK(ncclSocketProgress(r->op, r->sock, r->data, r->size, &r->offset));
+    }
+    *again = r->sock->wouldBlock;
+  }
+  return ncclSuccess;
+}
+
+// Publish the completion of t to the proxy thread once its header, payload and zero-copy
+// notifications are all done. Only called by the thread progressing t.
+static int ncclNetSocketTaskCheck(struct ncclNetSocketComm* comm, struct ncclNetSocketTask* t) {
+  if (t->hdrOffset < t->hdrSize || t->offset < t->size || (t->zc && t->zcDone == 0)) return 0;
+  if (comm->stats) comm->stats->socks[t->sock - comm->socks].chunks++;
+  __atomic_store_n(&t->done, 1, __ATOMIC_RELEASE);
+  return 1;
+}
+
 void* persistentSocketThread(void *args_) {
   struct ncclNetSocketThreadResources* resource = (struct ncclNetSocketThreadResources*)args_;
   struct ncclNetSocketComm* comm = resource->comm;
   struct ncclNetSocketTaskQueue* myQueue = &resource->threadTaskQueue;
-  int nSocksPerThread = comm->nSocks / comm->nThreads;
+  struct ncclNetSocketTask** active = resource->active;
+  // Sockets start as ready; they are only marked not ready once the kernel returns EAGAIN,
+  // after which we wait for the edge-triggered notification before touching them again.
+  int sockReady[MAX_SOCKETS];
+  int errReady[MAX_SOCKETS];
+  for (int s=0; s<MAX_SOCKETS; s++) { sockReady[s] = 1; errReady[s] = 0; }
+  struct ncclSpinWait spin;
+  ncclSpinWaitInit(&spin);
+  struct ncclNetSocketThreadStats* stats = comm->stats ? comm->stats->threads+(resource-comm->threadResources) : NULL;
   while (1) {
-    int idle = 1;
-    int mark = myQueue->next; // mark newest task seen
-    for (int i=0; i<myQueue->len; i+=nSocksPerThread) {
-      int repeat;
-      do {
-        repeat = 0;
-        for (int j=0; j<nSocksPerThread; j++) {
-          struct ncclNetSocketTask* r = myQueue->tasks+i+j;
-          if (r != NULL && r->used == 1 && r->offset < r->size) {
-            // does not pass here in our scenario
-            INFO(NCCL_ALL,"XXXXXXXXXXXXXXXXXXXXXXXXX persistentSocketThread");
-            r->result = ncclSocketProgress(r->op, r->sock, r->data, r->size, &r->offset);
-            if (r->result != ncclSuccess) {
-              WARN("NET/Socket : socket progress error");
-              return NULL;
-            }
-            idle = 0;
-            if (r->offset < r->size) repeat = 1;
+    uint64_t start = stats ? clockNano() : 0;
+    int progressed = 0;
+    uint64_t blocked = 0; // sockets which cannot make progress in this pass
+    // Take the newly posted tasks
+    uint32_t tail = __atomic_load_n(&myQueue->tail, __ATOMIC_ACQUIRE);
+    while (myQueue->head != tail) active[resource->nActive++] = myQueue->ring[myQueue->head++ & myQueue->ringMask];
+    // Reap zero-copy completions first; this also frees the socket memory that MSG_ZEROCOPY
+    // sends need, so it must happen even if no task is waiting on a completion yet.
+    for (int s=0; s<comm->nSocks; s++) {
+      if (errReady[s] == 0) continue;
+      errReady[s] = 0;
+      if (ncclNetSocketZeroCopyReap(comm->socks+s, comm->zc+s) != ncclSuccess) return NULL;
+    }
+    // Walk tasks from oldest to newest so that tasks sharing a socket are progressed in order,
+    // dropping those which are done.
+    int n = 0;
+    for (int i=0; i<resource->nActive; i++) {
+      struct ncclNetSocketTask* r = active[i];
+      int s = r->sock - comm->socks;
+      if (r->hdrOffset == r->hdrSize && r->offset >= r->size) {
+        if (r->zc && r->zcDone == 0 && ncclNetSocketZeroCopyDone(comm->zc+s, r->zcSeq)) r->zcDone = 1;
+      } else if ((blocked & (1ULL << s)) == 0) {
+        if (sockReady[s] == 0) {
+          blocked |= (1ULL << s);
+        } else {
+          int before = r->hdrOffset+r->offset, again;
+          r->result = ncclNetSocketTaskProgress(comm, r, &again);
+          if (r->result != ncclSuccess) {
+            WARN("NET/Socket : socket progress error");
+            return NULL;
+          }
+          ncclNetSocketStatsCount(comm, s, r->hdrOffset+r->offset-before, r->hdrSize+r->size-before);
+          progressed = 1;
+          if (r->hdrOffset < r->hdrSize || r->offset < r->size) {
+            // Keep later tasks on this socket behind this one. Only wait for the next edge if
+            // the kernel returned EAGAIN; otherwise retry on the next pass.
+            if (again) sockReady[s] = 0;
+            blocked |= (1ULL << s);
           }
         }
-      } while (repeat);
+      }
+      if (ncclNetSocketTaskCheck(comm, r)) {
+        NCCL_TRACEPOINT(NCCL_NET, ncclTraceSocketTaskDone, s, r->op, r->size);
+        progressed = 1;
+      } else {
+        active[n++] = r;
+      }
+    }
+    resource->nActive = n;
+    if (__atomic_load_n(&resource->stop, __ATOMIC_ACQUIRE)) {
+      ncclSpinWaitReport(&spin, NCCL_NET, "NET/Socket : helper thread");
+      return NULL;
+    }
+    int park = 0;
+    if (progressed) {
+      ncclSpinWaitBusy(&spin);
+    } else {
+      park = ncclSpinWaitIdle(&spin) == ncclSpinWaitPark;
+      if (ncclNetSocketThreadWait(resource, myQueue->head, sockReady, errReady, park) != ncclSuccess) return NULL;
+    }
+    if (stats) {
+      uint64_t elapsed = clockNano()-start;
+      if (progressed) stats->busyNs += elapsed;
+      else if (park) stats->blockedNs += elapsed;
+      else stats->idleNs += elapsed;
+    }
+  }
+}
+
+// Bandwidth calibration. When NCCL_SOCKET_CALIBRATE is set and the number of sockets and
+// threads is not forced, the listener asks for the largest configuration and the connector
+// probes the bandwidth of 1, 2, 4, ... data sockets. The receiver measures each candidate,
+// picks the smallest one within CALIB_TOLERANCE of the best and tells the sender, then both
+// close the sockets they do not need. The choice is cached per interface so that later
+// connections skip the probe, in a file of the user's cache directory unless
+// NCCL_SOCKET_CALIBRATION_FILE says otherwise.
+NCCL_PARAM(SocketCalibrate, "SOCKET_CALIBRATE", 0);
+NCCL_PARAM(SocketCalibrationBytes, "SOCKET_CALIBRATION_BYTES", 16*1024*1024);
+
+#define CALIB_MAX_SOCKETS 16
+#define CALIB_MAX_THREADS 4
+#define CALIB_CANDS 5 // 1, 2, 4, 8, 16 sockets
+#define CALIB_CHUNK (1024*1024)
+#define CALIB_TOLERANCE 0.9
+// Give the proxy thread back when the peer stops making progress, e.g. because its own
+// proxy thread is busy; the probe resumes on the next call.
+#define CALIB_IDLE_NS (10*1000*1000)
+#define CALIB_FILE_NAME "nccl-socket-calibration"
+static_assert(CALIB_MAX_SOCKETS+2 <= NCCL_NET_SOCKET_IDX_CALIBRATE, "socket indexes overlap the calibration flag");
+
+struct ncclNetSocketCalib {
+  int nCands;
+  int cands[CALIB_CANDS]; // number of data sockets of each candidate
+  int cand;
+  int phase;              // 0: exchanging a control word, 1: moving probe data
+  int ctrl;               // candidate to probe next, or -1-choice once the receiver has chosen
+  int ctrlOffset;
+  int64_t bytes;          // probe size of each candidate
+  int64_t moved[CALIB_MAX_SOCKETS];
+  uint64_t start;
+  double bw[CALIB_CANDS]; // GB/s, receiver only
+  int choice;
+  char* buf;
+};
+
+// Number of helper threads to use with a calibrated number of sockets
+static void ncclNetSocketCalibConfig(int nSocks, int* ns, int* nt) {
+  if (nSocks == 1 && ncclParamSocketIoUring() == 0) {
+    // A single stream is what the control socket already gives us without helper threads
+    *ns = *nt = 0;
+    return;
+  }
+  *nt = std::min(nSocks, CALIB_MAX_THREADS);
+  *ns = nSocks;
+}
+
+// $XDG_CACHE_HOME, then ~/.cache, then a file of /tmp named after the uid
+static void ncclNetSocketCalibFile(char* path) {
+  const char* file = ncclGetEnv("NCCL_SOCKET_CALIBRATION_FILE");
+  if (file) {
+    snprintf(path, PATH_MAX, "%s", file);
+    return;
+  }
+  const char* dir = getenv("XDG_CACHE_HOME");
+  if (dir && dir[0] == '/') {
+    snprintf(path, PATH_MAX, "%s/" CALIB_FILE_NAME, dir);
+    return;
+  }
+  dir = getenv("HOME");
+  if (dir == NULL || dir[0] != '/') dir = userHomeDir();
+  if (dir && dir[0] == '/') {
+    snprintf(path, PATH_MAX, "%s/.cache", dir);
+    if (mkdir(path, 0700) == 0 || errno == EEXIST) {
+      snprintf(path, PATH_MAX, "%s/.cache/" CALIB_FILE_NAME, dir);
+      return;
+    }
+  }
+  snprintf(path, PATH_MAX, "/tmp/" CALIB_FILE_NAME ".%u", (unsigned)geteuid());
+}
+
+// Open a calibration file for reading. Files owned by another user are ignored, so that nobody
+// else can choose the configuration of our connections.
+static FILE* ncclNetSocketCalibOpen(const char* path) {
+  int fd = open(path, O_RDONLY | O_NOFOLLOW);
+  if (fd == -1) return NULL;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_uid != geteuid() || !S_ISREG(st.st_mode)) {
+    INFO(NCCL_NET, "NET/Socket : ignoring calibration file %s which is not a regular file of uid %u", path, (unsigned)geteuid());
+    close(fd);
+    return NULL;
+  }
+  FILE* file = fdopen(fd, "r");
+  if (file == NULL) close(fd);
+  return file;
+}
+
+// Cache lines are "<interface> <nSocks> <nThreads>". Returns 1 if dev has an entry.
+static int ncclNetSocketCalibLoad(int dev, int* ns, int* nt) {
+  char path[PATH_MAX];
+  ncclNetSocketCalibFile(path);
+  FILE* file = ncclNetSocketCalibOpen(path);
+  if (file == NULL) return 0;
+  char name[MAX_IF_NAME_SIZE+1];
+  int nSocks, nThreads, found = 0;
+  while (fscanf(file, "%16s %d %d", name, &nSocks, &nThreads) == 3) {
+    if (strcmp(name, ncclNetSocketDevs[dev].devName) != 0) continue;
+    if (nSocks < 0 || nSocks > MAX_SOCKETS || nThreads < 0 || nThreads > MAX_THREADS ||
+        (nThreads == 0) != (nSocks == 0) || (nThreads && nSocks % nThreads)) continue;
+    *ns = nSocks;
+    *nt = nThreads;
+    found = 1;
+  }
+  fclose(file);
+  return found;
+}
+
+// Update the entry of dev, keeping those of other interfaces. Ranks sharing the file may race;
+// the rename keeps the file consistent and a lost update only costs another probe.
+static void ncclNetSocketCalibStore(int dev, int ns, int nt) {
+  char path[PATH_MAX];
+  ncclNetSocketCalibFile(path);
+  char tmpPath[PATH_MAX];
+  snprintf(tmpPath, PATH_MAX, "%s.%d", path, getpid());
+  // Never write through a file or link someone else left at the temporary path
+  int fd = open(tmpPath, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW, 0600);
+  FILE* out = fd == -1 ? NULL : fdopen(fd, "w");
+  if (out == NULL) {
+    INFO(NCCL_NET, "NET/Socket : could not write calibration file %s : %s", tmpPath, strerror(errno));
+    if (fd != -1) {
+      close(fd);
+      unlink(tmpPath);
     }
-    if (idle) {
-      pthread_mutex_lock(&resource->threadLock);
-      while (mark == myQueue->next && resource->stop == 0) { // no new tasks, wait
-        pthread_cond_wait(&resource->threadCond, &resource->threadLock);
+    return;
+  }
+  FILE* in = ncclNetSocketCalibOpen(path);
+  if (in) {
+    char name[MAX_IF_NAME_SIZE+1];
+    int nSocks, nThreads;
+    while (fscanf(in, "%16s %d %d", name, &nSocks, &nThreads) == 3) {
+      if (strcmp(name, ncclNetSocketDevs[dev].devName) != 0) fprintf(out, "%s %d %d\n", name, nSocks, nThreads);
+    }
+    fclose(in);
+  }
+  fprintf(out, "%s %d %d\n", ncclNetSocketDevs[dev].devName, ns, nt);
+  if (fclose(out) != 0 || rename(tmpPath, path) != 0) {
+    INFO(NCCL_NET, "NET/Socket : could not write calibration file %s : %s", path, strerror(errno));
+    unlink(tmpPath);
+  }
+}
+
+static int ncclNetSocketCalibChoose(struct ncclNetSocketCalib* c) {
+  double best = 0;
+  for (int i=0; i<c->nCands; i++) best = std::max(best, c->bw[i]);
+  for (int i=0; i<c->nCands; i++) {
+    if (c->bw[i] >= CALIB_TOLERANCE*best) return i;
+  }
+  return 0;
+}
+
+// Run the probe on a newly connected comm; op is NCCL_SOCKET_SEND on the connector side.
+// Sets *done once both sides agree on the number of sockets, which is then applied to comm.
+static ncclResult_t ncclNetSocketCalibrate(struct ncclNetSocketComm* comm, int op, int* done) {
+  struct ncclNetSocketCalib* c = comm->calib;
+  *done = 0;
+  if (c == NULL) {
+    NCCLCHECK(ncclCalloc(&c, 1));
+    NCCLCHECK(ncclCalloc(&c->buf, CALIB_CHUNK));
+    for (int n=1; n<=std::min(comm->nSocks, CALIB_MAX_SOCKETS) && c->nCands<CALIB_CANDS; n*=2) c->cands[c->nCands++] = n;
+    c->bytes = std::max<int64_t>(ncclParamSocketCalibrationBytes(), CALIB_MAX_SOCKETS);
+    comm->calib = c;
+  }
+  uint64_t last = clockNano();
+  while (1) {
+    int progressed = 0;
+    if (c->phase == 0) {
+      // Control words go from the receiver to the sender
+      int ctrlOp = (op == NCCL_SOCKET_SEND) ? NCCL_SOCKET_RECV : NCCL_SOCKET_SEND;
+      int offset = c->ctrlOffset;
+      NCCLCHECK(ncclSocketProgress(ctrlOp, &comm->ctrlSock, &c->ctrl, sizeof(int), &c->ctrlOffset));
+      progressed = c->ctrlOffset != offset;
+      if (c->ctrlOffset == sizeof(int)) {
+        c->ctrlOffset = 0;
+        if (c->ctrl < 0) {
+          c->choice = -1-c->ctrl;
+          break;
+        }
+        if (c->ctrl >= c->nCands) {
+          WARN("NET/Socket : invalid calibration candidate %d", c->ctrl);
+          return ncclInternalError;
+        }
+        c->cand = c->ctrl;
+        c->phase = 1;
+        c->start = 0;
+        memset(c->moved, 0, sizeof(c->moved));
+      }
+    } else {
+      int n = c->cands[c->cand];
+      int64_t perSock = c->bytes/n;
+      int busy = 0;
+      for (int s=0; s<n; s++) {
+        if (c->moved[s] == perSock) continue;
+        int offset = 0;
+        NCCLCHECK(ncclSocketProgress(op, comm->socks+s, c->buf, (int)std::min<int64_t>(CALIB_CHUNK, perSock-c->moved[s]), &offset));
+        if (offset) {
+          progressed = 1;
+          if (c->start == 0) c->start = clockNano();
+        }
+        c->moved[s] += offset;
+        if (c->moved[s] < perSock) busy = 1;
+      }
+      if (busy == 0) {
+        if (op == NCCL_SOCKET_RECV) {
+          c->bw[c->cand] = (double)(perSock*n) / std::max<uint64_t>(clockNano()-c->start, 1);
+          INFO(NCCL_NET, "NET/Socket : Calibration of %s with %d sockets : %.2f GB/s", ncclNetSocketDevs[comm->dev].devName, n, c->bw[c->cand]);
+          c->ctrl = (c->cand+1 < c->nCands) ? c->cand+1 : -1-ncclNetSocketCalibChoose(c);
+        }
+        c->phase = 0;
       }
-      pthread_mutex_unlock(&resource->threadLock);
     }
-    if (resource->stop) return NULL;
+    uint64_t now = clockNano();
+    if (progressed) last = now;
+    else if (now-last > CALIB_IDLE_NS) return ncclSuccess;
   }
+
+  int nSocks, nThreads;
+  ncclNetSocketCalibConfig(c->cands[c->choice], &nSocks, &nThreads);
+  for (int s=nSocks; s<comm->nSocks; s++) NCCLCHECK(ncclSocketClose(comm->socks+s));
+  comm->nSocks = nSocks;
+  comm->nThreads = nThreads;
+  if (op == NCCL_SOCKET_RECV) {
+    ncclNetSocketCalibStore(comm->dev, nSocks, nThreads);
+    INFO(NCCL_NET|NCCL_INIT, "NET/Socket : Calibrated %s to %d threads and %d sockets", ncclNetSocketDevs[comm->dev].devName, nThreads, nSocks);
+  }
+  free(c->buf);
+  free(c);
+  comm->calib = NULL;
+  *done = 1;
+  return ncclSuccess;
 }
 
-ncclResult_t ncclNetSocketGetNsockNthread(int dev, int* ns, int* nt) {
+ncclResult_t ncclNetSocketGetNsockNthread(int dev, int* ns, int* nt, int* calibrate) {
   int nSocksPerThread = ncclParamSocketNsocksPerThread();
   int nThreads = ncclParamSocketNthreads();
   if (nThreads > MAX_THREADS) {
     WARN("NET/Socket : NCCL_SOCKET_NTHREADS is greater than the maximum allowed, setting to %d", MAX_THREADS);
     nThreads = MAX_THREADS;
   }
+  *calibrate = 0;
+  if (nThreads == -2 && nSocksPerThread == -2 && ncclParamSocketCalibrate()) {
+    if (ncclNetSocketCalibLoad(dev, ns, nt)) {
+      INFO(NCCL_NET, "NET/Socket : Using calibrated %d threads and %d sockets for %s", *nt, *ns, ncclNetSocketDevs[dev].devName);
+    } else {
+      *ns = CALIB_MAX_SOCKETS;
+      *nt = CALIB_MAX_THREADS;
+      *calibrate = 1;
+    }
+    return ncclSuccess;
+  }
   if (nThreads == -2 || nSocksPerThread == -2) {
     // Auto-detection
     int autoNt=0, autoNs=1; // By default, we only use the main thread and do not spawn extra threads
@@ -270,6 +943,8 @@ ncclResult_t ncclNetSocketGetNsockNthread(int dev, int* ns, int* nt) {
       autoNs = 1;
     }
 end:
+    // The io_uring backend only drives data sockets, so make sure we have at least one.
+    if (autoNt == 0 && ncclParamSocketIoUring()) autoNt = 1;
     if (nThreads == -2) nThreads = autoNt;
     if (nSocksPerThread == -2) nSocksPerThread = autoNs;
   }
@@ -281,7 +956,105 @@ end:
   }
   *ns = nSocks;
   *nt = nThreads;
-  if (nSocks > 0) INFO(NCCL_ALL, "NET/Socket: Using %d threads and %d sockets per thread", nThreads, nSocksPerThread);
+  if (nSocks > 0) INFO(NCCL_INIT|NCCL_NET, "NET/Socket: Using %d threads and %d sockets per thread", nThreads, nSocksPerThread);
+  return ncclSuccess;
+}
+
+// Rail of data socket s. Sockets are spread over rails in proportion to their speed with a
+// smooth weighted round-robin, so that any prefix of the sockets (e.g. what is left after
+// calibration) is balanced as well. Equal-sized chunks then split messages in proportion.
+static int ncclNetSocketSockRail(int s, int nRails, const int* speed) {
+  int64_t current[MAX_RAILS] = { 0 };
+  int64_t total = 0;
+  int rail = 0;
+  for (int r=0; r<nRails; r++) total += speed[r];
+  for (int i=0; i<=s && nRails>1; i++) {
+    rail = 0;
+    for (int r=1; r<nRails; r++) if (current[r]+speed[r] > current[rail]+speed[rail]) rail = r;
+    for (int r=0; r<nRails; r++) current[r] += speed[r];
+    current[rail] -= total;
+  }
+  return rail;
+}
+
+// Socket i of a comm, the control socket and latency lane coming after the data sockets, connects
+// to the listening socket of its rail. The acceptor does not know which connection is which until
+// it gets its index, but it expects as many on each listening socket.
+static union ncclSocketAddress* ncclNetSocketConnectAddr(struct ncclNetSocketHandle* handle, int i, int nSocks) {
+  int rail = (i >= nSocks) ? 0 : ncclNetSocketSockRail(i, handle->nRails, handle->railSpeed);
+  return rail ? handle->railAddr+rail-1 : &handle->connectAddr;
+}
+
+static struct ncclSocket* ncclNetSocketListenSock(struct ncclNetSocketListenComm* comm, int i, int nSocks) {
+  int rail = (i >= nSocks) ? 0 : ncclNetSocketSockRail(i, comm->nRails, comm->railSpeed);
+  return rail ? comm->railSocks+rail-1 : &comm->sock;
+}
+
+// Listen on the other interfaces as well, starting with the one following dev so that
+// comms of different devices favor different pairs of interfaces.
+static ncclResult_t ncclNetSocketListenRails(int dev, struct ncclNetSocketListenComm* comm, struct ncclNetSocketHandle* handle) {
+  if (ncclParamSocketMultiRail() == 0 || ncclNetIfs < 2) return ncclSuccess;
+  if (comm->nSocks < 2) {
+    INFO(NCCL_NET, "NET/Socket : Multi-rail needs at least 2 data sockets, using %s only", ncclNetSocketDevs[dev].devName);
+    return ncclSuccess;
+  }
+  comm->nRails = std::min(ncclNetIfs, MAX_RAILS);
+  char line[MAX_RAILS*(MAX_IF_NAME_SIZE+16)];
+  line[0] = '\0';
+  for (int r=0; r<comm->nRails; r++) {
+    int railDev = (dev+r) % ncclNetIfs;
+    NCCLCHECK(ncclNetSocketGetSpeed(ncclNetSocketDevs[railDev].devName, comm->railSpeed+r));
+    snprintf(line+strlen(line), sizeof(line)-strlen(line), " %s(%d)", ncclNetSocketDevs[railDev].devName, comm->railSpeed[r]);
+    if (r == 0) continue;
+    NCCLCHECK(ncclSocketInit(comm->railSocks+r-1, &ncclNetSocketDevs[railDev].addr, handle->magic, ncclSocketTypeNetSocket, NULL, 1));
+    NCCLCHECK(ncclSocketListen(comm->railSocks+r-1));
+    NCCLCHECK(ncclSocketGetAddr(comm->railSocks+r-1, handle->railAddr+r-1));
+  }
+  handle->nRails = comm->nRails;
+  memcpy(handle->railSpeed, comm->railSpeed, sizeof(handle->railSpeed));
+  INFO(NCCL_NET, "NET/Socket : Spreading %d sockets over%s", comm->nSocks, line);
+  return ncclSuccess;
+}
+
+// AF_XDP socket of a device, opened the first time a comm asks for it. NULL if AF_XDP is disabled
+// or cannot be used on the device, in which case we stay on TCP.
+static struct ncclXdpDev* ncclNetSocketXdpDev(int dev) {
+  if (ncclParamSocketXdp() == 0 || ncclParamSocketFraming() == 0) return NULL;
+  struct ncclNetSocketDev* d = ncclNetSocketDevs+dev;
+  pthread_mutex_lock(&ncclNetSocketLock);
+  if (d->xdpTried == 0) {
+    d->xdpTried = 1;
+    if (d->addr.sa.sa_family != AF_INET) {
+      INFO(NCCL_NET, "NET/Socket : AF_XDP needs an IPv4 address, not using it on %s", d->devName);
+    } else if (ncclXdpOpen(d->devName, &d->addr, ncclParamSocketXdp() == 2, &d->xdp) != ncclSuccess) {
+      INFO(NCCL_NET, "NET/Socket : could not use AF_XDP on %s, using TCP", d->devName);
+      d->xdp = NULL;
+    }
+  }
+  pthread_mutex_unlock(&ncclNetSocketLock);
+  return d->xdp;
+}
+
+// Exchange the AF_XDP addresses of both ends over the control socket. Either end may have failed
+// to open its AF_XDP socket, in which case the comm stays on TCP.
+static ncclResult_t ncclNetSocketXdpConnect(struct ncclNetSocketComm* comm, int* done) {
+  *done = 0;
+  if (comm->xdpSendOffset == 0 && comm->xdpRecvOffset == 0 && comm->xdpLocal.valid == 0) {
+    struct ncclXdpDev* dev = ncclNetSocketXdpDev(comm->dev);
+    if (dev) NCCLCHECK(ncclXdpConnCreate(dev, &comm->xdp, &comm->xdpLocal));
+  }
+  int size = sizeof(struct ncclXdpAddr);
+  if (comm->xdpSendOffset < size) NCCLCHECK(ncclSocketProgress(NCCL_SOCKET_SEND, &comm->ctrlSock, &comm->xdpLocal, size, &comm->xdpSendOffset));
+  if (comm->xdpRecvOffset < size) NCCLCHECK(ncclSocketProgress(NCCL_SOCKET_RECV, &comm->ctrlSock, &comm->xdpRemote, size, &comm->xdpRecvOffset));
+  if (comm->xdpSendOffset < size || comm->xdpRecvOffset < size) return ncclSuccess;
+  if (comm->xdp && comm->xdpRemote.valid) {
+    NCCLCHECK(ncclXdpConnConnect(comm->xdp, &comm->xdpRemote));
+    INFO(NCCL_NET, "NET/Socket : Using AF_XDP on %s", ncclNetSocketDevs[comm->dev].devName);
+  } else if (comm->xdp) {
+    NCCLCHECK(ncclXdpConnClose(comm->xdp));
+    comm->xdp = NULL;
+  }
+  *done = 1;
   return ncclSuccess;
 }
 
@@ -289,8 +1062,7 @@ ncclResult_t ncclNetSocketListen(int dev, void* opaqueHandle, void** listenComm)
   if (dev < 0 || dev >= ncclNetIfs) { // data transfer socket is based on specified dev
     return ncclInternalError;
   }
-
-  INFO(NCCL_ALL, "---- ncclNetSocketListen");
+  TRACE(NCCL_NET, "NET/Socket : listen on dev %d", dev);
 
   struct ncclNetSocketHandle* handle = (struct ncclNetSocketHandle*) opaqueHandle;
   memset(handle, 0, sizeof(struct ncclNetSocketHandle));
@@ -301,72 +1073,255 @@ ncclResult_t ncclNetSocketListen(int dev, void* opaqueHandle, void** listenComm)
   NCCLCHECK(ncclSocketInit(&comm->sock, &ncclNetSocketDevs[dev].addr, handle->magic, ncclSocketTypeNetSocket, NULL, 1));
   NCCLCHECK(ncclSocketListen(&comm->sock));
   NCCLCHECK(ncclSocketGetAddr(&comm->sock, &handle->connectAddr));
-  NCCLCHECK(ncclNetSocketGetNsockNthread(dev, &comm->nSocks, &comm->nThreads));
+  NCCLCHECK(ncclNetSocketGetNsockNthread(dev, &comm->nSocks, &comm->nThreads, &comm->calibrate));
+  // AF_XDP carries everything over a single stream, in place of the control socket
+  comm->xdp = handle->xdp = ncclNetSocketXdpDev(dev) != NULL;
+  if (comm->xdp) comm->nSocks = comm->nThreads = comm->calibrate = 0;
   handle->nSocks = comm->nSocks;
   handle->nThreads = comm->nThreads;
+  handle->calibrate = comm->calibrate;
+  NCCLCHECK(ncclNetSocketListenRails(dev, comm, handle));
+  handle->version = ncclParamSocketFraming() ? NCCL_NET_SOCKET_PROTO_COMPRESS : NCCL_NET_SOCKET_PROTO_LEGACY;
+  comm->lane = handle->lane = ncclParamSocketFraming() && ncclParamSocketLatencyLane() >= 0 && comm->xdp == 0;
   comm->dev = dev;
   *listenComm = comm;
   return ncclSuccess;
 }
 
+// Try to set up the io_uring backend for a newly established comm. Any failure leaves
+// useRing unset so that we fall back to helper threads.
+static ncclResult_t ncclNetSocketRingInit(struct ncclNetSocketComm* comm) {
+  if (ncclParamSocketIoUring() == 0 || comm->nSocks == 0) return ncclSuccess;
+  int fds[MAX_SOCKETS];
+  unsigned entries = 1;
+  while (entries < 2*comm->nSocks) entries <<= 1;
+  if (ncclIoUringInit(&comm->ring, entries) != ncclSuccess) {
+    INFO(NCCL_NET, "NET/Socket : io_uring not available, using helper threads");
+    return ncclSuccess;
+  }
+  for (int s=0; s<comm->nSocks; s++) fds[s] = comm->socks[s].fd;
+  if (ncclIoUringRegisterFiles(&comm->ring, fds, comm->nSocks) != ncclSuccess) {
+    INFO(NCCL_NET, "NET/Socket : io_uring file registration failed, using helper threads");
+    NCCLCHECK(ncclIoUringClose(&comm->ring));
+    return ncclSuccess;
+  }
+  // Registered buffers are optional; without them we use plain send/recv operations.
+  if (ncclIoUringRegisterBufferTable(&comm->ring, MAX_RING_MRS) != ncclSuccess) {
+    INFO(NCCL_NET, "NET/Socket : io_uring buffer registration not supported");
+  }
+  comm->useRing = 1;
+  INFO(NCCL_NET, "NET/Socket : Using io_uring for %d sockets", comm->nSocks);
+  return ncclSuccess;
+}
+
+static ncclResult_t ncclNetSocketStatsInit(struct ncclNetSocketComm* comm) {
+  if (ncclParamSocketStats() == 0) return ncclSuccess;
+  NCCLCHECK(ncclCalloc(&comm->stats, 1));
+  comm->statsDumpTime = clockNano();
+  return ncclSuccess;
+}
+
+// Allocate the request pool once the protocol is known. A grouped receive uses one request per
+// buffer plus one for the group, and with the framed protocol we may also have to hold as many
+// unexpected messages as the peer can have sends in flight.
+static ncclResult_t ncclNetSocketInitRequests(struct ncclNetSocketComm* comm) {
+  comm->nRequests = MAX_REQUESTS*(MAX_RECVS+(comm->framed ? 2 : 1));
+  NCCLCHECK(ncclCalloc(&comm->requests, comm->nRequests));
+  for (int i=comm->nRequests-1; i>=0; i--) {
+    comm->requests[i].next = comm->freeRequests;
+    comm->freeRequests = comm->requests+i;
+  }
+  comm->nFreeRequests = comm->nRequests;
+  return ncclSuccess;
+}
+
+// Enable MSG_ZEROCOPY on the sockets of a send comm. Sockets driven by io_uring use
+// IORING_OP_SEND_ZC instead, which does not need SO_ZEROCOPY.
+static ncclResult_t ncclNetSocketZeroCopyInit(struct ncclNetSocketComm* comm) {
+  if (ncclParamSocketZeroCopyThreshold() < 0) return ncclSuccess;
+  for (int s=0; s<comm->nSocks+1; s++) {
+    struct ncclSocket* sock = (s == comm->nSocks) ? &comm->ctrlSock : comm->socks+s;
+    if (comm->useRing && s < comm->nSocks) comm->zc[s].enabled = 1;
+    else NCCLCHECK(ncclSocketEnableZeroCopy(sock, &comm->zc[s].enabled));
+  }
+  INFO(NCCL_NET, "NET/Socket : Using zero-copy sends for messages of %ld bytes or more", ncclParamSocketZeroCopyThreshold());
+  return ncclSuccess;
+}
+
+// Set up the framed receive streams, and ask for low latency on the latency lane. The lane only
+// carries small messages, so it is enough for it to get ahead of the data sockets in the
+// interface queues; failing to set the priority is not an error.
+static ncclResult_t ncclNetSocketLaneInit(struct ncclNetSocketComm* comm) {
+  comm->ctrlIn.sock = &comm->ctrlSock;
+  if (comm->lane == 0) return ncclSuccess;
+  comm->laneIn.sock = &comm->laneSock;
+  int fd = comm->laneSock.fd;
+  int tos = IPTOS_LOWDELAY;
+  int prio = 6;
+  if (comm->laneSock.addr.sa.sa_family == AF_INET6) {
+    if (setsockopt(fd, IPPROTO_IPV6, IPV6_TCLASS, &tos, sizeof(tos)) != 0) INFO(NCCL_NET, "NET/Socket : could not set IPV6_TCLASS on the latency lane : %s", strerror(errno));
+  } else {
+    if (setsockopt(fd, IPPROTO_IP, IP_TOS, &tos, sizeof(tos)) != 0) INFO(NCCL_NET, "NET/Socket : could not set IP_TOS on the latency lane : %s", strerror(errno));
+  }
+  if (setsockopt(fd, SOL_SOCKET, SO_PRIORITY, &prio, sizeof(prio)) != 0) INFO(NCCL_NET, "NET/Socket : could not set SO_PRIORITY on the latency lane : %s", strerror(errno));
+  INFO(NCCL_NET, "NET/Socket : Using a latency lane for messages of %ld bytes or less", ncclParamSocketLatencyLane());
+  return ncclSuccess;
+}
+
+// Compress sends if asked to and the peer can decompress them. Only messages sent over the control
+// socket are compressed, as data sockets carry fixed-size chunks of each message.
+static ncclResult_t ncclNetSocketCompressInit(struct ncclNetSocketComm* comm, struct ncclNetSocketHandle* handle) {
+  int64_t elemSize = ncclParamSocketCompress();
+  if (elemSize == 0 || comm->framed == 0) return ncclSuccess;
+  if (elemSize != 1 && elemSize != 2 && elemSize != 4 && elemSize != 8) {
+    WARN("NET/Socket : NCCL_SOCKET_COMPRESS must be 0, 1, 2, 4 or 8, not compressing");
+    return ncclSuccess;
+  }
+  if (handle->version < NCCL_NET_SOCKET_PROTO_COMPRESS || comm->nSocks > 0) {
+    INFO(NCCL_NET, "NET/Socket : Compression needs a peer supporting it and no data sockets, not compressing");
+    return ncclSuccess;
+  }
+  comm->compress = elemSize;
+  INFO(NCCL_NET, "NET/Socket : Compressing messages of %d bytes or more, with %ld-byte elements", COMPRESS_MIN_SIZE, elemSize);
+  return ncclSuccess;
+}
+
+// Socket of index i of a comm, in the order sockets are connected: data sockets, then the control
+// socket, then the latency lane
+static struct ncclSocket* ncclNetSocketCommSock(struct ncclNetSocketComm* comm, int i) {
+  return (i > comm->nSocks) ? &comm->laneSock : (i == comm->nSocks) ? &comm->ctrlSock : comm->socks+i;
+}
+
+// Start all connections of a comm at once. Each one sends its index once established.
+static ncclResult_t ncclNetSocketConnectProgress(struct ncclNetSocketComm* comm, int* done) {
+  struct ncclNetSocketEstablish* e = comm->establish;
+  for (int i=0; i<e->n; i++) {
+    if (e->offset[i] == sizeof(uint8_t)) continue;
+    struct ncclSocket* sock = ncclNetSocketCommSock(comm, i);
+    int ready;
+    NCCLCHECK(ncclSocketReady(sock, &ready));
+    if (!ready) continue;
+    // Older receivers do not advertise a protocol version, so they never see the framed flag.
+    // They do not ask for calibration either.
+    e->idx[i] = i | (comm->framed ? NCCL_NET_SOCKET_IDX_FRAMED : 0) | (comm->calibrate ? NCCL_NET_SOCKET_IDX_CALIBRATE : 0);
+    NCCLCHECK(ncclSocketProgress(NCCL_SOCKET_SEND, sock, e->idx+i, sizeof(uint8_t), e->offset+i));
+    if (e->offset[i] == sizeof(uint8_t)) e->nDone++;
+  }
+  *done = e->nDone == e->n;
+  return ncclSuccess;
+}
+
 ncclResult_t ncclNetSocketConnect(int dev, void* opaqueHandle, void** sendComm, ncclNetDeviceHandle_t** /*sendDevComm*/) {
   if (dev < 0 || dev >= ncclNetIfs) { // data transfer socket is based on specified dev
     return ncclInternalError;
   }
 
-  int ready;
   struct ncclNetSocketHandle* handle = (struct ncclNetSocketHandle*) opaqueHandle;
   struct ncclNetSocketCommStage* stage = &handle->stage;
   struct ncclNetSocketComm* comm = stage->comm;
-  uint8_t i = stage->iteration;
-  struct ncclSocket* sock = stage->sock;
   *sendComm = NULL;
 
   if (stage->state == ncclNetSocketCommStateConnect) goto socket_connect_check;
-  if (stage->state == ncclNetSocketCommStateSend) goto socket_send;
+  if (stage->state == ncclNetSocketCommStateCalibrate) goto socket_calibrate;
+  if (stage->state == ncclNetSocketCommStateXdp) goto socket_xdp;
 
   NCCLCHECK(ncclCalloc(&comm, 1));
   stage->comm = comm;
   comm->nSocks = handle->nSocks;
   comm->nThreads = handle->nThreads;
   comm->dev = dev;
+  comm->framed = handle->version >= NCCL_NET_SOCKET_PROTO_FRAMED && ncclParamSocketFraming();
+  // The lane is opened whenever the listener accepts it; we only send over it if enabled here too
+  comm->lane = comm->framed && handle->lane;
+  comm->calibrate = handle->calibrate;
   CUDACHECK(cudaGetDevice(&comm->cudaDev));
-  for (; i<comm->nSocks+1; i++) {
-    sock = (i == comm->nSocks) ? &comm->ctrlSock : comm->socks+i;
-    NCCLCHECK(ncclSocketInit(sock, &handle->connectAddr, handle->magic, ncclSocketTypeNetSocket, NULL, 1));
-
-    stage->sock = sock;
-    stage->state = ncclNetSocketCommStateConnect;
-    stage->iteration = i;
+  NCCLCHECK(ncclCalloc(&comm->establish, 1));
+  comm->establish->n = comm->nSocks+1+comm->lane;
+  for (int i=0; i<comm->establish->n; i++) {
+    struct ncclSocket* sock = ncclNetSocketCommSock(comm, i);
+    NCCLCHECK(ncclSocketInit(sock, ncclNetSocketConnectAddr(handle, i, comm->nSocks), handle->magic, ncclSocketTypeNetSocket, NULL, 1));
     NCCLCHECK(ncclSocketConnect(sock));
+  }
+  stage->state = ncclNetSocketCommStateConnect;
 
 socket_connect_check:
-    NCCLCHECK(ncclSocketReady(sock, &ready));
-    if (! ready) return ncclSuccess;
-    stage->state = ncclNetSocketCommStateSend;
-
-socket_send:
-    int done = 0;
-    //only two times in our scenario
-    INFO(NCCL_ALL,"XXXXXXXXXXXXXXXXXXXXXXXXX ncclNetSocketConnect socket_send");
-    NCCLCHECK(ncclSocketProgress(NCCL_SOCKET_SEND, sock, &i, sizeof(uint8_t), &done));
-    if (done == 0) return ncclSuccess;
+  int connected;
+  NCCLCHECK(ncclNetSocketConnectProgress(comm, &connected));
+  if (connected == 0) return ncclSuccess;
+  free(comm->establish);
+  comm->establish = NULL;
+  if (comm->calibrate) {
+    stage->state = ncclNetSocketCommStateCalibrate;
+socket_calibrate:
+    int calibrated;
+    NCCLCHECK(ncclNetSocketCalibrate(comm, NCCL_SOCKET_SEND, &calibrated));
+    if (calibrated == 0) return ncclSuccess;
+  }
+  if (comm->framed && handle->xdp) {
+    stage->state = ncclNetSocketCommStateXdp;
+socket_xdp:
+    int connected;
+    NCCLCHECK(ncclNetSocketXdpConnect(comm, &connected));
+    if (connected == 0) return ncclSuccess;
   }
+  NCCLCHECK(ncclNetSocketRingInit(comm));
+  if (comm->xdp == NULL) NCCLCHECK(ncclNetSocketZeroCopyInit(comm));
+  NCCLCHECK(ncclNetSocketInitRequests(comm));
+  NCCLCHECK(ncclNetSocketStatsInit(comm));
+  NCCLCHECK(ncclNetSocketLaneInit(comm));
+  NCCLCHECK(ncclNetSocketCompressInit(comm, handle));
   *sendComm = comm;
   return ncclSuccess;
 }
 
+// Accept the connections of a comm in whatever order they arrive, and put each one in place once
+// its index has been received. The first index tells whether the peer uses the framed protocol,
+// hence whether a latency lane follows.
+static ncclResult_t ncclNetSocketAcceptProgress(struct ncclNetSocketListenComm* lComm, struct ncclNetSocketComm* rComm, int* done) {
+  struct ncclNetSocketEstablish* e = rComm->establish;
+  for (int p=0; p<e->n; p++) {
+    if (e->offset[p] == sizeof(uint8_t)) continue;
+    struct ncclSocket* sock = e->socks+p;
+    if (e->started[p] == 0) {
+      // Connection p arrives on the listening socket of the rail of socket p, whatever its index
+      NCCLCHECK(ncclSocketInit(sock));
+      NCCLCHECK(ncclSocketAccept(sock, ncclNetSocketListenSock(lComm, p, rComm->nSocks)));
+      e->started[p] = 1;
+    }
+    int ready;
+    NCCLCHECK(ncclSocketReady(sock, &ready));
+    if (!ready) continue;
+    NCCLCHECK(ncclSocketProgress(NCCL_SOCKET_RECV, sock, e->idx+p, sizeof(uint8_t), e->offset+p));
+    if (e->offset[p] < sizeof(uint8_t)) continue;
+    uint8_t idx = e->idx[p];
+    if (e->nDone++ == 0) {
+      rComm->framed = (idx & NCCL_NET_SOCKET_IDX_FRAMED) ? 1 : 0;
+      rComm->lane = rComm->framed && lComm->lane;
+      rComm->calibrate = lComm->calibrate && (idx & NCCL_NET_SOCKET_IDX_CALIBRATE);
+      e->n += rComm->lane;
+    }
+    idx &= ~NCCL_NET_SOCKET_IDX_FRAMED;
+    if (lComm->calibrate) idx &= ~NCCL_NET_SOCKET_IDX_CALIBRATE;
+    if (idx >= rComm->nSocks+1+rComm->lane) {
+      char line[SOCKET_NAME_MAXLEN+1];
+      WARN("NET/Socket : peer %s sent invalid socket index %d", ncclSocketToString(&sock->addr, line), idx);
+      return ncclRemoteError;
+    }
+    memcpy(ncclNetSocketCommSock(rComm, idx), sock, sizeof(struct ncclSocket));
+  }
+  *done = e->nDone == e->n;
+  return ncclSuccess;
+}
+
 ncclResult_t ncclNetSocketAccept(void* listenComm, void** recvComm, ncclNetDeviceHandle_t** /*recvDevComm*/) {
   struct ncclNetSocketListenComm* lComm = (struct ncclNetSocketListenComm*)listenComm;
   struct ncclNetSocketCommStage* stage = &lComm->stage;
   struct ncclNetSocketComm* rComm = stage->comm;
-  uint8_t i = stage->iteration;
-  struct ncclSocket* sock = stage->sock;
-  int ready;
 
   *recvComm = NULL;
   if (stage->state == ncclNetSocketCommStateAccept) goto socket_accept_check;
-  if (stage->state == ncclNetSocketCommStateRecv) goto socket_recv;
+  if (stage->state == ncclNetSocketCommStateCalibrate) goto socket_calibrate;
+  if (stage->state == ncclNetSocketCommStateXdp) goto socket_xdp;
 
   NCCLCHECK(ncclCalloc(&rComm, 1));
   stage->comm = rComm;
@@ -374,34 +1329,38 @@ ncclResult_t ncclNetSocketAccept(void* listenComm, void** recvComm, ncclNetDevic
   rComm->nThreads = lComm->nThreads;
   rComm->dev = lComm->dev;
   CUDACHECK(cudaGetDevice(&rComm->cudaDev));
-  for (; i<rComm->nSocks+1; i++) {
-    uint8_t sendSockIdx;
-
-    NCCLCHECK(ncclCalloc(&sock, 1));
-    NCCLCHECK(ncclSocketInit(sock));
-    stage->sock = sock;
-    stage->state = ncclNetSocketCommStateAccept;
-    stage->iteration = i;
-    NCCLCHECK(ncclSocketAccept(sock, &lComm->sock));
+  NCCLCHECK(ncclCalloc(&rComm->establish, 1));
+  rComm->establish->n = rComm->nSocks+1;
+  stage->state = ncclNetSocketCommStateAccept;
 
 socket_accept_check:
-    NCCLCHECK(ncclSocketReady(sock, &ready));
-    if (!ready) return ncclSuccess;
-
-    stage->state = ncclNetSocketCommStateRecv;
-socket_recv:
-    int done = 0;
-    //only two times in our scenario
-    INFO(NCCL_ALL,"XXXXXXXXXXXXXXXXXXXXXXXXX ncclNetSocketAccept socket_recv");
-    NCCLCHECK(ncclSocketProgress(NCCL_SOCKET_RECV, sock, &sendSockIdx, sizeof(uint8_t), &done));
-    if (done == 0) return ncclSuccess;
-
-    if (sendSockIdx == rComm->nSocks)
-      memcpy(&rComm->ctrlSock, sock, sizeof(struct ncclSocket));
-    else
-      memcpy(rComm->socks+sendSockIdx, sock, sizeof(struct ncclSocket));
-    free(sock);
+  int accepted;
+  NCCLCHECK(ncclNetSocketAcceptProgress(lComm, rComm, &accepted));
+  if (accepted == 0) return ncclSuccess;
+  free(rComm->establish);
+  rComm->establish = NULL;
+  if (lComm->calibrate && rComm->calibrate == 0) {
+    INFO(NCCL_NET, "NET/Socket : peer does not support calibration, using %d threads and %d sockets", rComm->nThreads, rComm->nSocks);
+  }
+  if (rComm->calibrate) {
+    stage->state = ncclNetSocketCommStateCalibrate;
+socket_calibrate:
+    int calibrated;
+    NCCLCHECK(ncclNetSocketCalibrate(rComm, NCCL_SOCKET_RECV, &calibrated));
+    if (calibrated == 0) return ncclSuccess;
   }
+  if (rComm->framed && lComm->xdp) {
+    stage->state = ncclNetSocketCommStateXdp;
+socket_xdp:
+    int connected;
+    NCCLCHECK(ncclNetSocketXdpConnect(rComm, &connected));
+    if (connected == 0) return ncclSuccess;
+  }
+  NCCLCHECK(ncclNetSocketRingInit(rComm));
+  NCCLCHECK(ncclNetSocketInitRequests(rComm));
+  NCCLCHECK(ncclNetSocketStatsInit(rComm));
+  NCCLCHECK(ncclNetSocketLaneInit(rComm));
+  if (rComm->framed) INFO(NCCL_NET, "NET/Socket : Using framed protocol");
   *recvComm = rComm;
 
   /* reset lComm state */
@@ -412,82 +1371,606 @@ socket_recv:
   return ncclSuccess;
 }
 
-ncclResult_t ncclNetSocketGetRequest(struct ncclNetSocketComm* comm, int op, void* data, int size, struct ncclNetSocketRequest** req) {
-  for (int i=0; i<MAX_REQUESTS; i++) {
-    struct ncclNetSocketRequest* r = comm->requests+i;
-    if (r->used == 0) {
-      r->op = op;
-      r->data = data;
-      r->size = size;
-      r->ctrlSock = &comm->ctrlSock;
-      r->used = 1;
-      r->comm = comm;
-      r->nSubs = 0;
-      *req = r;
-      return ncclSuccess;
+// Take a request from the free list. *req is set to NULL when all requests are in use; the
+// caller then returns a NULL request so that the proxy retries later.
+ncclResult_t ncclNetSocketGetRequest(struct ncclNetSocketComm* comm, int op, void* data, int size, struct ncclNetSocketMr* mr, struct ncclNetSocketRequest** req) {
+  struct ncclNetSocketRequest* r = comm->freeRequests;
+  *req = r;
+  if (r == NULL) return ncclSuccess;
+  comm->freeRequests = r->next;
+  comm->nFreeRequests--;
+  r->op = op;
+  r->data = data;
+  r->size = size;
+  r->offset = 0;
+  r->ctrlSock = &comm->ctrlSock;
+  r->used = 1;
+  r->comm = comm;
+  r->nSubs = 0;
+  r->mr = mr;
+  r->zc = 0;
+  r->hdrSize = 0;
+  r->hdrOffset = 0;
+  r->tag = 0;
+  r->next = NULL;
+  r->unex = NULL;
+  r->unexpected = 0;
+  r->nRecvs = 0;
+  r->compressed = 0;
+  r->start = comm->stats ? clockNano() : 0;
+  return ncclSuccess;
+}
+
+static ncclResult_t ncclNetSocketThreadWake(struct ncclNetSocketThreadResources* res) {
+  uint64_t one = 1;
+  if (write(res->eventFd, &one, sizeof(one)) == -1 && errno != EAGAIN) {
+    WARN("NET/Socket : eventfd write failed : %s", strerror(errno));
+    return ncclSystemError;
+  }
+  return ncclSuccess;
+}
+
+// Register the data sockets served by helper thread tid, and its doorbell, in a new epoll instance
+static ncclResult_t ncclNetSocketThreadEpollInit(struct ncclNetSocketComm* comm, int tid, struct ncclNetSocketThreadResources* res) {
+  struct epoll_event ev;
+  SYSCHECKVAL(epoll_create1(EPOLL_CLOEXEC), "epoll_create1", res->epollFd);
+  SYSCHECKVAL(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC), "eventfd", res->eventFd);
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.u32 = NCCL_NET_SOCKET_EVENTFD_ID;
+  SYSCHECK(epoll_ctl(res->epollFd, EPOLL_CTL_ADD, res->eventFd, &ev), "epoll_ctl");
+  // Tasks are handed out round-robin over sockets, so thread tid serves sockets tid, tid+nThreads, ...
+  for (int s=tid; s<comm->nSocks; s+=comm->nThreads) {
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    ev.data.u32 = s;
+    SYSCHECK(epoll_ctl(res->epollFd, EPOLL_CTL_ADD, comm->socks[s].fd, &ev), "epoll_ctl");
+  }
+  int busyPoll = ncclParamSocketBusyPoll();
+  if (busyPoll > 0) {
+    // SO_BUSY_POLL records the device queue of each socket for epoll; the epoll instance then
+    // busy-polls those queues before sleeping. Without kernel support, only the net.core.busy_poll
+    // sysctl enables it.
+    for (int s=tid; s<comm->nSocks; s+=comm->nThreads) {
+      if (setsockopt(comm->socks[s].fd, SOL_SOCKET, SO_BUSY_POLL, &busyPoll, sizeof(busyPoll)) != 0) {
+        INFO(NCCL_NET, "NET/Socket : could not set SO_BUSY_POLL : %s", strerror(errno));
+        break;
+      }
+    }
+    struct epoll_params params;
+    memset(&params, 0, sizeof(params));
+    params.busy_poll_usecs = busyPoll;
+    params.busy_poll_budget = 8;
+    if (ioctl(res->epollFd, EPIOCSPARAMS, &params) != 0) {
+      INFO(NCCL_NET, "NET/Socket : epoll busy polling not supported (%s), relying on net.core.busy_poll", strerror(errno));
     }
   }
-  WARN("NET/Socket : unable to allocate requests");
-  return ncclInternalError;
+  return ncclSuccess;
 }
 
-ncclResult_t ncclNetSocketGetTask(struct ncclNetSocketComm* comm, int op, void* data, int size, struct ncclNetSocketTask** req) {
+static int ncclNetSocketUseZeroCopy(struct ncclNetSocketComm* comm, int s, int op, int size) {
+  int64_t threshold = ncclParamSocketZeroCopyThreshold();
+  return op == NCCL_SOCKET_SEND && threshold >= 0 && size > 0 && size >= threshold && __atomic_load_n(&comm->zc[s].enabled, __ATOMIC_RELAXED);
+}
 
-  INFO(NCCL_ALL, "XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX ncclNetSocketGetTask ");
-  int tid = comm->nextSock % comm->nThreads;
+// Post a task on data socket s. hdr, if not NULL, is the header to send in front of the data, or
+// the header expected in front of it; in the latter case data is only received if the header
+// carries the expected sequence number and tag.
+ncclResult_t ncclNetSocketGetTask(struct ncclNetSocketComm* comm, int s, int op, void* data, int size, struct ncclNetSocketMr* mr, struct ncclNetSocketHeader* hdr, struct ncclNetSocketTask** req) {
+  NCCL_TRACEPOINT(NCCL_NET, ncclTraceSocketGetTask, s, op, size);
+  // With io_uring, all tasks live in a single queue progressed by the proxy thread
+  int tid = comm->useRing ? 0 : s % comm->nThreads;
   struct ncclNetSocketThreadResources* res = comm->threadResources+tid;
   struct ncclNetSocketTaskQueue* queue = &res->threadTaskQueue;
   // create helper threads and prepare per-thread task queue
   if (queue->tasks == NULL) {
     // each request can be divided up to nSocks tasks, and
     // these tasks are distributed to nThreads threads,
-    // we need to make sure each thread queue has enough slots for MAX_REQUESTS
-    queue->len = MAX_REQUESTS * DIVUP(comm->nSocks, comm->nThreads);
+    // we need to make sure each thread queue has enough slots for all requests
+    // Since tasks are posted on consecutive sockets, a request never holds more than that
+    // many tasks of a queue, so the free list cannot run out while requests are available.
+    queue->len = comm->nRequests * (comm->useRing ? comm->nSocks : DIVUP(comm->nSocks, comm->nThreads));
     NCCLCHECK(ncclCalloc(&queue->tasks, queue->len));
-    queue->next = 0;
+    for (int i=queue->len-1; i>=0; i--) {
+      queue->tasks[i].nextFree = queue->freeTasks;
+      queue->freeTasks = queue->tasks+i;
+    }
+    int ringSize = 1;
+    while (ringSize < queue->len) ringSize <<= 1;
+    NCCLCHECK(ncclCalloc(&queue->ring, ringSize));
+    queue->ringMask = ringSize-1;
+    NCCLCHECK(ncclCalloc(&res->active, queue->len));
     res->comm = comm;
-    pthread_mutex_init(&res->threadLock, NULL);
-    pthread_cond_init(&res->threadCond, NULL);
-    pthread_create(comm->helperThread+tid, NULL, persistentSocketThread, res);
-    ncclSetThreadName(comm->helperThread[tid], "NCCL Sock%c%1u%2u%2u", op == NCCL_SOCKET_SEND ? 'S' : 'R', comm->dev, tid, comm->cudaDev);
-  }
-  struct ncclNetSocketTask* r = queue->tasks+queue->next;
-  if (r->used == 0) {
-    r->op = op;
-    r->data = data;
-    r->size = size;
-    r->sock = comm->socks + comm->nextSock;
-    r->offset = 0;
-    r->result = ncclSuccess;
+    if (comm->useRing == 0) {
+      NCCLCHECK(ncclNetSocketThreadEpollInit(comm, tid, res));
+      pthread_create(comm->helperThread+tid, NULL, persistentSocketThread, res);
+      ncclSetThreadName(comm->helperThread[tid], "NCCL Sock%c%1u%2u%2u", op == NCCL_SOCKET_SEND ? 'S' : 'R', comm->dev, tid, comm->cudaDev);
+    }
+  }
+  struct ncclNetSocketTask* r = queue->freeTasks;
+  // Every task belongs to a request (inTask to the oldest posted receive, which has no other task)
+  // and no request holds more tasks of a queue than the sizing above allows for, so a task is
+  // always free. Back-pressure happens earlier, when isend/irecv find no free request.
+  assert(r != NULL);
+  queue->freeTasks = r->nextFree;
+  r->op = op;
+  r->data = data;
+  r->size = size;
+  r->sock = comm->socks + s;
+  r->offset = 0;
+  r->result = ncclSuccess;
+  r->mr = mr;
+  r->zc = ncclNetSocketUseZeroCopy(comm, s, op, size);
+  r->zcSeq = 0;
+  r->zcNotifs = 0;
+  r->zcDone = 0;
+  r->hdrSize = hdr ? sizeof(struct ncclNetSocketHeader) : 0;
+  r->hdrOffset = 0;
+  if (hdr && op == NCCL_SOCKET_SEND) r->hdr = *hdr;
+  r->tag = (hdr && op == NCCL_SOCKET_RECV) ? hdr->tag : 0;
+  r->seq = (hdr && op == NCCL_SOCKET_RECV) ? hdr->seq : 0;
+  r->closed = 0;
+  r->done = 0;
+  r->used = 1;
+  *req = r;
+  queue->ring[queue->tail & queue->ringMask] = r;
+  __atomic_store_n(&queue->tail, queue->tail+1, __ATOMIC_SEQ_CST);
+  if (comm->useRing) return ncclSuccess;
+  // Only ring the doorbell when the helper thread is (about to be) parked in epoll_wait
+  if (__atomic_load_n(&res->parked, __ATOMIC_SEQ_CST)) NCCLCHECK(ncclNetSocketThreadWake(res));
+  return ncclSuccess;
+}
+
+// Reap io_uring completions, then issue the next operation on every idle data socket.
+// Operations on a given socket are kept in order by having at most one in flight per socket.
+static ncclResult_t ncclNetSocketRingProgress(struct ncclNetSocketComm* comm) {
+  struct ncclIoUring* ring = &comm->ring;
+  struct io_uring_cqe* cqe;
+  while ((cqe = ncclIoUringPeekCqe(ring)) != NULL) {
+    struct ncclNetSocketTask* r = (struct ncclNetSocketTask*)(uintptr_t)cqe->user_data;
+    int res = cqe->res;
+    unsigned flags = cqe->flags;
+    ncclIoUringCqeSeen(ring);
+    if (flags & IORING_CQE_F_NOTIF) {
+      // The kernel no longer references the pages of a previous IORING_OP_SEND_ZC
+      if (res & IORING_NOTIF_USAGE_ZC_COPIED) comm->zc[r->sock - comm->socks].enabled = 0;
+      if (--r->zcNotifs == 0 && r->offset == r->size) r->zcDone = 1;
+      continue;
+    }
+    comm->ringInflight[r->sock - comm->socks] = NULL;
+    if (flags & IORING_CQE_F_MORE) r->zcNotifs++;
+    if (res == -EINVAL && r->zc && r->offset < r->size) {
+      // IORING_OP_SEND_ZC is not supported by this kernel (< 6.0); retry with a regular send.
+      INFO(NCCL_NET, "NET/Socket : io_uring zero-copy send not supported, disabling");
+      for (int s=0; s<comm->nSocks; s++) comm->zc[s].enabled = 0;
+      r->zc = 0;
+    } else if (res > 0) {
+      ncclNetSocketStatsCount(comm, r->sock - comm->socks, res, r->hdrOffset < r->hdrSize ? r->hdrSize-r->hdrOffset : r->size-r->offset);
+      if (r->hdrOffset < r->hdrSize) ncclNetSocketSetHdrOffset(comm, r, r->hdrOffset+res);
+      else r->offset += res;
+    } else if (res == 0 && r->op == NCCL_SOCKET_RECV && comm->lane && r->hdrOffset == 0 && r->hdrSize) {
+      r->closed = 1;
+    } else if (res == 0 && r->op == NCCL_SOCKET_RECV) {
+      char line[SOCKET_NAME_MAXLEN+1];
+      WARN("NET/Socket : Connection closed by remote peer %s", ncclSocketToString(&r->sock->addr, line, 0));
+      r->result = ncclRemoteError;
+    } else if (res == -EAGAIN) {
+      ncclNetSocketStatsCount(comm, r->sock - comm->socks, 0, 1);
+    } else if (res < 0 && res != -EINTR) {
+      char line[SOCKET_NAME_MAXLEN+1];
+      WARN("NET/Socket : io_uring %s from/to %s failed : %s", r->op == NCCL_SOCKET_SEND ? "send" : "recv",
+          ncclSocketToString(&r->sock->addr, line), strerror(-res));
+      r->result = ncclRemoteError;
+    }
+    if (r->zc && r->zcNotifs == 0 && r->offset == r->size) r->zcDone = 1;
+  }
+
+  // Same ordered list of posted tasks as the helper threads keep, progressed by the proxy thread
+  struct ncclNetSocketThreadResources* res = comm->threadResources;
+  struct ncclNetSocketTaskQueue* queue = &res->threadTaskQueue;
+  while (queue->head != queue->tail) res->active[res->nActive++] = queue->ring[queue->head++ & queue->ringMask];
+  uint64_t busy = 0;
+  for (int s=0; s<comm->nSocks; s++) if (comm->ringInflight[s]) busy |= (1ULL << s);
+  int n = 0;
+  for (int i=0; i<res->nActive; i++) {
+    struct ncclNetSocketTask* r = res->active[i];
+    if (ncclNetSocketTaskCheck(comm, r)) continue;
+    res->active[n++] = r;
+    if (r->result != ncclSuccess || r->closed || (r->hdrOffset == r->hdrSize && r->offset >= r->size)) continue;
+    int s = r->sock - comm->socks;
+    if (busy & (1ULL << s)) continue;
+    struct io_uring_sqe* sqe = ncclIoUringGetSqe(ring);
+    if (sqe == NULL) continue;
+    busy |= (1ULL << s);
+    comm->ringInflight[s] = r;
+    sqe->fd = s; // Index in the registered file table
+    sqe->flags = IOSQE_FIXED_FILE;
+    sqe->addr = (uint64_t)(uintptr_t)((char*)r->data+r->offset);
+    sqe->len = r->size-r->offset;
+    sqe->user_data = (uint64_t)(uintptr_t)r;
+    struct ncclNetSocketMr* mr = r->mr;
+    if (r->hdrOffset < r->hdrSize) {
+      sqe->addr = (uint64_t)(uintptr_t)((char*)&r->hdr+r->hdrOffset);
+      sqe->len = r->hdrSize-r->hdrOffset;
+      sqe->opcode = r->op == NCCL_SOCKET_SEND ? IORING_OP_SEND : IORING_OP_RECV;
+      sqe->msg_flags = r->op == NCCL_SOCKET_SEND ? MSG_NOSIGNAL : 0;
+    } else if (r->op == NCCL_SOCKET_RECV && mr && mr->comm == comm && ring->nBuffers &&
+        (char*)r->data >= mr->data && (char*)r->data+r->size <= mr->data+mr->size) {
+      // Sockets are not seekable: the offset must be 0
+      sqe->opcode = IORING_OP_READ_FIXED;
+      sqe->buf_index = mr->index;
+      sqe->off = 0;
+    } else if (r->zc) {
+      sqe->opcode = IORING_OP_SEND_ZC;
+      sqe->msg_flags = MSG_NOSIGNAL;
+      sqe->ioprio = IORING_SEND_ZC_REPORT_USAGE;
+    } else {
+      // Sends always go through IORING_OP_SEND so that we can pass MSG_NOSIGNAL
+      sqe->opcode = r->op == NCCL_SOCKET_SEND ? IORING_OP_SEND : IORING_OP_RECV;
+      sqe->msg_flags = r->op == NCCL_SOCKET_SEND ? MSG_NOSIGNAL : 0;
+    }
+  }
+  res->nActive = n;
+  NCCLCHECK(ncclIoUringSubmit(ring));
+  return ncclSuccess;
+}
+
+static int ncclNetSocketTaskDone(struct ncclNetSocketTask* t) {
+  return __atomic_load_n(&t->done, __ATOMIC_ACQUIRE);
+}
+
+// Divide the data of r, from chunkOffset on, into tasks over the data sockets in round-robin order.
+// If hdr is set, it is sent in front of the first chunk, which is then posted even for an empty message.
+static ncclResult_t ncclNetSocketPostTasks(struct ncclNetSocketRequest* r, int chunkOffset, struct ncclNetSocketHeader* hdr) {
+  struct ncclNetSocketComm* comm = r->comm;
+  // each request can be divided up to nSocks tasks
+  int taskSize = ncclNetSocketTaskSize(comm, r->size);
+  while (chunkOffset < r->size || hdr) {
+    int chunkSize = std::min(taskSize, r->size-chunkOffset);
+    NCCLCHECK(ncclNetSocketGetTask(comm, comm->nextSock, r->op, (char*)(r->data)+chunkOffset, chunkSize, r->mr, hdr, r->tasks+r->nSubs));
+    r->nSubs++;
     comm->nextSock = (comm->nextSock + 1) % comm->nSocks;
-    r->used = 1;
-    *req = r;
-    pthread_mutex_lock(&res->threadLock);
-    queue->next = (queue->next+1)%queue->len;
-    pthread_cond_signal(&res->threadCond);
-    pthread_mutex_unlock(&res->threadLock);
+    chunkOffset += chunkSize;
+    hdr = NULL;
+  }
+  return ncclSuccess;
+}
+
+// Check size is less or equal to the size provided by the user
+static ncclResult_t ncclNetSocketCheckSize(struct ncclNetSocketRequest* r, int size) {
+  if (size > r->size) {
+    char line[SOCKET_NAME_MAXLEN+1];
+    union ncclSocketAddress addr;
+    ncclSocketGetAddr(r->ctrlSock, &addr);
+    WARN("NET/Socket : peer %s message truncated : receiving %d bytes instead of %d. If you believe your socket network is in healthy state, \
+        there may be a mismatch in collective sizes or environment settings (e.g. NCCL_PROTO, NCCL_ALGO) between ranks",
+        ncclSocketToString(&addr, line), size, r->size);
+    return ncclInvalidUsage;
+  }
+  return ncclSuccess;
+}
+
+static ncclResult_t ncclNetSocketCheckHeader(struct ncclNetSocketComm* comm, struct ncclNetSocketHeader* hdr) {
+  if (hdr->seq != comm->seq || hdr->size < 0) {
+    char line[SOCKET_NAME_MAXLEN+1];
+    WARN("NET/Socket : peer %s sent an invalid message header (seq %u size %d, expected seq %u)",
+        ncclSocketToString(&comm->ctrlSock.addr, line), hdr->seq, hdr->size, comm->seq);
+    return ncclRemoteError;
+  }
+  comm->seq++;
+  return ncclSuccess;
+}
+
+// Return a task to the free list of its queue. Tasks are only freed by the proxy thread, once done.
+static void ncclNetSocketTaskFree(struct ncclNetSocketComm* comm, struct ncclNetSocketTask* t) {
+  int tid = comm->useRing ? 0 : (t->sock - comm->socks) % comm->nThreads;
+  struct ncclNetSocketTaskQueue* queue = &comm->threadResources[tid].threadTaskQueue;
+  t->used = 0;
+  t->nextFree = queue->freeTasks;
+  queue->freeTasks = t;
+}
+
+static void ncclNetSocketRequestFree(struct ncclNetSocketRequest* r) {
+  struct ncclNetSocketComm* comm = r->comm;
+  for (int i=0; i<r->nSubs; i++) ncclNetSocketTaskFree(comm, r->tasks[i]);
+  if (r->unexpected) free(r->data);
+  r->used = 0;
+  r->next = comm->freeRequests;
+  comm->freeRequests = r;
+  comm->nFreeRequests++;
+}
+
+// Requests kept free for receives when taking unexpected messages, enough for a grouped receive
+#define UNEXPECTED_RESERVE (MAX_RECVS+1)
+
+// Find the oldest posted receive with the tag of an incoming message. If there is none yet,
+// receive the message into a bounce buffer and keep it in the unexpected list. *req is set to
+// NULL, and the header left unprocessed, when no request can be spared for the bounce buffer or
+// an earlier message has not been matched yet.
+static ncclResult_t ncclNetSocketMatch(struct ncclNetSocketComm* comm, struct ncclNetSocketHeader* hdr, struct ncclNetSocketRequest** req) {
+  *req = NULL;
+  // With the latency lane, wait until the headers of the messages sent before this one have been
+  // matched, whichever socket they arrive on
+  int32_t ahead = (int32_t)(hdr->seq - comm->seq);
+  if (comm->lane && ahead > 0 && ahead <= comm->nRequests) return ncclSuccess;
+  struct ncclNetSocketRequest* prev = NULL;
+  struct ncclNetSocketRequest* r = comm->postedHead;
+  while (r && r->tag != hdr->tag) { prev = r; r = r->next; }
+  if (r == NULL && comm->nFreeRequests <= UNEXPECTED_RESERVE) return ncclSuccess;
+  NCCLCHECK(ncclNetSocketCheckHeader(comm, hdr));
+  if (r) {
+    if (prev) prev->next = r->next;
+    else comm->postedHead = r->next;
+    if (comm->postedTail == r) comm->postedTail = prev;
+    r->next = NULL;
+    NCCLCHECK(ncclNetSocketCheckSize(r, hdr->size));
+    r->size = hdr->size;
+  } else {
+    char* buff;
+    NCCLCHECK(ncclCalloc(&buff, std::max(hdr->size, 1)));
+    NCCLCHECK(ncclNetSocketGetRequest(comm, NCCL_SOCKET_RECV, buff, hdr->size, NULL, &r));
+    r->tag = hdr->tag;
+    r->unexpected = 1;
+    if (comm->unexTail) comm->unexTail->next = r;
+    else comm->unexHead = r;
+    comm->unexTail = r;
+    TRACE(NCCL_NET, "NET/Socket : unexpected message tag %d size %d", hdr->tag, hdr->size);
+  }
+  r->compressed = (hdr->flags & NCCL_NET_SOCKET_HDR_COMPRESSED) ? 1 : 0;
+  *req = r;
+  return ncclSuccess;
+}
+
+// Match a new receive with the oldest unexpected message carrying its tag, or queue it until
+// such a message arrives.
+static ncclResult_t ncclNetSocketPostRecv(struct ncclNetSocketComm* comm, struct ncclNetSocketRequest* r) {
+  struct ncclNetSocketRequest* prev = NULL;
+  struct ncclNetSocketRequest* u = comm->unexHead;
+  while (u && u->tag != r->tag) { prev = u; u = u->next; }
+  if (u) {
+    if (prev) prev->next = u->next;
+    else comm->unexHead = u->next;
+    if (comm->unexTail == u) comm->unexTail = prev;
+    u->next = NULL;
+    NCCLCHECK(ncclNetSocketCheckSize(r, u->size));
+    r->unex = u;
     return ncclSuccess;
   }
-  WARN("NET/Socket : unable to allocate subtasks");
-  return ncclInternalError;
+  if (comm->postedTail) comm->postedTail->next = r;
+  else comm->postedHead = r;
+  comm->postedTail = r;
+  return ncclSuccess;
+}
+
+// Progress a framed stream over sock, or over AF_XDP in place of the control socket
+static ncclResult_t ncclNetSocketStreamProgressIov(struct ncclNetSocketComm* comm, int op, struct ncclSocket* sock, const struct iovec* iov, int iovcnt, int* offset, int* closed = NULL) {
+  int before = *offset;
+  if (comm->xdp && sock == &comm->ctrlSock) {
+    NCCLCHECK(ncclXdpConnProgressIov(comm->xdp, op, iov, iovcnt, offset));
+  } else {
+    NCCLCHECK(ncclSocketProgressIov(op, sock, iov, iovcnt, offset, closed));
+  }
+  if (comm->stats) {
+    int total = 0;
+    for (int i=0; i<iovcnt; i++) total += iov[i].iov_len;
+    ncclNetSocketStatsCount(comm, sock == &comm->laneSock ? comm->nSocks+1 : comm->nSocks, *offset-before, total-before);
+  }
+  return ncclSuccess;
+}
+
+// Framed protocol, send side over a single socket (the control socket without data sockets, or the
+// latency lane): messages go one after the other, in posting order. Headers and payloads of the
+// messages posted since the last call are gathered into a single sendmsg, as long as the messages
+// after the first are small.
+static ncclResult_t ncclNetSocketFramedSendProgress(struct ncclNetSocketComm* comm, struct ncclNetSocketSendFifo* fifo) {
+  int64_t coalesceBytes = ncclParamSocketCoalesceBytes();
+  while (fifo->head != fifo->tail) {
+    struct ncclNetSocketRequest* r = fifo->reqs[fifo->head % MAX_REQUESTS];
+    if (r->zc) {
+      if (r->hdrOffset < r->hdrSize) {
+        NCCLCHECK(ncclSocketProgress(NCCL_SOCKET_SEND, r->ctrlSock, &r->hdr, r->hdrSize, &r->hdrOffset));
+        if (r->hdrOffset < r->hdrSize) return ncclSuccess;
+      }
+      struct ncclNetSocketZeroCopy* zc = comm->zc+comm->nSocks;
+      int before = r->offset;
+      NCCLCHECK(ncclSocketSendZeroCopy(r->ctrlSock, r->data, r->size, &r->offset, &zc->sent));
+      ncclNetSocketStatsCount(comm, comm->nSocks, r->offset-before, r->size-before);
+      r->zcSeq = zc->sent;
+      if (r->offset < r->size) return ncclSuccess;
+      r->used = 2;
+      fifo->head++;
+      continue;
+    }
+    struct iovec iov[NCCL_SOCKET_MAX_IOV];
+    int n = 0;
+    for (uint32_t i=fifo->head; i!=fifo->tail && n+2<=NCCL_SOCKET_MAX_IOV; i++) {
+      struct ncclNetSocketRequest* q = fifo->reqs[i % MAX_REQUESTS];
+      if (n > 0 && (q->zc || q->size > coalesceBytes)) break;
+      iov[n].iov_base = &q->hdr;
+      iov[n++].iov_len = q->hdrSize;
+      iov[n].iov_base = q->data;
+      iov[n++].iov_len = q->size;
+    }
+    // Only the first message can have been partially sent
+    int offset = r->hdrOffset + r->offset;
+    uint64_t end = comm->xdp ? ncclXdpConnSent(comm->xdp) - offset : 0;
+    NCCLCHECK(ncclNetSocketStreamProgressIov(comm, NCCL_SOCKET_SEND, r->ctrlSock, iov, n, &offset));
+    for (int m=0; m<n/2; m++) {
+      struct ncclNetSocketRequest* q = fifo->reqs[fifo->head % MAX_REQUESTS];
+      q->hdrOffset = std::min(offset, q->hdrSize);
+      q->offset = std::min(std::max(0, offset-q->hdrSize), q->size);
+      offset -= q->hdrOffset + q->offset;
+      if (q->hdrOffset < q->hdrSize || q->offset < q->size) return ncclSuccess;
+      end += q->hdrSize + q->size;
+      q->xdpEnd = end;
+      q->used = 2;
+      fifo->head++;
+    }
+  }
+  return ncclSuccess;
+}
+
+// Receive the chunks of a compressed message, decompressing each one into the receive buffer once
+// it has arrived
+static ncclResult_t ncclNetSocketCompressedRecvProgress(struct ncclNetSocketComm* comm, struct ncclNetSocketRecvStream* in, struct ncclNetSocketRequest* r) {
+  struct ncclCompressChunk* c = &in->chunk;
+  int chunkHdrSize = sizeof(struct ncclCompressChunk);
+  while (r->offset < r->size) {
+    if (in->chunkOffset < chunkHdrSize) {
+      struct iovec iov = { c, (size_t)chunkHdrSize };
+      NCCLCHECK(ncclNetSocketStreamProgressIov(comm, NCCL_SOCKET_RECV, in->sock, &iov, 1, &in->chunkOffset));
+      if (in->chunkOffset < chunkHdrSize) return ncclSuccess;
+      if (c->size == 0 || c->size > r->size-r->offset || c->wireSize > NCCL_COMPRESS_CHUNK_SIZE) {
+        char line[SOCKET_NAME_MAXLEN+1];
+        WARN("NET/Socket : peer %s sent an invalid compressed chunk (size %u wire size %u, %d bytes left)",
+            ncclSocketToString(&in->sock->addr, line), c->size, c->wireSize, r->size-r->offset);
+        return ncclRemoteError;
+      }
+      if (in->zbuf == NULL) NCCLCHECK(ncclCalloc(&in->zbuf, NCCL_COMPRESS_CHUNK_SIZE));
+    }
+    struct iovec iov = { in->zbuf, c->wireSize };
+    int offset = in->chunkOffset-chunkHdrSize;
+    NCCLCHECK(ncclNetSocketStreamProgressIov(comm, NCCL_SOCKET_RECV, in->sock, &iov, 1, &offset));
+    in->chunkOffset = chunkHdrSize+offset;
+    if (offset < c->wireSize) return ncclSuccess;
+    NCCLCHECK(ncclDecompressChunk(c, in->zbuf, (char*)r->data+r->offset));
+    r->offset += c->size;
+    in->chunkOffset = 0;
+  }
+  return ncclSuccess;
+}
+
+// Framed protocol, receive side over a single socket: the payload of a message must be received
+// before the next header. *matched is set if a message was matched with a receive.
+static ncclResult_t ncclNetSocketStreamRecvProgress(struct ncclNetSocketComm* comm, struct ncclNetSocketRecvStream* in, int* matched) {
+  struct ncclNetSocketRequest* r;
+  while (1) {
+    if ((r = in->req) != NULL) {
+      if (r->compressed) {
+        NCCLCHECK(ncclNetSocketCompressedRecvProgress(comm, in, r));
+      } else if (r->offset < r->size) {
+        // Read ahead the header of the next message with the payload, if it has arrived already,
+        // and ignore the peer closing the connection after its last message.
+        struct iovec iov[2] = { { r->data, (size_t)r->size }, { &in->hdr, sizeof(struct ncclNetSocketHeader) } };
+        int offset = r->offset, closed = 0;
+        NCCLCHECK(ncclNetSocketStreamProgressIov(comm, NCCL_SOCKET_RECV, in->sock, iov, 2, &offset, &closed));
+        r->offset = std::min(offset, r->size);
+        in->hdrOffset = offset-r->offset;
+        if (closed && r->offset < r->size) {
+          char line[SOCKET_NAME_MAXLEN+1];
+          WARN("NET/Socket : Connection closed by remote peer %s", ncclSocketToString(&in->sock->addr, line, 0));
+          return ncclRemoteError;
+        }
+      }
+      if (r->offset < r->size) return ncclSuccess;
+      r->used = 2;
+      in->req = NULL;
+    }
+    if (comm->postedHead == NULL) return ncclSuccess;
+    if (in->hdrOffset < sizeof(struct ncclNetSocketHeader)) {
+      // The peer may close the lane once done while messages are still pending on the other socket
+      struct iovec iov = { &in->hdr, sizeof(struct ncclNetSocketHeader) };
+      int closed = 0;
+      NCCLCHECK(ncclNetSocketStreamProgressIov(comm, NCCL_SOCKET_RECV, in->sock, &iov, 1, &in->hdrOffset, &closed));
+      if (closed && in->hdrOffset > 0) {
+        char line[SOCKET_NAME_MAXLEN+1];
+        WARN("NET/Socket : Connection closed by remote peer %s", ncclSocketToString(&in->sock->addr, line, 0));
+        return ncclRemoteError;
+      }
+      if (in->hdrOffset < sizeof(struct ncclNetSocketHeader)) return ncclSuccess;
+    }
+    NCCLCHECK(ncclNetSocketMatch(comm, &in->hdr, &r));
+    if (r == NULL) return ncclSuccess;
+    in->hdrOffset = 0;
+    in->req = r;
+    *matched = 1;
+  }
+}
+
+// Framed protocol, receive side with data sockets: each header is read by a task on the next data
+// socket, then the payload is posted over the data sockets.
+static ncclResult_t ncclNetSocketDataRecvProgress(struct ncclNetSocketComm* comm, int* matched) {
+  struct ncclNetSocketRequest* r;
+  while (1) {
+    if (comm->inTask == NULL) {
+      if (comm->postedHead == NULL) return ncclSuccess;
+      // The first chunk of a message is on the same socket as its header. Receive it along
+      // with the header if the message turns out to be the next one, for the oldest posted receive.
+      r = comm->postedHead;
+      struct ncclNetSocketHeader expected = { comm->seq, r->size, r->tag, 0 };
+      NCCLCHECK(ncclNetSocketGetTask(comm, comm->nextSock, NCCL_SOCKET_RECV, r->data, r->size, r->mr, &expected, &comm->inTask));
+      comm->inTaskReq = r;
+    }
+    if (comm->useRing) NCCLCHECK(ncclNetSocketRingProgress(comm));
+    struct ncclNetSocketTask* t = comm->inTask;
+    if (t->result != ncclSuccess) return t->result;
+    if (__atomic_load_n(&t->hdrOffset, __ATOMIC_ACQUIRE) < t->hdrSize) return ncclSuccess;
+    // A task whose payload is not for the oldest receive can only be released once its helper
+    // thread has seen it complete.
+    if (t->size == 0 && ncclNetSocketTaskDone(t) == 0) return ncclSuccess;
+    NCCLCHECK(ncclNetSocketMatch(comm, &t->hdr, &r));
+    if (r == NULL) return ncclSuccess;
+    *matched = 1;
+    int s = comm->nextSock;
+    comm->nextSock = (s + 1) % comm->nSocks;
+    int chunkOffset = 0;
+    if (r == comm->inTaskReq && t->size > 0) {
+      r->tasks[r->nSubs++] = t;
+      chunkOffset = t->size;
+    } else {
+      // Only the header was received; post the first chunk on the same socket
+      ncclNetSocketTaskFree(comm, t);
+      if (r->size > 0) {
+        chunkOffset = std::min(r->size, ncclNetSocketTaskSize(comm, r->size));
+        NCCLCHECK(ncclNetSocketGetTask(comm, s, NCCL_SOCKET_RECV, r->data, chunkOffset, r->mr, NULL, r->tasks+r->nSubs));
+        r->nSubs++;
+      }
+    }
+    comm->inTask = NULL;
+    NCCLCHECK(ncclNetSocketPostTasks(r, chunkOffset, NULL));
+    r->used = 2;
+  }
+}
+
+// Framed protocol, receive side: read the header of each incoming message in turn, match it with
+// a receive and post the transfer of its payload. We only read ahead while receives are posted,
+// so unexpected messages are bounded by what the peer has in flight. Matching a message on one
+// socket may let the next one, waiting on the other socket, be matched as well.
+static ncclResult_t ncclNetSocketFramedRecvProgress(struct ncclNetSocketComm* comm) {
+  int matched;
+  do {
+    matched = 0;
+    if (comm->lane) NCCLCHECK(ncclNetSocketStreamRecvProgress(comm, &comm->laneIn, &matched));
+    if (comm->nSocks == 0) {
+      NCCLCHECK(ncclNetSocketStreamRecvProgress(comm, &comm->ctrlIn, &matched));
+    } else {
+      NCCLCHECK(ncclNetSocketDataRecvProgress(comm, &matched));
+    }
+  } while (matched && comm->lane);
+  return ncclSuccess;
 }
 
-// who is calling ncclNetSocketTest??
 // it is called by recvProxyProgress in transport/net.cc when receiving data from a channel/socket
 // it is called by sendProxyProgress in transport/net.cc when sending data to a channel/socket
 // ncclNetSocketTest calls ncclSocketProgress
 
-ncclResult_t ncclNetSocketTest(void* request, int* done, int* size) {
+// Check whether a request has completed, without releasing it
+static ncclResult_t ncclNetSocketRequestTest(struct ncclNetSocketRequest* r, int* done) {
   *done = 0;
-  struct ncclNetSocketRequest *r = (struct ncclNetSocketRequest*)request;
-  if (r == NULL) {
-    WARN("NET/Socket : test called with NULL request");
-    return ncclInternalError;
+  if (r->unex) {
+    // Matched with an unexpected message: copy it out of the bounce buffer once it has arrived
+    struct ncclNetSocketRequest* u = r->unex;
+    int unexDone;
+    NCCLCHECK(ncclNetSocketRequestTest(u, &unexDone));
+    if (unexDone == 0) return ncclSuccess;
+    memcpy(r->data, u->data, u->size);
+    r->size = r->offset = u->size;
+    r->used = 2;
+    r->unex = NULL;
+    ncclNetSocketRequestFree(u);
   }
-  if (r->used == 1) { /* try to send/recv size */
+  if (r->used == 1 && r->comm->framed == 0) { /* try to send/recv size */
     int data = r->size;
     int offset = 0;
-    //INFO(NCCL_ALL,"XXXXXXXXXXXXXXXXXXXXXXXXX ncclNetSocketTest r->used == 1 operation: %s", (r->op == NCCL_SOCKET_SEND) ? "SEND" : "RECV");
     NCCLCHECK(ncclSocketProgress(r->op, r->ctrlSock, &data, sizeof(int), &offset));
 
     if (offset == 0) return ncclSuccess; /* Not ready -- retry later */
@@ -495,79 +1978,265 @@ ncclResult_t ncclNetSocketTest(void* request, int* done, int* size) {
     // Not sure we could ever receive less than 4 bytes, but just in case ...
     if (offset < sizeof(int)) NCCLCHECK(ncclSocketWait(r->op, r->ctrlSock, &data, sizeof(int), &offset));
 
-    // Check size is less or equal to the size provided by the user
-    if (r->op == NCCL_SOCKET_RECV && data > r->size) {
-      char line[SOCKET_NAME_MAXLEN+1];
-      union ncclSocketAddress addr;
-      ncclSocketGetAddr(r->ctrlSock, &addr);
-      WARN("NET/Socket : peer %s message truncated : receiving %d bytes instead of %d. If you believe your socket network is in healthy state, \
-          there may be a mismatch in collective sizes or environment settings (e.g. NCCL_PROTO, NCCL_ALGO) between ranks",
-          ncclSocketToString(&addr, line), data, r->size);
-      return ncclInvalidUsage;
+    if (r->comm->stats) {
+      r->comm->stats->sizeWaitNs += clockNano()-r->start;
+      r->comm->stats->nSizeWaits++;
     }
+
+    // Check size is less or equal to the size provided by the user
+    if (r->op == NCCL_SOCKET_RECV) NCCLCHECK(ncclNetSocketCheckSize(r, data));
     r->size = data;
     r->offset = 0;
     r->used = 2; // done exchanging size
+    r->zc = r->comm->nSocks == 0 && ncclNetSocketUseZeroCopy(r->comm, r->comm->nSocks, r->op, r->size);
     // divide into subtasks
-    int chunkOffset = 0, i = 0;
-    if (r->comm->nSocks > 0) {
-      // each request can be divided up to nSocks tasks
-      int taskSize = std::max(MIN_CHUNKSIZE, DIVUP(r->size, r->comm->nSocks));
-      while (chunkOffset < r->size) {
-        int chunkSize = std::min(taskSize, r->size-chunkOffset);
-        NCCLCHECK(ncclNetSocketGetTask(r->comm, r->op, (char*)(r->data)+chunkOffset, chunkSize, r->tasks+i++));
-        chunkOffset += chunkSize;
-      }
-    }
-    r->nSubs = i;
+    if (r->comm->nSocks > 0) NCCLCHECK(ncclNetSocketPostTasks(r, 0, NULL));
   }
   if (r->used == 2) { // already exchanged size
     if (r->nSubs > 0) {
+      if (r->comm->useRing) NCCLCHECK(ncclNetSocketRingProgress(r->comm));
       int nCompleted = 0;
       for (int i=0; i<r->nSubs; i++) {
         struct ncclNetSocketTask* sub = r->tasks[i];
         if (sub->result != ncclSuccess) return sub->result;
-        if (sub->offset == sub->size) nCompleted++;
-      }
-      if (nCompleted == r->nSubs) {
-        if (size) *size = r->size;
-        *done = 1;
-        r->used = 0;
-        for (int i=0; i<r->nSubs; i++) {
-          struct ncclNetSocketTask* sub = r->tasks[i];
-          sub->used = 0;
-        }
+        if (ncclNetSocketTaskDone(sub)) nCompleted++;
       }
+      if (nCompleted == r->nSubs) *done = 1;
     } else { // progress request using main thread
+      struct ncclNetSocketZeroCopy* zc = r->comm->zc+r->comm->nSocks;
+      if (zc->completed != zc->sent) NCCLCHECK(ncclNetSocketZeroCopyReap(r->ctrlSock, zc));
       if (r->offset < r->size) {
-        //INFO(NCCL_ALL,"XXXXXXXXXXXXXXXXXXXXXXXXX ncclNetSocketTest progress request using main thread");
-        NCCLCHECK(ncclSocketProgress(r->op, r->ctrlSock, r->data, r->size, &r->offset));
-      }
-      if (r->offset == r->size) {
-        if (size) *size = r->size;
-        *done = 1;
-        r->used = 0;
+        int before = r->offset;
+        if (r->zc) {
+          NCCLCHECK(ncclSocketSendZeroCopy(r->ctrlSock, r->data, r->size, &r->offset, &zc->sent));
+          r->zcSeq = zc->sent;
+        } else {
+          NCCLCHECK(ncclSocketProgress(r->op, r->ctrlSock, r->data, r->size, &r->offset));
+        }
+        ncclNetSocketStatsCount(r->comm, r->comm->nSocks, r->offset-before, r->size-before);
       }
+      // Zero-copy sends complete once the kernel has released the pages of the user buffer
+      if (r->offset == r->size && (r->zc == 0 || ncclNetSocketZeroCopyDone(zc, r->zcSeq))) *done = 1;
+      if (*done && r->op == NCCL_SOCKET_SEND && r->comm->xdp) NCCLCHECK(ncclXdpConnAcked(r->comm->xdp, r->xdpEnd, done));
     }
   }
   return ncclSuccess;
 }
 
-ncclResult_t ncclNetSocketRegMr(void* comm, void* data, size_t size, int type, void** mhandle) {
-  return (type != NCCL_PTR_HOST) ? ncclInternalError : ncclSuccess;
+// Record the completion latency of a request
+static void ncclNetSocketStatsDone(struct ncclNetSocketRequest* r) {
+  struct ncclNetSocketStats* stats = r->comm->stats;
+  if (stats == NULL) return;
+  uint64_t us = (clockNano()-r->start)/1000;
+  int bucket = 0;
+  while (us >= 2 && bucket < NCCL_NET_SOCKET_LATENCY_BUCKETS-1) { us >>= 1; bucket++; }
+  stats->latency[r->op == NCCL_SOCKET_SEND ? 0 : 1][bucket]++;
+}
+
+// Copy the statistics of a comm. Counters are updated without synchronization, so a copy taken
+// while the comm is in use may be slightly inconsistent.
+static ncclResult_t ncclNetSocketGetStats(void* opaqueComm, struct ncclNetSocketStats* stats) {
+  struct ncclNetSocketComm* comm = (struct ncclNetSocketComm*)opaqueComm;
+  if (comm->stats == NULL) {
+    memset(stats, 0, sizeof(struct ncclNetSocketStats));
+  } else {
+    memcpy(stats, comm->stats, sizeof(struct ncclNetSocketStats));
+  }
+  stats->nSocks = comm->nSocks;
+  stats->nThreads = comm->useRing ? 0 : comm->nThreads;
+  return ncclSuccess;
+}
+
+static ncclResult_t ncclNetSocketDumpStats(void* opaqueComm) {
+  struct ncclNetSocketStats stats;
+  NCCLCHECK(ncclNetSocketGetStats(opaqueComm, &stats));
+  for (int s=0; s<stats.nSocks+2; s++) {
+    struct ncclNetSocketSockStats* st = stats.socks+s;
+    if (st->calls == 0) continue;
+    char name[32];
+    if (s < stats.nSocks) snprintf(name, sizeof(name), "socket %d", s);
+    else snprintf(name, sizeof(name), "%s", s == stats.nSocks ? "control socket" : "latency lane");
+    INFO(NCCL_NET, "NET/Socket : comm %p %s : %lu bytes, %lu chunks, %lu calls, %lu EAGAIN, %lu partial",
+        opaqueComm, name, st->bytes, st->chunks, st->calls, st->eagain, st->partial);
+  }
+  for (int t=0; t<stats.nThreads; t++) {
+    struct ncclNetSocketThreadStats* th = stats.threads+t;
+    INFO(NCCL_NET, "NET/Socket : comm %p helper thread %d : busy %lu us, idle %lu us, blocked %lu us",
+        opaqueComm, t, th->busyNs/1000, th->idleNs/1000, th->blockedNs/1000);
+  }
+  if (stats.nSizeWaits) {
+    INFO(NCCL_NET, "NET/Socket : comm %p size exchange : %lu waits, %lu us on average", opaqueComm, stats.nSizeWaits, stats.sizeWaitNs/stats.nSizeWaits/1000);
+  }
+  for (int op=0; op<2; op++) {
+    char line[NCCL_NET_SOCKET_LATENCY_BUCKETS*32];
+    line[0] = '\0';
+    for (int b=0; b<NCCL_NET_SOCKET_LATENCY_BUCKETS; b++) {
+      if (stats.latency[op][b]) snprintf(line+strlen(line), sizeof(line)-strlen(line), " <%luus:%lu", 2UL << b, stats.latency[op][b]);
+    }
+    if (line[0]) INFO(NCCL_NET, "NET/Socket : comm %p %s latency%s", opaqueComm, op == 0 ? "send" : "receive", line);
+  }
+  return ncclSuccess;
+}
+
+ncclResult_t ncclNetSocketTest(void* request, int* done, int* size) {
+  *done = 0;
+  struct ncclNetSocketRequest *r = (struct ncclNetSocketRequest*)request;
+  if (r == NULL) {
+    WARN("NET/Socket : test called with NULL request");
+    return ncclInternalError;
+  }
+  struct ncclNetSocketStats* stats = r->comm->stats;
+  if (stats && ncclParamSocketStatsInterval() > 0 && clockNano()-r->comm->statsDumpTime >= ncclParamSocketStatsInterval()*1000000000ULL) {
+    r->comm->statsDumpTime = clockNano();
+    NCCLCHECK(ncclNetSocketDumpStats(r->comm));
+  }
+  if (r->comm->framed) {
+    NCCLCHECK(ncclNetSocketFramedSendProgress(r->comm, &r->comm->ctrlFifo));
+    if (r->comm->lane) NCCLCHECK(ncclNetSocketFramedSendProgress(r->comm, &r->comm->laneFifo));
+    NCCLCHECK(ncclNetSocketFramedRecvProgress(r->comm));
+  }
+  if (r->nRecvs > 0) {
+    // Grouped receive: complete once all buffers are. Sizes are reported for each buffer.
+    int nDone = 0;
+    for (int i=0; i<r->nRecvs; i++) {
+      int d;
+      NCCLCHECK(ncclNetSocketRequestTest(r->recvs[i], &d));
+      nDone += d;
+      // Legacy comms receive the buffers one after the other, in posting order
+      if (d == 0 && r->comm->framed == 0) break;
+    }
+    if (nDone < r->nRecvs) return ncclSuccess;
+    for (int i=0; i<r->nRecvs; i++) {
+      if (size) size[i] = r->recvs[i]->size;
+      ncclNetSocketStatsDone(r->recvs[i]);
+      ncclNetSocketRequestFree(r->recvs[i]);
+    }
+    ncclNetSocketRequestFree(r);
+    *done = 1;
+    return ncclSuccess;
+  }
+  NCCLCHECK(ncclNetSocketRequestTest(r, done));
+  if (*done) {
+    // Compressed sends report the size of the message, not what went on the wire
+    if (size) *size = (r->op == NCCL_SOCKET_SEND && r->compressed) ? r->hdr.size : r->size;
+    ncclNetSocketStatsDone(r);
+    ncclNetSocketRequestFree(r);
+  }
+  return ncclSuccess;
+}
+
+ncclResult_t ncclNetSocketRegMr(void* opaqueComm, void* data, size_t size, int type, void** mhandle) {
+  struct ncclNetSocketComm* comm = (struct ncclNetSocketComm*)opaqueComm;
+  if (type != NCCL_PTR_HOST) return ncclInternalError;
+  *mhandle = NULL;
+  if (comm->useRing == 0 || comm->ring.nBuffers == 0) return ncclSuccess;
+  // Register the buffer with the ring so the kernel does not need to map it for every operation
+  for (int i=0; i<MAX_RING_MRS; i++) {
+    if (comm->ringMrs[i] != NULL) continue;
+    if (ncclIoUringUpdateBuffer(&comm->ring, i, data, size) != ncclSuccess) return ncclSuccess;
+    struct ncclNetSocketMr* mr;
+    NCCLCHECK(ncclCalloc(&mr, 1));
+    mr->comm = comm;
+    mr->data = (char*)data;
+    mr->size = size;
+    mr->index = i;
+    comm->ringMrs[i] = mr;
+    *mhandle = mr;
+    return ncclSuccess;
+  }
+  return ncclSuccess;
+}
+ncclResult_t ncclNetSocketDeregMr(void* opaqueComm, void* mhandle) {
+  struct ncclNetSocketComm* comm = (struct ncclNetSocketComm*)opaqueComm;
+  struct ncclNetSocketMr* mr = (struct ncclNetSocketMr*)mhandle;
+  if (mr == NULL) return ncclSuccess;
+  NCCLCHECK(ncclIoUringUpdateBuffer(&comm->ring, mr->index, NULL, 0));
+  comm->ringMrs[mr->index] = NULL;
+  free(mr);
+  return ncclSuccess;
+}
+
+// Compress the message of a send request, which then sends the compressed data. Messages which do
+// not get smaller are sent as they are.
+static ncclResult_t ncclNetSocketCompressSend(struct ncclNetSocketRequest* r) {
+  size_t bound = ncclCompressBound(r->size);
+  if (r->zbufSize < bound) {
+    free(r->zbuf);
+    r->zbuf = NULL;
+    r->zbufSize = 0;
+    NCCLCHECK(ncclCalloc(&r->zbuf, bound));
+    r->zbufSize = bound;
+  }
+  int zsize;
+  NCCLCHECK(ncclCompress(r->data, r->size, r->comm->compress, r->zbuf, &zsize));
+  if (zsize >= r->size) return ncclSuccess;
+  r->hdr.flags |= NCCL_NET_SOCKET_HDR_COMPRESSED;
+  r->compressed = 1;
+  r->data = r->zbuf;
+  r->size = zsize;
+  return ncclSuccess;
 }
-ncclResult_t ncclNetSocketDeregMr(void* comm, void* mhandle) { return ncclSuccess; }
 
 ncclResult_t ncclNetSocketIsend(void* sendComm, void* data, int size, int tag, void* mhandle, void** request) {
   struct ncclNetSocketComm* comm = (struct ncclNetSocketComm*)sendComm;
-  NCCLCHECK(ncclNetSocketGetRequest(comm, NCCL_SOCKET_SEND, data, size, (struct ncclNetSocketRequest**)request));
+  struct ncclNetSocketRequest* r;
+  *request = NULL;
+  // Small messages go over the latency lane, when there is one
+  struct ncclNetSocketSendFifo* fifo = NULL;
+  if (comm->lane && size <= ncclParamSocketLatencyLane()) fifo = &comm->laneFifo;
+  else if (comm->framed && comm->nSocks == 0) fifo = &comm->ctrlFifo;
+  // Out of requests, or of room in the send fifo: the proxy will try again
+  if (fifo && fifo->tail-fifo->head == MAX_REQUESTS) return ncclSuccess;
+  NCCLCHECK(ncclNetSocketGetRequest(comm, NCCL_SOCKET_SEND, data, size, (struct ncclNetSocketMr*)mhandle, &r));
+  if (r == NULL) return ncclSuccess;
+  if (comm->framed) {
+    // The header carries the size, so data can be sent right away
+    r->hdr.seq = comm->seq++;
+    r->hdr.size = size;
+    r->hdr.tag = tag;
+    r->hdr.flags = 0;
+    r->hdrSize = sizeof(struct ncclNetSocketHeader);
+    if (fifo == &comm->laneFifo) {
+      r->ctrlSock = &comm->laneSock;
+      fifo->reqs[fifo->tail++ % MAX_REQUESTS] = r;
+    } else if (comm->nSocks > 0) {
+      NCCLCHECK(ncclNetSocketPostTasks(r, 0, &r->hdr));
+      r->used = 2;
+    } else {
+      if (comm->compress && size >= COMPRESS_MIN_SIZE) NCCLCHECK(ncclNetSocketCompressSend(r));
+      r->zc = r->compressed == 0 && ncclNetSocketUseZeroCopy(comm, comm->nSocks, NCCL_SOCKET_SEND, size);
+      fifo->reqs[fifo->tail++ % MAX_REQUESTS] = r;
+    }
+  }
+  *request = r;
   return ncclSuccess;
 }
 
 ncclResult_t ncclNetSocketIrecv(void* recvComm, int n, void** data, int* sizes, int* tags, void** mhandles, void** request) {
   struct ncclNetSocketComm* comm = (struct ncclNetSocketComm*)recvComm;
-  if (n != 1) return ncclInternalError;
-  NCCLCHECK(ncclNetSocketGetRequest(comm, NCCL_SOCKET_RECV, data[0], sizes[0], (struct ncclNetSocketRequest**)request));
+  if (n < 1 || n > MAX_RECVS) return ncclInternalError;
+  // Without tags, a legacy comm matches messages with receives in posting order. This is safe for
+  // grouped receives too: peers using the legacy protocol advertise maxRecvs 1, so they do not
+  // share send comms and all messages of the comm come from one sender, in the order we post.
+  *request = NULL;
+  // All requests of a grouped receive are taken at once, or not at all
+  if (comm->nFreeRequests < n + (n > 1 ? 1 : 0)) return ncclSuccess;
+  struct ncclNetSocketRequest* group = NULL;
+  if (n > 1) {
+    NCCLCHECK(ncclNetSocketGetRequest(comm, NCCL_SOCKET_RECV, NULL, 0, NULL, &group));
+    group->nRecvs = n;
+  }
+  for (int i=0; i<n; i++) {
+    struct ncclNetSocketRequest* r;
+    NCCLCHECK(ncclNetSocketGetRequest(comm, NCCL_SOCKET_RECV, data[i], sizes[i], (struct ncclNetSocketMr*)mhandles[i], &r));
+    if (comm->framed) {
+      r->tag = tags[i];
+      NCCLCHECK(ncclNetSocketPostRecv(comm, r));
+    }
+    if (group) group->recvs[i] = r;
+    else *request = r;
+  }
+  if (group) *request = group;
   return ncclSuccess;
 }
 
@@ -582,6 +2251,7 @@ ncclResult_t ncclNetSocketCloseListen(void* opaqueComm) {
     int ready;
     NCCLCHECK(ncclSocketReady(&comm->sock, &ready));
     if (ready) NCCLCHECK(ncclSocketClose(&comm->sock));
+    for (int r=1; r<comm->nRails; r++) NCCLCHECK(ncclSocketClose(comm->railSocks+r-1));
     free(comm);
   }
   return ncclSuccess;
@@ -593,21 +2263,41 @@ ncclResult_t ncclNetSocketClose(void* opaqueComm) {
     for (int i=0; i<comm->nThreads; i++) {
       struct ncclNetSocketThreadResources* res = comm->threadResources+i;
       if (comm->helperThread[i]) {
-        pthread_mutex_lock(&res->threadLock);
-        res->stop = 1;
-        pthread_cond_signal(&res->threadCond);
-        pthread_mutex_unlock(&res->threadLock);
+        __atomic_store_n(&res->stop, 1, __ATOMIC_RELEASE);
+        NCCLCHECK(ncclNetSocketThreadWake(res));
         pthread_join(comm->helperThread[i], NULL);
+        close(res->epollFd);
+        close(res->eventFd);
       }
       free(res->threadTaskQueue.tasks);
+      free(res->threadTaskQueue.ring);
+      free(res->active);
     }
+    if (comm->useRing) {
+      // Closing the ring cancels operations still in flight
+      NCCLCHECK(ncclIoUringClose(&comm->ring));
+      for (int i=0; i<MAX_RING_MRS; i++) free(comm->ringMrs[i]);
+    }
+    if (comm->xdp) NCCLCHECK(ncclXdpConnClose(comm->xdp));
     int ready;
     NCCLCHECK(ncclSocketReady(&comm->ctrlSock, &ready));
     if (ready) NCCLCHECK(ncclSocketClose(&comm->ctrlSock));
+    if (comm->lane) NCCLCHECK(ncclSocketClose(&comm->laneSock));
     for (int i=0; i<comm->nSocks; i++) {
       NCCLCHECK(ncclSocketReady(&comm->socks[i], &ready));
       if (ready) NCCLCHECK(ncclSocketClose(&comm->socks[i]));
     }
+    for (int i=0; i<comm->nRequests; i++) {
+      if (comm->requests[i].used && comm->requests[i].unexpected) free(comm->requests[i].data);
+      free(comm->requests[i].zbuf);
+    }
+    free(comm->ctrlIn.zbuf);
+    free(comm->laneIn.zbuf);
+    free(comm->requests);
+    if (comm->calib) free(comm->calib->buf);
+    free(comm->calib);
+    if (comm->stats) NCCLCHECK(ncclNetSocketDumpStats(comm));
+    free(comm->stats);
     free(comm);
   }
   return ncclSuccess;
@@ -0,0 +1,140 @@
+/*************************************************************************
+ * Copyright (c) 2024, NVIDIA CORPORATION. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+// Grouped receives of the socket transport against a peer using the legacy protocol. A listener
+// with framing enabled, which therefore advertises maxRecvs > 1, accepts a connection from a
+// process running with NCCL_SOCKET_FRAMING=0, which stands for an older peer. The comm falls
+// back to the legacy protocol, and grouped receives must still deliver each message into its
+// buffer, in posting order. The same exchange is then run against a framed connector.
+
+#include "net.h"
+#include <sys/wait.h>
+#include <algorithm>
+
+#define NGROUPS 4
+#define NRECVS 4
+#define MAX_SIZE (1<<20)
+
+static int testFailed = 0;
+#define EXPECT(cond, ...) do { \
+  if (!(cond)) { WARN(__VA_ARGS__); testFailed = 1; } \
+} while (0)
+
+// Size and contents of message i, so that both processes agree on them
+static int testSize(int i) {
+  static const int sizes[] = { 0, 4, 8192, 65536+13, MAX_SIZE };
+  return sizes[i % (sizeof(sizes)/sizeof(sizes[0]))];
+}
+static char testByte(int i, int offset) {
+  return (char)(i*131 + offset*7);
+}
+
+static ncclResult_t testWait(void* request, int* sizes) {
+  int done = 0;
+  while (done == 0) NCCLCHECK(ncclNetSocket.test(request, &done, sizes));
+  return ncclSuccess;
+}
+
+// Connect to the handle, send all messages, then wait for the listener to be done with them
+static ncclResult_t testConnector(char* handle, int doneFd) {
+  void* sendComm = NULL;
+  ncclNetDeviceHandle_t* devHandle = NULL;
+  char* data;
+  void* requests[NGROUPS*NRECVS];
+  char ack;
+
+  NCCLCHECK(ncclNetSocket.init(NULL));
+  while (sendComm == NULL) NCCLCHECK(ncclNetSocket.connect(0, handle, &sendComm, &devHandle));
+  NCCLCHECK(ncclCalloc(&data, (size_t)NGROUPS*NRECVS*MAX_SIZE));
+  for (int i=0; i<NGROUPS*NRECVS; i++) {
+    char* buf = data+(size_t)i*MAX_SIZE;
+    for (int o=0; o<testSize(i); o++) buf[o] = testByte(i, o);
+    requests[i] = NULL;
+    while (requests[i] == NULL) NCCLCHECK(ncclNetSocket.isend(sendComm, buf, testSize(i), i%NRECVS, NULL, requests+i));
+  }
+  for (int i=0; i<NGROUPS*NRECVS; i++) NCCLCHECK(testWait(requests[i], NULL));
+  if (read(doneFd, &ack, 1) != 1) return ncclSystemError;
+  NCCLCHECK(ncclNetSocket.closeSend(sendComm));
+  free(data);
+  return ncclSuccess;
+}
+
+// Accept a connection from a connector using the given framing setting, and receive the
+// messages in groups of NRECVS
+static ncclResult_t testRun(int framing) {
+  ncclResult_t ret = ncclSuccess;
+  char handle[NCCL_NET_HANDLE_MAXSIZE];
+  void* listenComm = NULL, *recvComm = NULL;
+  ncclNetDeviceHandle_t* devHandle = NULL;
+  char* data = NULL;
+  int doneFds[2];
+  int status;
+  pid_t pid;
+
+  NCCLCHECK(ncclNetSocket.listen(0, handle, &listenComm));
+  if (pipe(doneFds) != 0) return ncclSystemError;
+  fflush(stdout);
+  pid = fork();
+  if (pid < 0) return ncclSystemError;
+  if (pid == 0) {
+    char value[2] = { (char)('0'+framing), '\0' };
+    setenv("NCCL_SOCKET_FRAMING", value, 1);
+    close(doneFds[1]);
+    _exit(testConnector(handle, doneFds[0]) == ncclSuccess ? 0 : 1);
+  }
+  close(doneFds[0]);
+
+  while (recvComm == NULL) NCCLCHECKGOTO(ncclNetSocket.accept(listenComm, &recvComm, &devHandle), ret, exit);
+  NCCLCHECKGOTO(ncclCalloc(&data, (size_t)NRECVS*MAX_SIZE), ret, exit);
+  for (int g=0; g<NGROUPS; g++) {
+    void* bufs[NRECVS];
+    void* mhandles[NRECVS];
+    int sizes[NRECVS], tags[NRECVS];
+    void* request = NULL;
+    for (int r=0; r<NRECVS; r++) {
+      bufs[r] = data+(size_t)r*MAX_SIZE;
+      memset(bufs[r], 0xff, MAX_SIZE);
+      mhandles[r] = NULL;
+      sizes[r] = MAX_SIZE;
+      tags[r] = r;
+    }
+    while (request == NULL) NCCLCHECKGOTO(ncclNetSocket.irecv(recvComm, NRECVS, bufs, sizes, tags, mhandles, &request), ret, exit);
+    NCCLCHECKGOTO(testWait(request, sizes), ret, exit);
+    for (int r=0; r<NRECVS; r++) {
+      int i = g*NRECVS+r;
+      char* buf = (char*)bufs[r];
+      EXPECT(sizes[r] == testSize(i), "framing %d: message %d received %d bytes instead of %d", framing, i, sizes[r], testSize(i));
+      for (int o=0; o<std::min(sizes[r], testSize(i)); o++) {
+        if (buf[o] == testByte(i, o)) continue;
+        EXPECT(0, "framing %d: message %d differs at offset %d", framing, i, o);
+        break;
+      }
+    }
+  }
+
+exit:
+  if (write(doneFds[1], "", 1) != 1) ret = ncclSystemError;
+  close(doneFds[1]);
+  if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    WARN("framing %d: connector failed", framing);
+    ret = ncclSystemError;
+  }
+  if (recvComm) ncclNetSocket.closeRecv(recvComm);
+  ncclNetSocket.closeListen(listenComm);
+  free(data);
+  return ret;
+}
+
+int main(int argc, char* argv[]) {
+  int ndev;
+  setenv("NCCL_SOCKET_IFNAME", "lo", 0);
+  if (ncclNetSocket.init(NULL) != ncclSuccess || ncclNetSocket.devices(&ndev) != ncclSuccess || ndev < 1) return 1;
+  for (int framing=0; framing<2; framing++) {
+    if (testRun(framing) != ncclSuccess) testFailed = 1;
+  }
+  printf("%s\n", testFailed ? "FAILED" : "PASSED");
+  return testFailed;
+}